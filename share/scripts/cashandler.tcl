@@ -51,4 +51,59 @@ proc initial_set {} {
 
 after realtime 0 [namespace code initial_set]
 
+######################################################
+
+user_setting create boolean fast_cassette_load \
+"Whether you want to intercept the BIOS tape routines (TAPION and TAPIN) to
+instantly load CAS images that are inserted in the normal cassetteplayer. The
+tape position is moved as-if the tape was really played, so loaders that don't
+use the BIOS (e.g. protected tapes) still get the normal waveform. This has no
+effect on WAV images." false
+
+variable fast_load_bps [list]
+
+proc update_fast_load {args} {
+	variable fast_load_bps
+	foreach bp $fast_load_bps {
+		debug remove_bp $bp
+	}
+	set fast_load_bps [list]
+	if {$::fast_cassette_load} {
+		set cond {[cashandler::in_msx_bios]}
+		lappend fast_load_bps [debug set_bp 0x00E1 $cond cashandler::fast_tapion]
+		lappend fast_load_bps [debug set_bp 0x00E4 $cond cashandler::fast_tapin]
+	}
+}
+
+proc in_msx_bios {} {
+	expr {!$::fast_cas_load_hack_enabled &&
+	      ([machine_info type] ne "SVI") && [pc_in_slot 0 0]}
+}
+
+proc fast_tapion {} {
+	# TAPION: turn the cassette motor on and read the header
+	# On failure (e.g. WAV image) just continue in the BIOS routine.
+	debug write ioports 0xAB 0x08 ;# motor on (PPI port C bit 4 reset)
+	if {[catch {cassetteplayer fastload header} ok] || !$ok} return
+	reg F 0x40 ;# ok, clear carry flag
+	bios_ret
+}
+
+proc fast_tapin {} {
+	# TAPIN: read one byte from the tape into register A
+	if {[catch {cassetteplayer fastload byte} val] || ($val < 0)} return
+	reg A $val
+	reg F 0x40 ;# ok, clear carry flag
+	bios_ret
+}
+
+proc bios_ret {} {
+	reg PC [peek16 [reg SP]]
+	reg SP [expr {[reg SP] + 2}]
+}
+
+trace add variable ::fast_cassette_load write [namespace code update_fast_load]
+
+after realtime 0 [namespace code update_fast_load]
+
 } ;# namespace cashandler
@@ -0,0 +1,164 @@
+#include "BootCache.hh"
+#include "Reactor.hh"
+#include "MSXMotherBoard.hh"
+#include "HardwareConfig.hh"
+#include "XMLElement.hh"
+#include "GlobalSettings.hh"
+#include "EventDistributor.hh"
+#include "Event.hh"
+#include "DiskManipulator.hh"
+#include "DiskContainer.hh"
+#include "SectorAccessibleDisk.hh"
+#include "SRAM.hh"
+#include "StateChangeDistributor.hh"
+#include "CliComm.hh"
+#include "FileOperations.hh"
+#include "MSXException.hh"
+#include "Version.hh"
+#include "serialize.hh"
+#include "sha1.hh"
+#include <cstdio>
+
+using std::string;
+
+namespace openmsx {
+
+BootCache::BootCache(Reactor& reactor_)
+	: reactor(reactor_)
+	, booting(false)
+{
+	reactor.getEventDistributor().registerEventListener(
+		OPENMSX_BOOT_EVENT, *this);
+}
+
+BootCache::~BootCache()
+{
+	reactor.getEventDistributor().unregisterEventListener(
+		OPENMSX_BOOT_EVENT, *this);
+}
+
+// The name of the cache file is the SHA1 of everything that influences the
+// boot of the machine.
+string BootCache::getCacheFile(MSXMotherBoard& board)
+{
+	// Savestates are only guaranteed to be compatible with the same
+	// version of openMSX.
+	string data = Version::full() + '\n';
+	data += board.getMachineConfig()->getConfig().dump();
+	for (auto& ext : board.getExtensions()) {
+		data += ext->getConfig().dump();
+	}
+	auto& filePool = reactor.getFilePool();
+	for (auto* drive : reactor.getDiskManipulator().getDrives(
+			board.getMachineID())) {
+		data += drive->getContainerName() + ": ";
+		if (auto* disk = drive->getSectorAccessibleDisk()) {
+			data += disk->getSha1Sum(filePool).toString();
+		}
+		data += '\n';
+	}
+	SHA1 sha1;
+	sha1.update(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+	return FileOperations::getUserDataDir() + "/bootcache/" +
+	       sha1.digest().toString() + ".omsb";
+}
+
+bool BootCache::restore(MSXMotherBoard& board)
+{
+	auto newBoard = reactor.createEmptyMotherBoard();
+	try {
+		BinInputArchive in(filename);
+		in.serialize("machine", *newBoard);
+	} catch (MSXException& e) {
+		reactor.getCliComm().printWarning(
+			"Couldn't restore boot cache " + filename + ": " +
+			e.getMessage());
+		return false;
+	}
+	// Use the actual host input, not the one at the time the state was
+	// stored (see also RestoreMachineCommand).
+	newBoard->getStateChangeDistributor().stopReplay(
+		newBoard->getCurrentTime());
+	reactor.replaceBoard(board, std::move(newBoard));
+	return true;
+}
+
+void BootCache::store(MSXMotherBoard& board)
+{
+	// Note: the archive replaces the file only when it's completely
+	// written, other openMSX processes might be reading it right now.
+	try {
+		FileOperations::mkdirp(FileOperations::getUserDataDir() + "/bootcache");
+		BinOutputArchive out(filename);
+		out.serialize("machine", board);
+		out.close();
+	} catch (MSXException& e) {
+		reactor.getCliComm().printWarning(
+			"Couldn't store boot cache " + filename + ": " +
+			e.getMessage());
+	}
+}
+
+void BootCache::check(MSXMotherBoard* activeBoard)
+{
+	if (machineID.empty()) return;
+	if (!activeBoard || (activeBoard->getMachineID() != machineID)) {
+		// switched to another machine
+		machineID.clear();
+		return;
+	}
+	auto& board = *activeBoard;
+	double storeTime = reactor.getGlobalSettings().
+		getBootCacheTimeSetting().getDouble();
+
+	// The stored state must only depend on the configuration. Input (or
+	// any other recorded state change) during the boot would end up in
+	// it as well.
+	if (board.getStateChangeDistributor().getLastEventTime() !=
+	    EmuTime::zero) {
+		machineID.clear();
+		return;
+	}
+
+	if (booting) {
+		booting = false;
+		// The stored state would contain the SRAM content (e.g. the
+		// CMOS settings and time of a real time clock), restoring it
+		// overwrites the SRAM files with outdated data.
+		if (SRAM::hasPersistentSRAM(board)) {
+			machineID.clear();
+			return;
+		}
+		try {
+			filename = getCacheFile(board);
+		} catch (MSXException& e) {
+			// e.g. a disk image that can't be read
+			machineID.clear();
+			return;
+		}
+		if (FileOperations::isRegularFile(filename) && restore(board)) {
+			machineID.clear();
+			return;
+		}
+	}
+	if ((board.getCurrentTime() - EmuTime::zero).toDouble() >= storeTime) {
+		store(board);
+		machineID.clear();
+	}
+}
+
+int BootCache::signalEvent(const std::shared_ptr<const Event>& /*event*/)
+{
+	// Only a cold boot of a freshly created machine, not a reset or a
+	// power cycle later on.
+	auto* board = reactor.getMotherBoard();
+	if (!board || (board->getCurrentTime() != EmuTime::zero)) return 0;
+	if (reactor.getGlobalSettings().getBootCacheTimeSetting().getDouble() == 0.0) {
+		return 0;
+	}
+	machineID = board->getMachineID();
+	booting = true;
+	return 0;
+}
+
+} // namespace openmsx
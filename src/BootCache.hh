@@ -0,0 +1,57 @@
+#ifndef BOOTCACHE_HH
+#define BOOTCACHE_HH
+
+#include "EventListener.hh"
+#include <string>
+
+namespace openmsx {
+
+class Reactor;
+class MSXMotherBoard;
+
+/** Skip the (slow) boot sequence of a machine by continuing from the state
+  * of an earlier boot of the same configuration.
+  *
+  * When the 'boot_cache_time' setting is non-zero, the state of a freshly
+  * powered up machine is stored after that amount of emulated time. When
+  * later a machine with the exact same configuration is powered up, it
+  * immediately continues from the stored state. The configuration consists
+  * of the machine and the extensions (including the SHA1 of all ROMs) and
+  * the content of the disk drives and hard disks.
+  *
+  * Machines with persistent SRAM (e.g. the CMOS settings of a real time
+  * clock) don't use the boot cache, neither do boots during which there
+  * was input.
+  */
+class BootCache final : private EventListener
+{
+public:
+	explicit BootCache(Reactor& reactor);
+	~BootCache();
+
+	/** Must be called regularly from the main loop (at a moment the
+	  * active board is not executing). This may replace the active board.
+	  */
+	void check(MSXMotherBoard* activeBoard);
+
+private:
+	std::string getCacheFile(MSXMotherBoard& board);
+	bool restore(MSXMotherBoard& board);
+	void store(MSXMotherBoard& board);
+
+	// EventListener
+	int signalEvent(const std::shared_ptr<const Event>& event) override;
+
+	Reactor& reactor;
+
+	// The machine that was freshly powered up, empty if none. Once the
+	// cache file is known, it's either restored or it's stored after the
+	// configured amount of time.
+	std::string machineID;
+	std::string filename;
+	bool booting;
+};
+
+} // namespace openmsx
+
+#endif
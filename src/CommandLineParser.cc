@@ -7,6 +7,7 @@
 #include "FileOperations.hh"
 #include "GlobalCliComm.hh"
 #include "StdioMessages.hh"
+#include "StartupProfiler.hh"
 #include "Version.hh"
 #include "CliConnection.hh"
 #include "ConfigException.hh"
@@ -62,6 +63,7 @@ CommandLineParser::CommandLineParser(Reactor& reactor_)
 	registerOption("-v",          versionOption, PHASE_BEFORE_INIT, 1);
 	registerOption("--version",   versionOption, PHASE_BEFORE_INIT, 1);
 	registerOption("-bash",       bashOption,    PHASE_BEFORE_INIT, 1);
+	registerOption("-profile-startup", profileStartupOption, PHASE_BEFORE_INIT);
 
 	registerOption("-setting",    settingOption, PHASE_BEFORE_SETTINGS);
 	registerOption("-control",    controlOption, PHASE_BEFORE_SETTINGS, 1);
@@ -170,10 +172,12 @@ void CommandLineParser::parse(int argc, char** argv)
 	     (phase <= PHASE_LAST) && (parseStatus != EXIT);
 	     phase = static_cast<ParsePhase>(phase + 1)) {
 		switch (phase) {
-		case PHASE_INIT:
+		case PHASE_INIT: {
+			StartupProfiler::Phase profile("Reactor init");
 			reactor.init();
 			getInterpreter().init(argv[0]);
 			break;
+		}
 		case PHASE_LOAD_SETTINGS:
 			// after -control and -setting has been parsed
 			if (parseStatus != CONTROL) {
@@ -189,6 +193,7 @@ void CommandLineParser::parse(int argc, char** argv)
 				// didn't specify one.
 				auto context = systemFileContext();
 				string filename = "settings.xml";
+				StartupProfiler::Phase profile("settings.xml");
 				try {
 					settingsConfig.loadSetting(context, filename);
 				} catch (XMLException& e) {
@@ -211,6 +216,7 @@ void CommandLineParser::parse(int argc, char** argv)
 			break;
 		case PHASE_DEFAULT_MACHINE: {
 			if (!haveConfig) {
+				StartupProfiler::Phase profile("default machine");
 				// load default config file in case the user didn't specify one
 				const auto& machine =
 					reactor.getMachineSetting().getString();
@@ -499,6 +505,7 @@ void CommandLineParser::MachineOption::parseOption(
 	const string& option, array_ref<string>& cmdLine)
 {
 	auto& parser = OUTER(CommandLineParser, machineOption);
+	StartupProfiler::Phase profile("machine");
 	if (parser.haveConfig) {
 		throw FatalError("Only one machine option allowed");
 	}
@@ -574,6 +581,20 @@ string_ref CommandLineParser::TestConfigOption::optionHelp() const
 	return "Test if the specified config works and exit";
 }
 
+// class ProfileStartupOption
+
+void CommandLineParser::ProfileStartupOption::parseOption(
+	const string& option, array_ref<string>& cmdLine)
+{
+	StartupProfiler::setReportFile(getArgument(option, cmdLine));
+}
+
+string_ref CommandLineParser::ProfileStartupOption::optionHelp() const
+{
+	return "Write a report of the startup time to the given file "
+	       "(JSON if the name ends with .json)";
+}
+
 // class BashOption
 
 void CommandLineParser::BashOption::parseOption(
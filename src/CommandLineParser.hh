@@ -126,6 +126,11 @@ private:
 		string_ref optionHelp() const override;
 	} testConfigOption;
 
+	struct ProfileStartupOption final : CLIOption {
+		void parseOption(const std::string& option, array_ref<std::string>& cmdLine) override;
+		string_ref optionHelp() const override;
+	} profileStartupOption;
+
 	struct BashOption final : CLIOption {
 		void parseOption(const std::string& option, array_ref<std::string>& cmdLine) override;
 		string_ref optionHelp() const override;
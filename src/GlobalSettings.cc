@@ -22,6 +22,21 @@ GlobalSettings::GlobalSettings(GlobalCommandController& commandController_)
 	        "automatically save settings when openMSX exits", true)
 	, pauseOnLostFocusSetting(commandController, "pause_on_lost_focus",
 	       "pause emulation when the openMSX window loses focus", false)
+	, sharedRomCacheSetting(commandController, "shared_rom_cache",
+	       "store decompressed copies of (g)zipped ROM images in the user "
+	       "data dir, and share their memory between openMSX processes",
+	       false)
+	, ramWriteTrackingSetting(commandController, "ram_write_tracking",
+	       "track writes to emulated RAM via the memory protection "
+	       "hardware, this speeds up reverse snapshots (only used for "
+	       "machines created after changing this setting)",
+	       false)
+	, bootCacheTimeSetting(commandController, "boot_cache_time",
+	       "emulated time (in seconds) after which the state of a freshly "
+	       "powered up machine is stored in the boot cache, later boots "
+	       "of the same configuration continue from that state, 0 "
+	       "disables the boot cache",
+	       0.0, 0.0, 3600.0)
 	, umrCallBackSetting(commandController, "umr_callback",
 		"Tcl proc to call when an UMR is detected", {})
 	, invalidPsgDirectionsSetting(commandController,
@@ -4,6 +4,7 @@
 #include "Observer.hh"
 #include "BooleanSetting.hh"
 #include "EnumSetting.hh"
+#include "FloatSetting.hh"
 #include "IntegerSetting.hh"
 #include "StringSetting.hh"
 #include "ThrottleManager.hh"
@@ -41,6 +42,15 @@ public:
 	BooleanSetting& getPauseOnLostFocusSetting() {
 		return pauseOnLostFocusSetting;
 	}
+	BooleanSetting& getSharedRomCacheSetting() {
+		return sharedRomCacheSetting;
+	}
+	BooleanSetting& getRamWriteTrackingSetting() {
+		return ramWriteTrackingSetting;
+	}
+	FloatSetting& getBootCacheTimeSetting() {
+		return bootCacheTimeSetting;
+	}
 	StringSetting& getUMRCallBackSetting() {
 		return umrCallBackSetting;
 	}
@@ -68,6 +78,9 @@ private:
 	BooleanSetting powerSetting;
 	BooleanSetting autoSaveSetting;
 	BooleanSetting pauseOnLostFocusSetting;
+	BooleanSetting sharedRomCacheSetting;
+	BooleanSetting ramWriteTrackingSetting;
+	FloatSetting bootCacheTimeSetting;
 	StringSetting  umrCallBackSetting;
 	StringSetting  invalidPsgDirectionsSetting;
 	EnumSetting<ResampledSoundDevice::ResampleType> resampleSetting;
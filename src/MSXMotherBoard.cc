@@ -1063,6 +1063,11 @@ void MSXMotherBoard::serialize(Archive& ar, unsigned version)
 	//    debugger, msxMixer, panasonicMemory, renShaTurbo,
 	//    ledStatus
 
+	// The blobs of each machine form a group, so that in a replay file
+	// the blobs of a snapshot can be stored as differences with the
+	// previous snapshot. This has no effect for normal savestates.
+	ar.beginBlobGroup();
+
 	// Scheduler must come early so that devices can query current time
 	ar.serialize("scheduler", *scheduler);
 	// MSXMixer has already set syncpoints, those are invalid now
@@ -9,8 +9,12 @@
 #include "DiskManipulator.hh"
 #include "DiskChanger.hh"
 #include "FilePool.hh"
+#include "CompressedFileAdapter.hh"
+#include "SRAM.hh"
 #include "UserSettings.hh"
 #include "RomDatabase.hh"
+#include "BootCache.hh"
+#include "StartupProfiler.hh"
 #include "TclCallbackMessages.hh"
 #include "MSXMotherBoard.hh"
 #include "StateChangeDistributor.hh"
@@ -37,6 +41,7 @@
 #include "Thread.hh"
 #include "Timer.hh"
 #include "serialize.hh"
+#include "DeltaBlock.hh"
 #include "openmsx.hh"
 #include "checked_cast.hh"
 #include "statp.hh"
@@ -148,6 +153,17 @@ private:
 	Reactor& reactor;
 };
 
+class CloneMachineCommand final : public Command
+{
+public:
+	CloneMachineCommand(CommandController& commandController, Reactor& reactor);
+	void execute(array_ref<TclObject> tokens, TclObject& result) override;
+	string help(const vector<string>& tokens) const override;
+	void tabCompletion(vector<string>& tokens) const override;
+private:
+	Reactor& reactor;
+};
+
 class ConfigInfo final : public InfoTopic
 {
 public:
@@ -203,11 +219,18 @@ void Reactor::init()
 		*globalCommandController, *this);
 	virtualDrive = make_unique<DiskChanger>(
 		*this, "virtual_drive");
-	filePool = make_unique<FilePool>(*globalCommandController, *this);
+	{
+		StartupProfiler::Phase profile("file pool");
+		filePool = make_unique<FilePool>(*globalCommandController, *this);
+	}
 	userSettings = make_unique<UserSettings>(
 		*globalCommandController);
-	softwareDatabase = make_unique<RomDatabase>(
-		*globalCommandController, *globalCliComm);
+	{
+		StartupProfiler::Phase profile("software database");
+		softwareDatabase = make_unique<RomDatabase>(
+			*globalCommandController, *globalCliComm);
+	}
+	bootCache = make_unique<BootCache>(*this);
 	afterCommand = make_unique<AfterCommand>(
 		*this, *eventDistributor, *globalCommandController);
 	quitCommand = make_unique<QuitCommand>(
@@ -230,6 +253,8 @@ void Reactor::init()
 		*globalCommandController, *this);
 	restoreMachineCommand = make_unique<RestoreMachineCommand>(
 		*globalCommandController, *this);
+	cloneMachineCommand = make_unique<CloneMachineCommand>(
+		*globalCommandController, *this);
 	aviRecordCommand = make_unique<AviRecorder>(*this);
 	extensionInfo = make_unique<ConfigInfo>(
 		getOpenMSXInfoCommand(), "extensions");
@@ -360,6 +385,33 @@ Reactor::Board Reactor::createEmptyMotherBoard()
 	return make_unique<MSXMotherBoard>(*this);
 }
 
+vector<Reactor::Board> Reactor::cloneMotherBoard(MSXMotherBoard& board, unsigned num)
+{
+	// Same mechanism as used for reverse: serialize the board once to an
+	// in-memory snapshot, and load that snapshot in each new board. ROM
+	// content isn't part of the snapshot, the new boards map the same ROM
+	// files (and share the decompressed images of compressed files).
+	LastDeltaBlocks lastDeltaBlocks;
+	vector<std::shared_ptr<DeltaBlock>> deltaBlocks;
+	MemOutputArchive out(lastDeltaBlocks, deltaBlocks, false);
+	out.serialize("machine", board);
+	size_t size;
+	auto savestate = out.releaseBuffer(size);
+
+	vector<Board> result;
+	for (unsigned i = 0; i < num; ++i) {
+		auto newBoard = createEmptyMotherBoard();
+		MemInputArchive in(savestate.data(), size, deltaBlocks);
+		in.serialize("machine", *newBoard);
+		// Like restore_machine: don't replay the input events that
+		// were recorded in the original board.
+		newBoard->getStateChangeDistributor().stopReplay(
+			newBoard->getCurrentTime());
+		result.push_back(move(newBoard));
+	}
+	return result;
+}
+
 void Reactor::replaceBoard(MSXMotherBoard& oldBoard_, Board newBoard_)
 {
 	assert(Thread::isMainThread());
@@ -470,6 +522,27 @@ void Reactor::deleteBoard(MSXMotherBoard* board)
 		make_shared<SimpleEvent>(OPENMSX_DELETE_BOARDS));
 }
 
+void Reactor::prepareFork()
+{
+	assert(Thread::isMainThread());
+	// The save threads don't exist in the child process.
+	SRAM::waitForPendingSaves();
+	mbMutex.lock();
+	eventDistributor->prepareFork();
+	globalCliComm->prepareFork();
+	filePool->prepareFork();
+	CompressedFileAdapter::prepareFork();
+}
+
+void Reactor::afterFork(bool child)
+{
+	CompressedFileAdapter::afterFork();
+	filePool->afterFork(child);
+	globalCliComm->afterFork(child);
+	eventDistributor->afterFork();
+	mbMutex.unlock();
+}
+
 void Reactor::enterMainLoop()
 {
 	// Note: this method can get called from different threads
@@ -492,6 +565,7 @@ void Reactor::run(CommandLineParser& parser)
 
 	// execute init.tcl
 	try {
+		StartupProfiler::Phase profile("init.tcl");
 		commandController.source(
 			preferSystemFileContext().resolve("init.tcl"));
 	} catch (FileException&) {
@@ -500,6 +574,7 @@ void Reactor::run(CommandLineParser& parser)
 
 	// execute startup scripts
 	for (auto& s : parser.getStartupScripts()) {
+		StartupProfiler::Phase profile("startup scripts");
 		try {
 			commandController.source(userFileContext().resolve(s));
 		} catch (FileException& e) {
@@ -511,6 +586,7 @@ void Reactor::run(CommandLineParser& parser)
 	// At this point openmsx is fully started, it's OK now to start
 	// accepting external commands
 	getGlobalCliComm().setAllowExternalCommands();
+	StartupProfiler::finish();
 
 	// Run
 	if (parser.getParseStatus() == CommandLineParser::RUN) {
@@ -528,6 +604,7 @@ void Reactor::run(CommandLineParser& parser)
 	while (running) {
 		eventDistributor->deliverEvents();
 		assert(garbageBoards.empty());
+		bootCache->check(activeBoard);
 		bool blocked = (blockedCounter > 0) || !activeBoard;
 		if (!blocked) blocked = !activeBoard->execute();
 		if (blocked) {
@@ -890,8 +967,14 @@ void StoreMachineCommand::execute(array_ref<TclObject> tokens, TclObject& result
 
 	auto& board = reactor.getMachine(machineID);
 
-	XmlOutputArchive out(filename);
-	out.serialize("machine", board);
+	if (StringOp::endsWith(filename, ".omsb")) {
+		BinOutputArchive out(filename);
+		out.serialize("machine", board);
+		out.close();
+	} else {
+		XmlOutputArchive out(filename);
+		out.serialize("machine", board);
+	}
 	result.setString(filename);
 }
 
@@ -902,6 +985,7 @@ string StoreMachineCommand::help(const vector<string>& /*tokens*/) const
 		"store_machine machineID             Save state of machine \"machineID\" to file \"openmsxNNNN.xml.gz\"\n"
                 "store_machine machineID <filename>  Save state of machine \"machineID\" to indicated file\n"
 		"\n"
+		"Files with extension \".omsb\" are stored in a (faster) binary format.\n"
 		"This is a low-level command, the 'savestate' script is easier to use.";
 }
 
@@ -959,8 +1043,13 @@ void RestoreMachineCommand::execute(array_ref<TclObject> tokens,
 
 	//std::cerr << "Loading " << filename << std::endl;
 	try {
-		XmlInputArchive in(filename);
-		in.serialize("machine", *newBoard);
+		if (BinInputArchive::isBinaryArchive(filename)) {
+			BinInputArchive in(filename);
+			in.serialize("machine", *newBoard);
+		} else {
+			XmlInputArchive in(filename);
+			in.serialize("machine", *newBoard);
+		}
 	} catch (XMLException& e) {
 		throw CommandException("Cannot load state, bad file format: " + e.getMessage());
 	} catch (MSXException& e) {
@@ -992,6 +1081,67 @@ void RestoreMachineCommand::tabCompletion(vector<string>& tokens) const
 }
 
 
+// class CloneMachineCommand
+
+CloneMachineCommand::CloneMachineCommand(
+	CommandController& commandController_, Reactor& reactor_)
+	: Command(commandController_, "clone_machine")
+	, reactor(reactor_)
+{
+}
+
+void CloneMachineCommand::execute(array_ref<TclObject> tokens,
+                                  TclObject& result)
+{
+	string_ref machineID;
+	int num = 1;
+	switch (tokens.size()) {
+	case 1:
+		machineID = reactor.getMachineID();
+		break;
+	case 3:
+		num = tokens[2].getInt(getInterpreter());
+		if (num < 1) {
+			throw CommandException("Number of clones should be at least 1");
+		}
+		// fall-through
+	case 2:
+		machineID = tokens[1].getString();
+		break;
+	default:
+		throw SyntaxError();
+	}
+
+	auto& board = reactor.getMachine(machineID);
+	vector<Reactor::Board> clones;
+	try {
+		clones = reactor.cloneMotherBoard(board, num);
+	} catch (MSXException& e) {
+		throw CommandException("Cannot clone machine: " + e.getMessage());
+	}
+	for (auto& c : clones) {
+		result.addListElement(c->getMachineID());
+		reactor.boards.push_back(move(c));
+	}
+}
+
+string CloneMachineCommand::help(const vector<string>& /*tokens*/) const
+{
+	return
+		"clone_machine                       Create a copy of the current machine\n"
+		"clone_machine machineID             Create a copy of machine \"machineID\"\n"
+		"clone_machine machineID <number>    Create the given number of copies of machine \"machineID\"\n"
+		"\n"
+		"Returns the IDs of the new machines. Each copy is an independent machine,\n"
+		"in the same state as the original machine at the moment of cloning.";
+}
+
+void CloneMachineCommand::tabCompletion(vector<string>& tokens) const
+{
+	completeString(tokens, reactor.getMachineIDs());
+}
+
+
 // class ConfigInfo
 
 ConfigInfo::ConfigInfo(InfoCommand& openMSXInfoCommand,
@@ -30,6 +30,7 @@ class DiskChanger;
 class FilePool;
 class UserSettings;
 class RomDatabase;
+class BootCache;
 class TclCallbackMessages;
 class MSXMotherBoard;
 class Setting;
@@ -45,6 +46,7 @@ class ListMachinesCommand;
 class ActivateMachineCommand;
 class StoreMachineCommand;
 class RestoreMachineCommand;
+class CloneMachineCommand;
 class AviRecorder;
 class ConfigInfo;
 class RealTimeInfo;
@@ -84,6 +86,7 @@ public:
 	EnumSetting<int>& getMachineSetting() { return *machineSetting; }
 	RomDatabase& getSoftwareDatabase() { return *softwareDatabase; }
 	FilePool& getFilePool() { return *filePool; }
+	AviRecorder& getRecorder() { return *aviRecordCommand; }
 
 	void switchMachine(const std::string& machine);
 	MSXMotherBoard* getMotherBoard() const;
@@ -105,6 +108,24 @@ public:
 	Board createEmptyMotherBoard();
 	void replaceBoard(MSXMotherBoard& oldBoard, Board newBoard); // for reverse
 
+	/** Create 'num' independent copies of the given board, all in the
+	  * same state as the original. The copies are not yet added to the
+	  * list of machines.
+	  * The copies don't share state with each other, but all boards still
+	  * use some unsynchronized global state (PageWriteTracker, the list
+	  * of all SRAMs, the parsed hardware config cache). So the boards may
+	  * only be created and run from the main thread, one at a time.
+	  */
+	std::vector<Board> cloneMotherBoard(MSXMotherBoard& board, unsigned num);
+
+	/** Must be called (from the main thread) right before and right after
+	  * fork(). Makes sure no helper thread holds a lock during the fork,
+	  * and in the child process stops using (or restarts) the helper
+	  * threads of the parent. Pending SRAM saves are finished first.
+	  */
+	void prepareFork();
+	void afterFork(bool child);
+
 private:
 	using Boards = std::vector<Board>;
 
@@ -148,6 +169,7 @@ private:
 	std::unique_ptr<EnumSetting<int>> machineSetting;
 	std::unique_ptr<UserSettings> userSettings;
 	std::unique_ptr<RomDatabase> softwareDatabase;
+	std::unique_ptr<BootCache> bootCache;
 
 	std::unique_ptr<AfterCommand> afterCommand;
 	std::unique_ptr<QuitCommand> quitCommand;
@@ -160,6 +182,7 @@ private:
 	std::unique_ptr<ActivateMachineCommand> activateMachineCommand;
 	std::unique_ptr<StoreMachineCommand> storeMachineCommand;
 	std::unique_ptr<RestoreMachineCommand> restoreMachineCommand;
+	std::unique_ptr<CloneMachineCommand> cloneMachineCommand;
 	std::unique_ptr<AviRecorder> aviRecordCommand;
 	std::unique_ptr<ConfigInfo> extensionInfo;
 	std::unique_ptr<ConfigInfo> machineInfo;
@@ -197,6 +220,7 @@ private:
 	friend class ActivateMachineCommand;
 	friend class StoreMachineCommand;
 	friend class RestoreMachineCommand;
+	friend class CloneMachineCommand;
 };
 
 } // namespace openmsx
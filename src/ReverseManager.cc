@@ -73,6 +73,12 @@ struct Replay
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version)
 	{
+		if (ar.versionAtLeast(version, 5)) {
+			// Most of the memory is the same in all snapshots, so
+			// store the blobs of each snapshot as differences with
+			// the previous snapshot (see MSXMotherBoard::serialize()).
+			ar.enableBlobDeltas();
+		}
 		if (ar.versionAtLeast(version, 2)) {
 			ar.serializeWithID("snapshots", motherBoards, std::ref(reactor));
 		} else {
@@ -96,7 +102,7 @@ struct Replay
 		}
 	}
 };
-SERIALIZE_CLASS_VERSION(Replay, 4);
+SERIALIZE_CLASS_VERSION(Replay, 5);
 
 
 // struct ReverseHistory
@@ -583,8 +589,9 @@ void ReverseManager::saveReplay(
 	default:
 		throw SyntaxError();
 	}
+	bool binary = StringOp::endsWith(filename, ".omrb");
 	filename = FileOperations::parseCommandFileArgument(
-		filename, REPLAY_DIR, "openmsx", ".omr");
+		filename, REPLAY_DIR, "openmsx", binary ? ".omrb" : ".omr");
 
 	auto& reactor = motherBoard.getReactor();
 	Replay replay(reactor);
@@ -650,9 +657,15 @@ void ReverseManager::saveReplay(
 			getCurrentTime()));
 	}
 	try {
-		XmlOutputArchive out(filename);
 		replay.events = &history.events;
-		out.serialize("replay", replay);
+		if (binary) {
+			BinOutputArchive out(filename);
+			out.serialize("replay", replay);
+			out.close();
+		} else {
+			XmlOutputArchive out(filename);
+			out.serialize("replay", replay);
+		}
 	} catch (MSXException&) {
 		if (addSentinel) {
 			history.events.pop_back();
@@ -707,13 +720,16 @@ void ReverseManager::loadReplay(
 		// Not found, try adding '.omr'.
 		filename = context.resolve(fileNameArg + ".omr");
 	} catch (MSXException& e2) { try {
+		// Not found, try adding '.omrb' (binary replay).
+		filename = context.resolve(fileNameArg + ".omrb");
+	} catch (MSXException& /*e3*/) { try {
 		// Again not found, try adding '.gz'.
 		// (this is for backwards compatibility).
 		filename = context.resolve(fileNameArg + ".gz");
-	} catch (MSXException& /*e3*/) {
+	} catch (MSXException& /*e4*/) {
 		// Show error message that includes the default extension.
 		throw e2;
-	}}}
+	}}}}
 
 	// restore replay
 	auto& reactor = motherBoard.getReactor();
@@ -721,8 +737,13 @@ void ReverseManager::loadReplay(
 	Events events;
 	replay.events = &events;
 	try {
-		XmlInputArchive in(filename);
-		in.serialize("replay", replay);
+		if (BinInputArchive::isBinaryArchive(filename)) {
+			BinInputArchive in(filename);
+			in.serialize("replay", replay);
+		} else {
+			XmlInputArchive in(filename);
+			in.serialize("replay", replay);
+		}
 	} catch (XMLException& e) {
 		throw CommandException("Cannot load replay, bad file format: " + e.getMessage());
 	} catch (MSXException& e) {
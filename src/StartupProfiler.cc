@@ -0,0 +1,143 @@
+#include "StartupProfiler.hh"
+#include "FileOperations.hh"
+#include "StringOp.hh"
+#include "Thread.hh"
+#include "Timer.hh"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using std::string;
+
+namespace openmsx {
+namespace StartupProfiler {
+
+struct Node {
+	const char* name;
+	int parent; // -1 for top level phases
+	unsigned count;
+	uint64_t total; // us
+	uint64_t start; // us, only valid while running
+};
+
+// Time at which the process started (approximately: static initialization).
+static const uint64_t startTime = Timer::getTime();
+static bool measuring = true;
+static std::vector<Node> nodes; // parents come before their children
+static std::vector<int> running;
+static string reportFile;
+
+Phase::Phase(const char* name)
+	: index(-1)
+{
+	if (!measuring || !Thread::isMainThread()) return;
+
+	int parent = running.empty() ? -1 : running.back();
+	for (int i = 0; i < int(nodes.size()); ++i) {
+		if ((nodes[i].parent == parent) &&
+		    (strcmp(nodes[i].name, name) == 0)) {
+			index = i;
+			break;
+		}
+	}
+	if (index == -1) {
+		index = int(nodes.size());
+		nodes.push_back(Node{name, parent, 0, 0, 0});
+	}
+	running.push_back(index);
+	nodes[index].start = Timer::getTime();
+}
+
+Phase::~Phase()
+{
+	if (index == -1) return;
+	auto& node = nodes[index];
+	node.total += Timer::getTime() - node.start;
+	++node.count;
+	assert(running.back() == index);
+	running.pop_back();
+}
+
+void setReportFile(const string& filename)
+{
+	reportFile = filename;
+}
+
+static string formatMs(uint64_t us)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.1f", us / 1000.0);
+	return buf;
+}
+
+static void writeText(std::ostream& out, int parent, unsigned depth,
+                      uint64_t total)
+{
+	for (int i = 0; i < int(nodes.size()); ++i) {
+		const auto& node = nodes[i];
+		if (node.parent != parent) continue;
+		string name = string(2 * depth, ' ') + node.name;
+		if (node.count > 1) {
+			name += " (" + StringOp::toString(node.count) + "x)";
+		}
+		if (name.size() < 40) name.resize(40, ' ');
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%10s ms %5.1f%%",
+		         formatMs(node.total).c_str(),
+		         total ? (100.0 * node.total) / total : 0.0);
+		out << name << buf << '\n';
+		writeText(out, i, depth + 1, total);
+	}
+}
+
+static void writeJson(std::ostream& out, int parent, unsigned depth)
+{
+	string indent(2 * depth, ' ');
+	bool first = true;
+	for (int i = 0; i < int(nodes.size()); ++i) {
+		const auto& node = nodes[i];
+		if (node.parent != parent) continue;
+		out << (first ? "\n" : ",\n") << indent << "{\"name\": \"";
+		for (const char* p = node.name; *p; ++p) {
+			if ((*p == '"') || (*p == '\\')) out << '\\';
+			out << *p;
+		}
+		out << "\", \"count\": " << node.count
+		    << ", \"ms\": " << formatMs(node.total)
+		    << ", \"phases\": [";
+		writeJson(out, i, depth + 1);
+		out << "]}";
+		first = false;
+	}
+	if (!first) out << '\n' << string(2 * (depth - 1), ' ');
+}
+
+void finish()
+{
+	if (!measuring) return;
+	measuring = false;
+	assert(running.empty());
+	if (reportFile.empty()) return;
+
+	uint64_t total = Timer::getTime() - startTime;
+	std::ofstream out;
+	FileOperations::openofstream(out, reportFile);
+	if (StringOp::endsWith(reportFile, ".json")) {
+		out << "{\"ms\": " << formatMs(total) << ", \"phases\": [";
+		writeJson(out, -1, 1);
+		out << "]}\n";
+	} else {
+		out << "openMSX startup: " << formatMs(total) << " ms\n";
+		writeText(out, -1, 1, total);
+	}
+	if (!out.good()) {
+		std::cerr << "Couldn't write startup profile to "
+		          << reportFile << std::endl;
+	}
+}
+
+} // namespace StartupProfiler
+} // namespace openmsx
@@ -0,0 +1,46 @@
+#ifndef STARTUPPROFILER_HH
+#define STARTUPPROFILER_HH
+
+#include <string>
+
+namespace openmsx {
+
+/** Measure how long the different phases of the openMSX startup take.
+  *
+  * A phase is timed by creating a Phase object on the stack. Phases can be
+  * nested, a phase that is started while another phase is running becomes a
+  * sub-phase of that phase. If the same phase (with the same parent) runs
+  * several times (e.g. loading of a ROM) the times are accumulated.
+  *
+  * Measuring stops when startup is complete (see finish()). When requested
+  * (see the -profile-startup command line option) a report is written at
+  * that point.
+  */
+namespace StartupProfiler {
+
+	class Phase
+	{
+	public:
+		/** 'name' must remain valid (typically it's a string literal). */
+		explicit Phase(const char* name);
+		~Phase();
+
+	private:
+		int index; // -1 when not measuring
+	};
+
+	/** Write the report to the given file when startup is complete. The
+	  * report is in JSON format if the filename ends with ".json",
+	  * otherwise it's plain text.
+	  */
+	void setReportFile(const std::string& filename);
+
+	/** Startup is complete: stop measuring and write the report (if
+	  * requested). Later calls have no effect.
+	  */
+	void finish();
+
+} // namespace StartupProfiler
+} // namespace openmsx
+
+#endif
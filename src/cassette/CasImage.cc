@@ -6,6 +6,8 @@
 #include "Clock.hh"
 #include "MSXException.hh"
 #include "xrange.hh"
+#include <algorithm>
+#include <cassert>
 #include <cstring> // for memcmp
 
 namespace openmsx {
@@ -47,24 +49,63 @@ static const byte ASCII_HEADER [10] = { 0xEA,0xEA,0xEA,0xEA,0xEA,0xEA,0xEA,0xEA,
 static const byte BINARY_HEADER[10] = { 0xD0,0xD0,0xD0,0xD0,0xD0,0xD0,0xD0,0xD0,0xD0,0xD0 };
 static const byte BASIC_HEADER [10] = { 0xD3,0xD3,0xD3,0xD3,0xD3,0xD3,0xD3,0xD3,0xD3,0xD3 };
 
+// waveforms for a single bit, and the number of bits per (encoded) byte
+static const signed char BIT0[4] = { 127,  127, -127, -127 };
+static const signed char BIT1[4] = { 127, -127,  127, -127 };
+static const unsigned SAMPLES_PER_BIT = 4;
+static const unsigned BITS_PER_BYTE = 1 + 8 + 2; // start, data, stop bits
+static const unsigned SAMPLES_PER_BYTE = BITS_PER_BYTE * SAMPLES_PER_BIT;
+
 
 CasImage::CasImage(const Filename& filename, FilePool& filePool, CliComm& cliComm)
+	: nbSamples(0)
 {
 	setFirstFileType(CassetteImage::UNKNOWN);
 	convert(filename, filePool, cliComm);
 }
 
+const CasImage::Block* CasImage::findBlock(unsigned pos) const
+{
+	if (pos >= nbSamples) return nullptr;
+	auto it = std::upper_bound(begin(blocks), end(blocks), pos,
+		[](unsigned p, const Block& b) { return p < b.start; });
+	assert(it != begin(blocks));
+	return &*(it - 1);
+}
+
+int CasImage::getSample(const Block& block, unsigned pos) const
+{
+	assert((block.start <= pos) && (pos < (block.start + block.length)));
+	unsigned offset = pos - block.start;
+	switch (block.type) {
+	case Block::SILENCE:
+		return 0;
+	case Block::HEADER:
+		return BIT1[offset % SAMPLES_PER_BIT];
+	default: {
+		byte b = data[block.dataPos + offset / SAMPLES_PER_BYTE];
+		unsigned bit = (offset % SAMPLES_PER_BYTE) / SAMPLES_PER_BIT;
+		// one start bit (0), eight data bits, two stop bits (1)
+		bool one = (bit == 0) ? false
+		         : (bit <= 8) ? ((b & (1 << (bit - 1))) != 0)
+		                      : true;
+		return (one ? BIT1 : BIT0)[offset % SAMPLES_PER_BIT];
+	}
+	}
+}
+
 int16_t CasImage::getSampleAt(EmuTime::param time)
 {
 	static const Clock<OUTPUT_FREQUENCY> zero(EmuTime::zero);
 	unsigned pos = zero.getTicksTill(time);
-	return pos < output.size() ? output[pos] * 256 : 0;
+	const Block* block = findBlock(pos);
+	return block ? getSample(*block, pos) * 256 : 0;
 }
 
 EmuTime CasImage::getEndTime() const
 {
 	Clock<OUTPUT_FREQUENCY> clk(EmuTime::zero);
-	clk += unsigned(output.size());
+	clk += nbSamples;
 	return clk.getTime();
 }
 
@@ -75,77 +116,98 @@ unsigned CasImage::getFrequency() const
 
 void CasImage::fillBuffer(unsigned pos, int** bufs, unsigned num) const
 {
-	size_t nbSamples = output.size();
-	if ((pos / AUDIO_OVERSAMPLE) < nbSamples) {
-		for (auto i : xrange(num)) {
-			bufs[0][i] = ((pos / AUDIO_OVERSAMPLE) < nbSamples)
-			           ? output[pos / AUDIO_OVERSAMPLE] * 256
-			           : 0;
-			++pos;
-		}
-	} else {
+	const Block* block = findBlock(pos / AUDIO_OVERSAMPLE);
+	if (!block) {
 		bufs[0] = nullptr;
+		return;
+	}
+	const Block* last = &blocks.back();
+	for (auto i : xrange(num)) {
+		unsigned p = pos / AUDIO_OVERSAMPLE;
+		while (p >= (block->start + block->length)) {
+			if (block == last) break;
+			++block;
+		}
+		bufs[0][i] = (p < nbSamples) ? getSample(*block, p) * 256 : 0;
+		++pos;
 	}
 }
 
-void CasImage::write0()
+bool CasImage::seekHeader(EmuTime& time) const
 {
-	output.insert(end(output), { 127, 127, -127, -127 } );
+	static const Clock<OUTPUT_FREQUENCY> zero(EmuTime::zero);
+	const Block* block = findBlock(zero.getTicksTill(time));
+	if (!block) return false;
+	for (const Block* last = &blocks.back(); block <= last; ++block) {
+		if (block->type == Block::HEADER) {
+			Clock<OUTPUT_FREQUENCY> clk(EmuTime::zero);
+			clk += block->start + block->length;
+			time = clk.getTime();
+			return true;
+		}
+	}
+	return false;
 }
-void CasImage::write1()
+
+bool CasImage::readByte(EmuTime& time, byte& value) const
+{
+	static const Clock<OUTPUT_FREQUENCY> zero(EmuTime::zero);
+	unsigned pos = zero.getTicksTill(time);
+	const Block* block = findBlock(pos);
+	if (!block || (block->type != Block::DATA)) return false;
+	// The byte that's currently 'under the tape head'. Note that we don't
+	// round up: the time between two reads is much shorter than the time
+	// it takes to transfer one byte.
+	unsigned idx = (pos - block->start) / SAMPLES_PER_BYTE;
+	value = data[block->dataPos + idx];
+	Clock<OUTPUT_FREQUENCY> clk(EmuTime::zero);
+	clk += block->start + (idx + 1) * SAMPLES_PER_BYTE;
+	time = clk.getTime();
+	return true;
+}
+
+void CasImage::addBlock(Block::Type type, unsigned length, size_t dataPos)
 {
-	output.insert(end(output), { 127, -127, 127, -127 } );
+	if (length == 0) return;
+	Block block;
+	block.type = type;
+	block.start = nbSamples;
+	block.length = length;
+	block.dataPos = dataPos;
+	blocks.push_back(block);
+	nbSamples += length;
 }
 
 // write a header signal
 void CasImage::writeHeader(int s)
 {
-	for (int i = 0; i < s; ++i) {
-		write1();
-	}
+	addBlock(Block::HEADER, s * SAMPLES_PER_BIT);
 }
 
 // write silence
 void CasImage::writeSilence(int s)
 {
-	output.insert(end(output), s, 0);
-}
-
-// write a byte
-void CasImage::writeByte(byte b)
-{
-	// one start bit
-	write0();
-	// eight data bits
-	for (auto i : xrange(8)) {
-		if (b & (1 << i)) {
-			write1();
-		} else {
-			write0();
-		}
-	}
-	// two stop bits
-	write1();
-	write1();
+	addBlock(Block::SILENCE, s);
 }
 
 // write data until a header is detected
 bool CasImage::writeData(const byte* buf, size_t size, size_t& pos)
 {
+	size_t begin = pos;
 	bool eof = false;
 	while ((pos + 8) <= size) {
 		if (!memcmp(&buf[pos], CAS_HEADER, 8)) {
+			addBlock(Block::DATA,
+			         unsigned(pos - begin) * SAMPLES_PER_BYTE, begin);
 			return eof;
 		}
-		writeByte(buf[pos]);
 		if (buf[pos] == 0x1A) {
 			eof = true;
 		}
 		pos++;
 	}
-	while (pos < size) {
-		writeByte(buf[pos++]);
-	}
+	pos = size;
+	addBlock(Block::DATA, unsigned(pos - begin) * SAMPLES_PER_BYTE, begin);
 	return false;
 }
 
@@ -154,6 +216,9 @@ void CasImage::convert(const Filename& filename, FilePool& filePool, CliComm& cl
 	File file(filename);
 	size_t size;
 	const byte* buf = file.mmap(size);
+	// CAS files are small compared to the waveform they represent, so
+	// keeping a copy of the raw data is cheap.
+	data.assign(buf, buf + size);
 
 	// search for a header in the .cas file
 	bool issueWarning = false;
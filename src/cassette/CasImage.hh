@@ -13,6 +13,10 @@ class FilePool;
 
 /**
  * Code based on "cas2wav" tool by Vincent van Dam
+ *
+ * The waveform is not expanded in memory. Instead the CAS file is split in
+ * a (small) list of blocks (silence, header or data) and the samples are
+ * synthesized on demand from that list.
  */
 class CasImage final : public CassetteImage
 {
@@ -24,17 +28,29 @@ public:
 	EmuTime getEndTime() const override;
 	unsigned getFrequency() const override;
 	void fillBuffer(unsigned pos, int** bufs, unsigned num) const override;
+	bool seekHeader(EmuTime& time) const override;
+	bool readByte(EmuTime& time, byte& value) const override;
 
 private:
-	void write0();
-	void write1();
+	struct Block {
+		enum Type { SILENCE, HEADER, DATA };
+		Type type;
+		unsigned start;  // position of first sample of this block
+		unsigned length; // length of this block in samples
+		size_t dataPos;  // only for DATA blocks: offset in 'data'
+	};
+
+	void addBlock(Block::Type type, unsigned length, size_t dataPos = 0);
 	void writeHeader(int s);
 	void writeSilence(int s);
-	void writeByte(byte b);
 	bool writeData(const byte* buf, size_t size, size_t& pos);
 	void convert(const Filename& filename, FilePool& filePool, CliComm& cliComm);
+	const Block* findBlock(unsigned pos) const;
+	int getSample(const Block& block, unsigned pos) const;
 
-	std::vector<signed char> output;
+	std::vector<Block> blocks; // sorted on 'start'
+	std::vector<byte> data;    // the raw content of the CAS file
+	unsigned nbSamples;
 };
 
 } // namespace openmsx
@@ -21,6 +21,16 @@ std::string CassetteImage::getFirstFileTypeAsString() const
 	}
 }
 
+bool CassetteImage::seekHeader(EmuTime& /*time*/) const
+{
+	return false;
+}
+
+bool CassetteImage::readByte(EmuTime& /*time*/, uint8_t& /*value*/) const
+{
+	return false;
+}
+
 void CassetteImage::setSha1Sum(const Sha1Sum& sha1sum_)
 {
 	assert(sha1sum.empty());
@@ -19,6 +19,16 @@ public:
 	virtual unsigned getFrequency() const = 0;
 	virtual void fillBuffer(unsigned pos, int** bufs, unsigned num) const = 0;
 
+	/** Support for fast loading via the BIOS tape routines. Only images
+	 * that know the logical structure of the tape implement these.
+	 * seekHeader() moves 'time' to just after the next header (sync)
+	 * signal. readByte() returns the byte that's being read at 'time'
+	 * and moves 'time' to the end of that byte. Both return false when
+	 * not supported or when there's no such header/byte at that position.
+	 */
+	virtual bool seekHeader(EmuTime& time) const;
+	virtual bool readByte(EmuTime& time, uint8_t& value) const;
+
 	FileType getFirstFileType() const { return firstFileType; }
 	std::string getFirstFileTypeAsString() const;
 
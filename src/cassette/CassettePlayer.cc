@@ -431,6 +431,29 @@ void CassettePlayer::setSignal(bool output, EmuTime::param time)
 	lastOutput = output;
 }
 
+bool CassettePlayer::fastLoadHeader(EmuTime::param time)
+{
+	if (getState() != PLAY) return false;
+	sync(time); // before tapePos changes
+	EmuTime pos = tapePos;
+	if (!playImage->seekHeader(pos)) return false;
+	tapePos = pos;
+	updateLoadingState(time); // end-of-tape moved
+	return true;
+}
+
+int CassettePlayer::fastLoadByte(EmuTime::param time)
+{
+	if (getState() != PLAY) return -1;
+	sync(time); // before tapePos changes
+	EmuTime pos = tapePos;
+	byte value;
+	if (!playImage->readByte(pos, value)) return -1;
+	tapePos = pos;
+	updateLoadingState(time); // end-of-tape moved
+	return value;
+}
+
 void CassettePlayer::sync(EmuTime::param time)
 {
 	EmuDuration duration = time - prevSyncTime;
@@ -648,6 +671,15 @@ void CassettePlayer::TapeCommand::execute(
 			throw CommandException(e.getMessage());
 		}
 
+	} else if (tokens[1] == "fastload" && tokens.size() == 3) {
+		if (tokens[2] == "header") {
+			result.setBoolean(cassettePlayer.fastLoadHeader(time));
+		} else if (tokens[2] == "byte") {
+			result.setInt(cassettePlayer.fastLoadByte(time));
+		} else {
+			throw SyntaxError();
+		}
+
 	} else if (tokens[1] == "motorcontrol" && tokens.size() == 3) {
 		if (tokens[2] == "on") {
 			cassettePlayer.setMotorControl(true, time);
@@ -775,6 +807,15 @@ string CassettePlayer::TapeCommand::help(const vector<string>& tokens) const
 		} else if (tokens[1] == "getlength") {
 			helptext =
 			    "Return the length of the tape in seconds.";
+		} else if (tokens[1] == "fastload") {
+			helptext =
+			    "Support for fast loading via the BIOS tape "
+			    "routines, normally only used by the "
+			    "fast_cassette_load script. 'header' skips to the "
+			    "end of the next header and returns whether that "
+			    "succeeded. 'byte' returns the byte at the current "
+			    "tape position (or -1 on failure) and moves the "
+			    "tape past it. Only works for CAS images.";
 		}
 	} else {
 		helptext =
@@ -796,6 +837,8 @@ string CassettePlayer::TapeCommand::help(const vector<string>& tokens) const
 		    ": query the position of the tape\n"
 		    "cassetteplayer getlength         "
 		    ": query the total length of the tape\n"
+		    "cassetteplayer fastload <what>   "
+		    ": BIOS fast loading support (header or byte)\n"
 		    "cassetteplayer <filename>        "
 		    ": insert (a different) tape file\n";
 	}
@@ -821,7 +864,9 @@ void CassettePlayer::TapeCommand::tabCompletion(vector<string>& tokens) const
 
 bool CassettePlayer::TapeCommand::needRecord(array_ref<TclObject> tokens) const
 {
-	return tokens.size() > 1;
+	// 'fastload' is executed from within the emulation (via breakpoints
+	// on the BIOS routines), so it will be repeated during a replay.
+	return (tokens.size() > 1) && (tokens[1] != "fastload");
 }
 
 
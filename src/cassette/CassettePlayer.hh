@@ -102,6 +102,13 @@ private:
 	  * continuously). */
 	double getTapeLength(EmuTime::param time);
 
+	/** Fast loading support, used by the BIOS TAPION/TAPIN hooks. These
+	  * move the tape position as-if the tape was actually played, so
+	  * that it's always possible to fall back to the normal waveform
+	  * based loading (e.g. for custom loaders). */
+	bool fastLoadHeader(EmuTime::param time);
+	int fastLoadByte(EmuTime::param time);
+
 	void sync(EmuTime::param time);
 	void updateTapePosition(EmuDuration::param duration, EmuTime::param time);
 	void generateRecordOutput(EmuDuration::param duration);
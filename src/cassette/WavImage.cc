@@ -1,13 +1,24 @@
 #include "WavImage.hh"
+#include "WavData.hh"
 #include "LocalFileReference.hh"
-#include "File.hh"
+#include "FileException.hh"
 #include "FilePool.hh"
 #include "Math.hh"
+#include "endian.hh"
 #include "memory.hh"
 #include "xrange.hh"
+#include <algorithm>
+#include <cstring>
 
 namespace openmsx {
 
+// Number of samples converted in one go while streaming.
+static const unsigned CHUNK_SIZE = 64 * 1024;
+// Number of samples before the requested position that are also converted,
+// so that the DC-removal filter below has settled (its impulse response
+// decays to (far) below 1 LSB within this many samples).
+static const unsigned FILTER_WARMUP = 1024;
+
 // DC-removal filter
 //   y(n) = x(n) - x(n-1) + R * y(n-1)
 // see comments in MSXMixer.cc for more details
@@ -26,30 +37,130 @@ static void filter(float sampleFreq, int16_t* begin, int16_t* end)
 
 // Note: type detection not implemented yet for WAV images
 WavImage::WavImage(const Filename& filename, FilePool& filePool)
-	: clock(EmuTime::zero)
+	: file(filename)
+	, dataOffset(0)
+	, nbSamples(0)
+	, channels(1)
+	, bytesPerSample(2)
+	, clock(EmuTime::zero)
+	, cacheStart(0)
+	, cacheSize(0)
+{
+	setSha1Sum(filePool.getSha1Sum(file));
+	if (!parseHeader()) {
+		file.close();
+		loadFully(filename);
+	}
+}
+
+// Returns true iff this is a plain PCM file that can be streamed.
+bool WavImage::parseHeader()
 {
-	LocalFileReference localFile;
-	{
-		// File object must be destroyed before localFile is actually
-		// used by an external API (see comments in LocalFileReference
-		// for details).
-		File file(filename);
-		setSha1Sum(filePool.getSha1Sum(file));
-		localFile = LocalFileReference(file);
+	size_t fileSize = file.getSize();
+	if (fileSize < 12) return false;
+	byte riff[12];
+	file.seek(0);
+	file.read(riff, sizeof(riff));
+	if (memcmp(&riff[0], "RIFF", 4) || memcmp(&riff[8], "WAVE", 4)) {
+		return false;
 	}
-	wav = WavData(localFile.getFilename(), 16, 0);
+
+	bool fmtFound = false;
+	size_t pos = 12;
+	while ((pos + 8) <= fileSize) {
+		byte chunk[8];
+		file.seek(pos);
+		file.read(chunk, sizeof(chunk));
+		size_t chunkSize = Endian::read_UA_L32(&chunk[4]);
+		pos += 8;
+		if (!memcmp(chunk, "fmt ", 4)) {
+			if ((chunkSize < 16) || ((pos + 16) > fileSize)) return false;
+			byte fmt[16];
+			file.read(fmt, sizeof(fmt));
+			unsigned formatTag = Endian::read_UA_L16(&fmt[0]);
+			unsigned bits      = Endian::read_UA_L16(&fmt[14]);
+			channels           = Endian::read_UA_L16(&fmt[2]);
+			unsigned freq      = Endian::read_UA_L32(&fmt[4]);
+			if ((formatTag != 1) || (channels == 0) || (freq == 0) ||
+			    ((bits != 8) && (bits != 16))) {
+				return false;
+			}
+			bytesPerSample = bits / 8;
+			clock.setFreq(freq);
+			fmtFound = true;
+		} else if (!memcmp(chunk, "data", 4)) {
+			if (!fmtFound) return false;
+			dataOffset = pos;
+			size_t dataSize = std::min(chunkSize, fileSize - pos);
+			nbSamples = unsigned(dataSize / (channels * bytesPerSample));
+			return true;
+		}
+		pos += chunkSize + (chunkSize & 1); // chunks are word aligned
+	}
+	return false;
+}
+
+void WavImage::loadFully(const Filename& filename)
+{
+	LocalFileReference localFile(filename);
+	WavData wav(localFile.getFilename(), 16, 0);
 	clock.setFreq(wav.getFreq());
 
-	auto* buf = static_cast<int16_t*>(wav.getData());
-	auto* end = buf + wav.getSize();
-	filter(wav.getFreq(), buf, end);
+	nbSamples = wav.getSize();
+	cache.resize(nbSamples);
+	memcpy(cache.data(), wav.getData(), nbSamples * sizeof(int16_t));
+	filter(wav.getFreq(), cache.data(), cache.data() + nbSamples);
+	cacheStart = 0;
+	cacheSize = nbSamples;
+}
+
+void WavImage::loadChunk(unsigned pos) const
+{
+	unsigned start = (pos > FILTER_WARMUP) ? (pos - FILTER_WARMUP) : 0;
+	unsigned end = std::min(nbSamples, pos + CHUNK_SIZE);
+	unsigned num = end - start;
+	unsigned frameSize = channels * bytesPerSample;
+
+	cache.resize(num);
+	MemBuffer<byte> raw(num * frameSize);
+	try {
+		file.seek(dataOffset + size_t(start) * frameSize);
+		file.read(raw.data(), num * frameSize);
+	} catch (FileException&) {
+		// file became unreadable, play silence instead
+		memset(raw.data(), (bytesPerSample == 1) ? 0x80 : 0,
+		       num * frameSize);
+	}
+
+	// convert to mono 16-bit
+	const byte* p = raw.data();
+	for (auto i : xrange(num)) {
+		int sum = 0;
+		for (unsigned ch = 0; ch < channels; ++ch) {
+			sum += (bytesPerSample == 1)
+			     ? ((p[0] - 0x80) << 8)
+			     : int16_t(Endian::read_UA_L16(p));
+			p += bytesPerSample;
+		}
+		cache[i] = sum / int(channels);
+	}
+	filter(getFrequency(), cache.data(), cache.data() + num);
+
+	// drop the warm-up samples
+	unsigned skip = pos - start;
+	memmove(cache.data(), cache.data() + skip,
+	        (num - skip) * sizeof(int16_t));
+	cacheStart = pos;
+	cacheSize = num - skip;
 }
 
 int16_t WavImage::getSample(unsigned pos) const
 {
-	if (pos < wav.getSize()) {
-		auto* buf = static_cast<const int16_t*>(wav.getData());
-		return buf[pos];
+	if (pos < nbSamples) {
+		if ((pos < cacheStart) || (pos >= (cacheStart + cacheSize))) {
+			loadChunk(pos);
+		}
+		return cache[pos - cacheStart];
 	}
 	return 0;
 }
@@ -62,7 +173,7 @@ int16_t WavImage::getSampleAt(EmuTime::param time)
 EmuTime WavImage::getEndTime() const
 {
 	DynamicClock clk(clock);
-	clk += wav.getSize();
+	clk += nbSamples;
 	return clk.getTime();
 }
 
@@ -73,7 +184,7 @@ unsigned WavImage::getFrequency() const
 
 void WavImage::fillBuffer(unsigned pos, int** bufs, unsigned num) const
 {
-	if (pos < wav.getSize()) {
+	if (pos < nbSamples) {
 		for (auto i : xrange(num)) {
 			bufs[0][i] = getSample(pos + i);
 		}
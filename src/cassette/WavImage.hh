@@ -2,8 +2,9 @@
 #define WAVIMAGE_HH
 
 #include "CassetteImage.hh"
-#include "WavData.hh"
+#include "File.hh"
 #include "DynamicClock.hh"
+#include "MemBuffer.hh"
 #include <cstdint>
 
 namespace openmsx {
@@ -11,6 +12,11 @@ namespace openmsx {
 class Filename;
 class FilePool;
 
+/** Cassette image backed by a .wav file.
+ * Plain PCM files are streamed: only a window of (converted and filtered)
+ * samples around the current play position is kept in memory. Other
+ * formats (e.g. ADPCM) are decoded completely at construction.
+ */
 class WavImage final : public CassetteImage
 {
 public:
@@ -22,10 +28,22 @@ public:
 	void fillBuffer(unsigned pos, int** bufs, unsigned num) const override;
 
 private:
+	bool parseHeader();
+	void loadFully(const Filename& filename);
+	void loadChunk(unsigned pos) const;
 	int16_t getSample(unsigned pos) const;
 
-	WavData wav;
+	mutable File file;
+	size_t dataOffset;
+	unsigned nbSamples;
+	unsigned channels;
+	unsigned bytesPerSample;
 	DynamicClock clock;
+
+	// Samples [cacheStart, cacheStart + cacheSize) are available in cache.
+	mutable MemBuffer<int16_t> cache;
+	mutable unsigned cacheStart;
+	mutable unsigned cacheSize;
 };
 
 } // namespace openmsx
@@ -10,12 +10,15 @@
 #include "MSXCPUInterface.hh"
 #include "DeviceFactory.hh"
 #include "CliComm.hh"
+#include "StartupProfiler.hh"
 #include "serialize.hh"
 #include "serialize_stl.hh"
 #include "StringOp.hh"
+#include "hash_map.hh"
 #include "memory.hh"
 #include "unreachable.hh"
 #include "xrange.hh"
+#include "xxhash.hh"
 #include <cassert>
 #include <iostream>
 
@@ -203,11 +206,49 @@ XMLElement HardwareConfig::loadConfig(string_ref type, string_ref name)
 	return loadConfig(getFilename(type, name));
 }
 
+// Parsed (and validated) hardware configuration files. Creating the same
+// machine or extension again only has to copy the parsed tree. An entry is
+// reused as long as the size and the modification time of the file don't
+// change. The key is the original filename (for compressed files the
+// decompressed temp file gets a new name each time).
+namespace {
+struct ParsedConfig {
+	time_t time;
+	off_t size;
+	XMLElement config;
+};
+}
+static hash_map<string, ParsedConfig, XXHasher> parsedConfigs;
+// There are only a few hundred config files, but the filenames can also
+// be chosen by the user (e.g. via -machine), so limit the size anyway.
+static const size_t MAX_PARSED_CONFIGS = 256;
+
 XMLElement HardwareConfig::loadConfig(const string& filename)
 {
 	try {
+		FileOperations::Stat st;
+		bool cacheable = FileOperations::getStat(filename, st);
+		time_t time = 0;
+		if (cacheable) {
+			time = FileOperations::getModificationDate(st);
+			auto it = parsedConfigs.find(filename);
+			if ((it != end(parsedConfigs)) &&
+			    (it->second.time == time) &&
+			    (it->second.size == st.st_size)) {
+				return it->second.config;
+			}
+		}
 		LocalFileReference fileRef(filename);
-		return XMLLoader::load(fileRef.getFilename(), "msxconfig2.dtd");
+		auto config = XMLLoader::load(fileRef.getFilename(), "msxconfig2.dtd");
+		if (cacheable) {
+			if ((parsedConfigs.size() >= MAX_PARSED_CONFIGS) &&
+			    (parsedConfigs.find(filename) == end(parsedConfigs))) {
+				parsedConfigs.erase(begin(parsedConfigs));
+			}
+			parsedConfigs.insert_or_assign(
+				filename, ParsedConfig{time, st.st_size, config});
+		}
+		return config;
 	} catch (XMLException& e) {
 		throw MSXException(
 			"Loading of hardware configuration failed: " +
@@ -236,6 +277,7 @@ string HardwareConfig::getFilename(string_ref type, string_ref name)
 
 void HardwareConfig::load(string_ref type)
 {
+	StartupProfiler::Phase profile("hardware config XML");
 	string filename = getFilename(type, hwName);
 	setConfig(loadConfig(filename));
 
@@ -292,6 +334,7 @@ void HardwareConfig::parseSlots()
 
 void HardwareConfig::createDevices()
 {
+	StartupProfiler::Phase profile("device construction");
 	createDevices(getDevices(), nullptr, nullptr);
 }
 
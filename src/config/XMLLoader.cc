@@ -28,7 +28,7 @@ private:
 	string_ref systemID;
 };
 
-XMLElement load(string_ref filename, string_ref systemID)
+static MemBuffer<char> readFile(string_ref filename)
 {
 	MemBuffer<char> buf;
 	try {
@@ -40,6 +40,12 @@ XMLElement load(string_ref filename, string_ref systemID)
 	} catch (FileException& e) {
 		throw XMLException(filename + ": failed to read: " + e.getMessage());
 	}
+	return buf;
+}
+
+XMLElement load(string_ref filename, string_ref systemID)
+{
+	auto buf = readFile(filename);
 
 	XMLElementParser handler;
 	try {
@@ -52,16 +58,35 @@ XMLElement load(string_ref filename, string_ref systemID)
 		throw XMLException(filename +
 			": Document doesn't contain mandatory root Element");
 	}
-	if (handler.getSystemID().empty()) {
+	checkSystemID(filename, handler.getSystemID(), systemID);
+	return std::move(root);
+}
+
+void checkSystemID(string_ref filename, string_ref systemID,
+                   string_ref expected)
+{
+	if (systemID.empty()) {
 		throw XMLException(filename + ": Missing systemID.\n"
 			"You're probably using an old incompatible file format.");
 	}
-	if (handler.getSystemID() != systemID) {
+	if (systemID != expected) {
 		throw XMLException(filename + ": systemID doesn't match "
-			"(expected " + systemID + ", got " + handler.getSystemID() + ")\n"
+			"(expected " + expected + ", got " + systemID + ")\n"
 			"You're probably using an old incompatible file format.");
 	}
-	return std::move(root);
+}
+
+string_ref parseSystemID(string_ref txt)
+{
+	auto pos1 = txt.find(" SYSTEM ");
+	if (pos1 == string_ref::npos) return string_ref();
+	char q = txt[pos1 + 8];
+	if ((q != '"') && (q != '\'')) return string_ref();
+	auto t = txt.substr(pos1 + 9);
+	auto pos2 = t.find(q);
+	if (pos2 == string_ref::npos) return string_ref();
+
+	return t.substr(0, pos2);
 }
 
 void XMLElementParser::start(string_ref name)
@@ -93,15 +118,7 @@ void XMLElementParser::stop()
 
 void XMLElementParser::doctype(string_ref txt)
 {
-	auto pos1 = txt.find(" SYSTEM ");
-	if (pos1 == string_ref::npos) return;
-	char q = txt[pos1 + 8];
-	if ((q != '"') && (q != '\'')) return;
-	auto t = txt.substr(pos1 + 9);
-	auto pos2 = t.find(q);
-	if (pos2 == string_ref::npos) return;
-
-	systemID = t.substr(0, pos2);
+	systemID = parseSystemID(txt);
 }
 
 } // namespace XMLLoader
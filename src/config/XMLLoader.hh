@@ -8,6 +8,15 @@ namespace XMLLoader {
 
 	XMLElement load(string_ref filename, string_ref systemID);
 
+	/** Extract the system ID from the contents of a <!DOCTYPE> tag. */
+	string_ref parseSystemID(string_ref doctype);
+
+	/** Throws XMLException if the system ID of the document doesn't match
+	  * the expected one.
+	  */
+	void checkSystemID(string_ref filename, string_ref systemID,
+	                   string_ref expected);
+
 } // namespace XMLLoader
 } // namespace openmsx
 
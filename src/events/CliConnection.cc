@@ -17,6 +17,7 @@
 #include "unistdp.hh"
 #include "openmsx.hh"
 #include "StringOp.hh"
+#include "Thread.hh"
 #include <cassert>
 #include <iostream>
 
@@ -70,6 +71,7 @@ CliConnection::CliConnection(CommandController& commandController_,
 	: parser([this](const std::string& cmd) { execute(cmd); })
 	, commandController(commandController_)
 	, eventDistributor(eventDistributor_)
+	, forked(false)
 {
 	for (auto& en : updateEnabled) {
 		en = false;
@@ -85,6 +87,7 @@ CliConnection::~CliConnection()
 
 void CliConnection::log(CliComm::LogLevel level, string_ref message)
 {
+	if (forked) return;
 	auto levelStr = CliComm::getLevelStrings();
 	output(StringOp::Builder() <<
 		"<log level=\"" << levelStr[level] << "\">" <<
@@ -94,7 +97,7 @@ void CliConnection::log(CliComm::LogLevel level, string_ref message)
 void CliConnection::update(CliComm::UpdateType type, string_ref machine,
                               string_ref name, string_ref value)
 {
-	if (!getUpdateEnable(type)) return;
+	if (forked || !getUpdateEnable(type)) return;
 
 	auto updateStr = CliComm::getUpdateStrings();
 	StringOp::Builder tmp;
@@ -120,8 +123,20 @@ void CliConnection::start()
 	thread = std::thread([this]() { run(); });
 }
 
+void CliConnection::afterFork()
+{
+	// The helper thread only exists in the parent process. Also the
+	// stream is shared with the parent, so stop using it (but don't
+	// shut it down).
+	forked = true;
+	Thread::forgetAfterFork(thread);
+	close();
+}
+
 void CliConnection::end()
 {
+	if (forked) return;
+
 	output("</openmsx-output>\n");
 	close();
 
@@ -152,10 +167,11 @@ int CliConnection::signalEvent(const std::shared_ptr<const Event>& event)
 		try {
 			string result = commandController.executeCommand(
 				commandEvent.getCommand(), this).getString().str();
-			output(reply(result, true));
+			// (the command might have forked this process)
+			if (!forked) output(reply(result, true));
 		} catch (CommandException& e) {
 			string result = e.getMessage() + '\n';
-			output(reply(result, false));
+			if (!forked) output(reply(result, false));
 		}
 	}
 	return 0;
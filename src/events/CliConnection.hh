@@ -70,6 +70,7 @@ private:
 	void log(CliComm::LogLevel level, string_ref message) override;
 	void update(CliComm::UpdateType type, string_ref machine,
 	            string_ref name, string_ref value) override;
+	void afterFork() override;
 
 	// EventListener
 	int signalEvent(const std::shared_ptr<const Event>& event) override;
@@ -80,6 +81,7 @@ private:
 	std::thread thread;
 
 	bool updateEnabled[CliComm::NUM_UPDATES];
+	bool forked; // connection belongs to the parent process
 };
 
 class StdioConnection final : public CliConnection
@@ -15,6 +15,13 @@ public:
 	virtual void update(CliComm::UpdateType type, string_ref machine,
 	                    string_ref name, string_ref value) = 0;
 
+	/** Called in the child process after a fork(). Threads started by
+	  * this listener don't exist in the child, and resources like sockets
+	  * are shared with the parent process. So from now on these should
+	  * no longer be used.
+	  */
+	virtual void afterFork() {}
+
 protected:
 	CliListener() {}
 };
@@ -1,12 +1,24 @@
 #include "CliServer.hh"
 #include "GlobalCliComm.hh"
 #include "CliConnection.hh"
+#include "CommandException.hh"
+#include "Reactor.hh"
+#include "Display.hh"
+#include "RenderSettings.hh"
+#include "Mixer.hh"
+#include "AviRecorder.hh"
+#include "TclObject.hh"
 #include "StringOp.hh"
+#include "Thread.hh"
 #include "FileOperations.hh"
 #include "MSXException.hh"
 #include "memory.hh"
+#include "outer.hh"
 #include "random.hh"
 #include "statp.hh"
+#include "stl.hh"
+#include <cerrno>
+#include <cstring>
 #include <string>
 
 #ifdef _WIN32
@@ -16,9 +28,11 @@
 #include <pwd.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/wait.h>
 #endif
 
 using std::string;
+using std::vector;
 
 
 namespace openmsx {
@@ -182,32 +196,32 @@ SOCKET CliServer::createSocket()
 void CliServer::exitAcceptLoop()
 {
 	sock_close(listenSock);
-	poller.abort();
+	poller->abort();
 }
 
 static void deleteSocket(const string& socket)
 {
+	if (socket.empty()) return;
 	FileOperations::unlink(socket); // ignore errors
 	string dir = socket.substr(0, socket.find_last_of('/'));
 	FileOperations::rmdir(dir); // ignore errors
 }
 
 
-CliServer::CliServer(CommandController& commandController_,
+CliServer::CliServer(Reactor& reactor_,
+                     CommandController& commandController_,
                      EventDistributor& eventDistributor_,
                      GlobalCliComm& cliComm_)
-	: commandController(commandController_)
+	: RTSchedulable(reactor_.getRTScheduler())
+	, reactor(reactor_)
+	, commandController(commandController_)
 	, eventDistributor(eventDistributor_)
 	, cliComm(cliComm_)
+	, forkCmd(commandController_)
 	, listenSock(OPENMSX_INVALID_SOCKET)
 {
 	sock_startup();
-	try {
-		listenSock = createSocket();
-		thread = std::thread([this]() { mainLoop(); });
-	} catch (MSXException& e) {
-		cliComm.printWarning(e.getMessage());
-	}
+	start();
 }
 
 CliServer::~CliServer()
@@ -221,6 +235,18 @@ CliServer::~CliServer()
 	sock_cleanup();
 }
 
+void CliServer::start()
+{
+	try {
+		listenSock = createSocket();
+		poller = make_unique<Poller>();
+		thread = std::thread([this]() { mainLoop(); });
+	} catch (MSXException& e) {
+		listenSock = OPENMSX_INVALID_SOCKET;
+		cliComm.printWarning(e.getMessage());
+	}
+}
+
 void CliServer::mainLoop()
 {
 #ifndef _WIN32
@@ -233,12 +259,12 @@ void CliServer::mainLoop()
 		// Note: On Windows, closing the socket is sufficient to exit the
 		//       accept() call.
 #ifndef _WIN32
-		if (poller.poll(listenSock)) {
+		if (poller->poll(listenSock)) {
 			break;
 		}
 #endif
 		SOCKET sd = accept(listenSock, nullptr, nullptr);
-		if (poller.aborted()) {
+		if (poller->aborted()) {
 			break;
 		}
 		if (sd == OPENMSX_INVALID_SOCKET) {
@@ -258,4 +284,91 @@ void CliServer::mainLoop()
 	}
 }
 
+// Fork this process. The child process continues from the exact same state,
+// but it gets its own socket (named after its own process id).
+int CliServer::forkProcess()
+{
+#ifdef _WIN32
+	throw CommandException("fork is not supported on this platform");
+#else
+	reactor.prepareFork();
+	pid_t pid = fork();
+	int error = errno;
+	reactor.afterFork(pid == 0);
+	if (pid == -1) {
+		throw CommandException(StringOp::Builder() <<
+			"Couldn't fork: " << strerror(error));
+	}
+	if (pid != 0) {
+		children.push_back(pid);
+		if (!isPendingRT()) scheduleRT(1000000); // 1s
+		return pid;
+	}
+
+	// In the child process: the accept thread and the socket belong to
+	// the parent process.
+	children.clear();
+	cancelRT();
+	Thread::forgetAfterFork(thread);
+	if (listenSock != OPENMSX_INVALID_SOCKET) {
+		sock_close(listenSock);
+	}
+	listenSock = OPENMSX_INVALID_SOCKET;
+	socketName.clear();
+	start();
+	return 0;
+#endif
+}
+
+// Reap forked processes that already exited, so that they don't linger
+// as zombies. Keep polling as long as there are children left.
+void CliServer::executeRT()
+{
+#ifndef _WIN32
+	children.erase(std::remove_if(begin(children), end(children),
+		[](int pid) { return waitpid(pid, nullptr, WNOHANG) == pid; }),
+		end(children));
+	if (!children.empty()) scheduleRT(1000000); // 1s
+#endif
+}
+
+
+// class ForkCmd
+
+CliServer::ForkCmd::ForkCmd(CommandController& commandController_)
+	: Command(commandController_, "fork")
+{
+}
+
+void CliServer::ForkCmd::execute(array_ref<TclObject> tokens, TclObject& result)
+{
+	if (tokens.size() != 1) {
+		throw SyntaxError();
+	}
+	auto& server = OUTER(CliServer, forkCmd);
+	// The child process can't share the window or the sound device with
+	// the parent.
+	auto& reactor = server.reactor;
+	if (reactor.getDisplay().getRenderSettings().getRenderer() !=
+	    RenderSettings::DUMMY) {
+		throw CommandException("fork requires renderer \"none\"");
+	}
+	if (reactor.getMixer().getSoundDriverType() != Mixer::SND_NULL) {
+		throw CommandException("fork requires sound_driver \"null\"");
+	}
+	// Both processes would write to the same file.
+	if (reactor.getRecorder().isRecording()) {
+		throw CommandException("can't fork while recording");
+	}
+	result.setInt(server.forkProcess());
+}
+
+string CliServer::ForkCmd::help(const vector<string>& /*tokens*/) const
+{
+	return "Create a copy of this openMSX process, in the exact same state. "
+	       "Returns the process id of the copy (returns 0 in the copy "
+	       "itself). The copy accepts connections on its own socket. "
+	       "Requires renderer \"none\" and sound_driver \"null\".";
+}
+
 } // namespace openmsx
@@ -1,38 +1,57 @@
 #ifndef CLISERVER_HH
 #define CLISERVER_HH
 
+#include "Command.hh"
+#include "RTSchedulable.hh"
 #include "Poller.hh"
 #include "Socket.hh"
+#include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace openmsx {
 
+class Reactor;
 class CommandController;
 class EventDistributor;
 class GlobalCliComm;
 
-class CliServer final
+class CliServer final : private RTSchedulable
 {
 public:
-	CliServer(CommandController& commandController,
+	CliServer(Reactor& reactor,
+	          CommandController& commandController,
 	          EventDistributor& eventDistributor,
 	          GlobalCliComm& cliComm);
 	~CliServer();
 
 private:
+	void start();
 	void mainLoop();
 	SOCKET createSocket();
 	void exitAcceptLoop();
+	int forkProcess();
 
+	// RTSchedulable
+	void executeRT() override;
+
+	Reactor& reactor;
 	CommandController& commandController;
 	EventDistributor& eventDistributor;
 	GlobalCliComm& cliComm;
 
+	struct ForkCmd final : Command {
+		explicit ForkCmd(CommandController& commandController);
+		void execute(array_ref<TclObject> tokens, TclObject& result) override;
+		std::string help(const std::vector<std::string>& tokens) const override;
+	} forkCmd;
+
 	std::thread thread;
 	std::string socketName;
 	SOCKET listenSock;
-	Poller poller;
+	std::unique_ptr<Poller> poller;
+	std::vector<int> children; // forked processes, not yet reaped
 };
 
 } // namespace openmsx
@@ -125,4 +125,14 @@ bool EventDistributor::sleep(unsigned us)
 	return condition.wait_for(lock, duration) == std::cv_status::timeout;
 }
 
+void EventDistributor::prepareFork()
+{
+	mutex.lock();
+}
+
+void EventDistributor::afterFork()
+{
+	mutex.unlock();
+}
+
 } // namespace openmsx
@@ -67,6 +67,12 @@ public:
 	  */
 	bool sleep(unsigned us);
 
+	/** Must be called right before and right after fork(). Makes sure
+	  * no other thread holds a lock during the fork.
+	  */
+	void prepareFork();
+	void afterFork();
+
 private:
 	bool isRegistered(EventType type, EventListener* listener) const;
 
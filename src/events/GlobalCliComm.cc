@@ -58,6 +58,21 @@ void GlobalCliComm::setAllowExternalCommands()
 	}
 }
 
+void GlobalCliComm::prepareFork()
+{
+	mutex.lock();
+}
+
+void GlobalCliComm::afterFork(bool child)
+{
+	if (child) {
+		for (auto& l : listeners) {
+			l->afterFork();
+		}
+	}
+	mutex.unlock();
+}
+
 void GlobalCliComm::log(LogLevel level, string_ref message)
 {
 	assert(Thread::isMainThread());
@@ -28,6 +28,13 @@ public:
 	// connections are not yet processed (but they keep pending).
 	void setAllowExternalCommands();
 
+	/** Must be called right before and right after fork(). In the child
+	  * process the existing listeners are told to stop using resources
+	  * shared with the parent (see CliListener::afterFork()).
+	  */
+	void prepareFork();
+	void afterFork(bool child);
+
 	// CliComm
 	void log(LogLevel level, string_ref message) override;
 	void update(UpdateType type, string_ref name,
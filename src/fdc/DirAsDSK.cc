@@ -12,6 +12,10 @@
 #include <cassert>
 #include <cstring>
 #include <vector>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 using std::string;
 using std::vector;
@@ -35,6 +39,12 @@ static const unsigned FREE_FAT = 0x000;
 static const unsigned BAD_FAT  = 0xFF7;
 static const unsigned EOF_FAT  = 0xFFF; // actually 0xFF8-0xFFF
 
+#ifdef __linux__
+static const uint32_t WATCH_MASK =
+	IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+	IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+#endif
+
 
 // Transform BAD_FAT (0xFF7) and EOF_FAT-range (0xFF8-0xFFF)
 // to a single value: EOF_FAT (0xFFF).
@@ -272,10 +282,15 @@ DirAsDSK::DirAsDSK(DiskChanger& diskChanger_, CliComm& cliComm_,
 	, firstDataSector(firstDirSector + SECTORS_PER_DIR)
 	, maxCluster((nofSectors - firstDataSector) / SECTORS_PER_CLUSTER + FIRST_CLUSTER)
 	, sectors(nofSectors)
+	, watchFd(-1)
+	, watchPid(0)
+	, fullSyncNeeded(true)
+	, skippedHostFiles(false)
 {
 	if (!FileOperations::isDirectory(hostDir)) {
 		throw MSXException("Not a directory");
 	}
+	openHostWatch();
 
 	// First create structure for the virtual disk.
 	byte numSides = diskChanger_.isDoubleSidedDrive() ? 2 : 1;
@@ -323,6 +338,13 @@ DirAsDSK::DirAsDSK(DiskChanger& diskChanger_, CliComm& cliComm_,
 	syncWithHost();
 }
 
+DirAsDSK::~DirAsDSK()
+{
+#ifdef __linux__
+	if (watchFd != -1) close(watchFd);
+#endif
+}
+
 bool DirAsDSK::isWriteProtectedImpl() const
 {
 	return syncMode == SYNC_READONLY;
@@ -381,6 +403,15 @@ void DirAsDSK::readSectorImpl(size_t sector, SectorBuffer& buf)
 
 void DirAsDSK::syncWithHost()
 {
+	// When we know which host files changed, only check those.
+	vector<string> changed;
+	if (getChangedHostFiles(changed)) {
+		syncChangedHostFiles(changed);
+		return;
+	}
+	fullSyncNeeded = false;
+	skippedHostFiles = false;
+
 	// Check for removed host files. This frees up space in the virtual
 	// disk. Do this first because otherwise later actions may fail (run
 	// out of virtual disk space) for no good reason.
@@ -396,6 +427,89 @@ void DirAsDSK::syncWithHost()
 	addNewHostFiles({}, firstDirSector);
 }
 
+// Collect the host files (relative to 'hostDir') that changed since the
+// previous call. Returns false if that's not known, then all host files must
+// be checked.
+bool DirAsDSK::getChangedHostFiles(vector<string>& changed)
+{
+#ifdef __linux__
+	if ((watchFd != -1) && (watchPid != getpid())) {
+		// We're a forked copy of openMSX (see 'fork' command). The
+		// inotify instance is shared with the parent process, reading
+		// it would steal the parent's events. Start over with a new
+		// instance, the full sync adds the watches again.
+		close(watchFd);
+		watchDirs.clear();
+		openHostWatch();
+		fullSyncNeeded = true;
+	}
+	if (watchFd == -1) return false;
+	bool overflow = false;
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	while (true) {
+		ssize_t len = read(watchFd, buf, sizeof(buf));
+		if (len <= 0) break; // no more pending events
+		for (char* p = buf; p < (buf + len); ) {
+			auto* event = reinterpret_cast<inotify_event*>(p);
+			p += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				// events were dropped
+				overflow = true;
+				continue;
+			}
+			auto it = watchDirs.find(event->wd);
+			if (it == end(watchDirs)) continue;
+			if (event->mask & IN_IGNORED) {
+				// directory was removed
+				watchDirs.erase(it);
+				continue;
+			}
+			if (event->len == 0) continue;
+			changed.push_back(it->second + event->name);
+		}
+	}
+	if (overflow || fullSyncNeeded) return false;
+	sort(begin(changed), end(changed));
+	changed.erase(unique(begin(changed), end(changed)), end(changed));
+	return true;
+#else
+	(void)changed;
+	return false;
+#endif
+}
+
+void DirAsDSK::openHostWatch()
+{
+#ifdef __linux__
+	watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	watchPid = getpid();
+#endif
+}
+
+// Watch a (mapped) host directory for changes. 'hostSubDir' is relative to
+// 'hostDir' and ends with a '/' (or is empty for 'hostDir' itself).
+void DirAsDSK::addHostWatch(const string& hostSubDir)
+{
+#ifdef __linux__
+	if (watchFd == -1) return;
+	int wd = inotify_add_watch(watchFd, (hostDir + hostSubDir).c_str(),
+	                           WATCH_MASK);
+	if (wd == -1) {
+		// E.g. the limit on the number of watches is reached. Changes
+		// in this directory would be missed, so from now on always
+		// check all host files.
+		close(watchFd);
+		watchFd = -1;
+		watchDirs.clear();
+		return;
+	}
+	watchDirs[wd] = hostSubDir;
+#else
+	(void)hostSubDir;
+#endif
+}
+
 void DirAsDSK::checkDeletedHostFiles()
 {
 	// This handles both host files and directories.
@@ -693,6 +807,9 @@ void DirAsDSK::addNewHostFiles(const string& hostSubDir, unsigned msxDirSector)
 	assert(!StringOp::startsWith(hostSubDir, '/'));
 	assert(hostSubDir.empty() || StringOp::endsWith(hostSubDir, '/'));
 
+	// Watch before reading the directory, so no changes are missed.
+	addHostWatch(hostSubDir);
+
 	vector<string> hostNames;
 	{
 		ReadDir dir(hostDir + hostSubDir);
@@ -724,6 +841,114 @@ void DirAsDSK::addNewHostFiles(const string& hostSubDir, unsigned msxDirSector)
 				                   fullHostName);
 			}
 		} catch (MSXException& e) {
+			skippedHostFiles = true;
+			cliComm.printWarning(e.getMessage());
+		}
+	}
+}
+
+// Same as the three steps in syncWithHost(), but only for the given host files
+// (relative to 'hostDir', sorted).
+void DirAsDSK::syncChangedHostFiles(const vector<string>& changed)
+{
+	// Removed host files.
+	bool deleted = false;
+	for (auto& hostName : changed) {
+		DirIndex dirIndex = findHostFileInDSK(hostName);
+		if (dirIndex.sector == unsigned(-1)) continue;
+		bool isMSXDirectory = (msxDir(dirIndex).attrib &
+		                       MSXDirEntry::ATT_DIRECTORY) != 0;
+		FileOperations::Stat fst;
+		if ((!FileOperations::getStat(hostDir + hostName, fst)) ||
+		    (FileOperations::isDirectory(fst) != isMSXDirectory)) {
+			deleteMSXFile(dirIndex);
+			deleted = true;
+		}
+	}
+
+	// Modified host files.
+	for (auto& hostName : changed) {
+		DirIndex dirIndex = findHostFileInDSK(hostName);
+		if (dirIndex.sector == unsigned(-1)) continue;
+		FileOperations::Stat fst;
+		if (!FileOperations::getStat(hostDir + hostName, fst)) continue;
+		if (msxDir(dirIndex).attrib & MSXDirEntry::ATT_DIRECTORY) {
+			// E.g. a directory created by the MSX (so not via
+			// addNewHostFiles()), make sure it's watched.
+			addHostWatch(hostName + '/');
+			continue;
+		}
+		auto& mapDir = mapDirs[dirIndex];
+		if ((mapDir.mtime    != fst.st_mtime) ||
+		    (mapDir.filesize != size_t(fst.st_size))) {
+			importHostFile(dirIndex, fst);
+		}
+	}
+
+	// New host files.
+	if (deleted && skippedHostFiles) {
+		// There's free space again, retry the host files that
+		// previously couldn't be added.
+		skippedHostFiles = false;
+		addNewHostFiles({}, firstDirSector);
+		return;
+	}
+	vector<string> added;
+	for (auto& hostName : changed) {
+		if (!checkFileUsedInDSK(hostName)) added.push_back(hostName);
+	}
+	// Directories before the files in them, and within one directory
+	// use the same order as addNewHostFiles().
+	auto depth = [](const string& s) {
+		return std::count(begin(s), end(s), '/'); };
+	auto baseName = [](const string& s) {
+		return s.substr(s.rfind('/') + 1); };
+	sort(begin(added), end(added),
+	     [&](const string& l, const string& r) {
+		auto dl = depth(l), dr = depth(r);
+		if (dl != dr) return dl < dr;
+		return weight(baseName(l)) < weight(baseName(r)); });
+	for (auto& hostPath : added) {
+		auto pos = hostPath.rfind('/');
+		string hostSubDir = (pos == string::npos)
+		                  ? string{} : hostPath.substr(0, pos + 1);
+		string hostName = hostPath.substr(hostSubDir.size());
+		if (StringOp::startsWith(hostName, '.')) {
+			// skip hidden files, see addNewHostFiles()
+			continue;
+		}
+		unsigned msxDirSector = firstDirSector;
+		if (!hostSubDir.empty()) {
+			DirIndex dirIndex = findHostFileInDSK(
+				hostSubDir.substr(0, hostSubDir.size() - 1));
+			if (dirIndex.sector == unsigned(-1)) {
+				// parent directory is not in the virtual disk
+				continue;
+			}
+			unsigned cluster = msxDir(dirIndex).startCluster;
+			if (!(msxDir(dirIndex).attrib & MSXDirEntry::ATT_DIRECTORY) ||
+			    (cluster < FIRST_CLUSTER) || (cluster >= maxCluster)) {
+				continue;
+			}
+			msxDirSector = clusterToSector(cluster);
+		}
+		try {
+			string fullHostName = hostDir + hostPath;
+			FileOperations::Stat fst;
+			if (!FileOperations::getStat(fullHostName, fst)) {
+				// already removed again
+				continue;
+			}
+			if (FileOperations::isDirectory(fst)) {
+				addNewDirectory(hostSubDir, hostName, msxDirSector, fst);
+			} else if (FileOperations::isRegularFile(fst)) {
+				addNewHostFile(hostSubDir, hostName, msxDirSector, fst);
+			} else {
+				throw MSXException("Not a regular file: " +
+				                   fullHostName);
+			}
+		} catch (MSXException& e) {
+			skippedHostFiles = true;
 			cliComm.printWarning(e.getMessage());
 		}
 	}
@@ -6,6 +6,8 @@
 #include "FileOperations.hh"
 #include "EmuTime.hh"
 #include <map>
+#include <string>
+#include <vector>
 
 namespace openmsx {
 
@@ -22,6 +24,7 @@ public:
 	DirAsDSK(DiskChanger& diskChanger, CliComm& cliComm,
 	         const Filename& hostDir, SyncMode syncMode,
 	         BootSectorType bootSectorType);
+	~DirAsDSK();
 
 	// SectorBasedDisk
 	void readSectorImpl (size_t sector,       SectorBuffer& buf) override;
@@ -62,6 +65,10 @@ private:
 	void writeDIREntry(DirIndex dirIndex, DirIndex dirDirIndex,
 	                   const MSXDirEntry& newEntry);
 	void syncWithHost();
+	bool getChangedHostFiles(std::vector<std::string>& changed);
+	void syncChangedHostFiles(const std::vector<std::string>& changed);
+	void openHostWatch();
+	void addHostWatch(const std::string& hostSubDir);
 	void checkDeletedHostFiles();
 	void deleteMSXFile(DirIndex dirIndex);
 	void deleteMSXFilesInDir(unsigned msxDirSector);
@@ -139,6 +146,15 @@ private:
 
 	// Storage for the whole virtual disk.
 	std::vector<SectorBuffer> sectors;
+
+	// On Linux, inotify is used to find out which host files changed, so
+	// that a sync doesn't need to check all host files. -1 when this is
+	// not available.
+	int watchFd;
+	int watchPid; // process that created 'watchFd'
+	std::map<int, std::string> watchDirs; // watch descriptor -> host subdir
+	bool fullSyncNeeded;
+	bool skippedHostFiles; // some host files couldn't be added (e.g. disk full)
 };
 
 } // namespace openmsx
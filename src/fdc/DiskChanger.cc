@@ -3,6 +3,7 @@
 #include "DummyDisk.hh"
 #include "RamDSKDiskImage.hh"
 #include "DirAsDSK.hh"
+#include "SectorBasedDisk.hh"
 #include "CommandController.hh"
 #include "RecordedCommand.hh"
 #include "StateChangeDistributor.hh"
@@ -172,8 +173,16 @@ void DiskChanger::insertDisk(array_ref<TclObject> args)
 	auto& diskFactory = reactor.getDiskFactory();
 	std::unique_ptr<Disk> newDisk(diskFactory.createDisk(diskImage, *this));
 	for (unsigned i = 2; i < args.size(); ++i) {
-		newDisk->applyPatch(Filename(
-			args[i].getString().str(), userFileContext()));
+		if (args[i] == "-overlay") {
+			if (!dynamic_cast<SectorBasedDisk*>(newDisk.get())) {
+				throw MSXException(
+					"Overlay mode is not supported for this disk");
+			}
+			newDisk->enableOverlay();
+		} else {
+			newDisk->applyPatch(Filename(
+				args[i].getString().str(), userFileContext()));
+		}
 	}
 
 	// no errors, only now replace original disk
@@ -218,6 +227,9 @@ void DiskCommand::execute(array_ref<TclObject> tokens, TclObject& result)
 		} else if (dynamic_cast<RamDSKDiskImage*>(diskChanger.disk.get())) {
 			options.addListElement("ramdsk");
 		}
+		if (diskChanger.disk->hasOverlay()) {
+			options.addListElement("overlay");
+		}
 		if (diskChanger.disk->isWriteProtected()) {
 			options.addListElement("readonly");
 		}
@@ -243,6 +255,28 @@ void DiskCommand::execute(array_ref<TclObject> tokens, TclObject& result)
 	} else if (tokens[1] == "eject") {
 		string args[] = {diskChanger.getDriveName(), "eject"};
 		diskChanger.sendChangeDiskEvent(args);
+	} else if (tokens[1] == "overlay") {
+		// The overlay is only consulted via the sector interface, disk
+		// images that store raw tracks (DMK) bypass it.
+		if (!dynamic_cast<SectorBasedDisk*>(diskChanger.disk.get()) ||
+		    diskChanger.disk->isDummyDisk()) {
+			throw CommandException(
+				"Overlay mode is not supported for this disk");
+		}
+		diskChanger.disk->enableOverlay();
+	} else if (tokens[1] == "commit") {
+		try {
+			diskChanger.disk->commitOverlay();
+		} catch (MSXException& e) {
+			throw CommandException("Can't commit overlay: " +
+			                       e.getMessage());
+		}
+	} else if (tokens[1] == "discard") {
+		if (diskChanger.disk->getOverlaySize() != 0) {
+			diskChanger.disk->discardOverlay();
+			// for the MSX this is like a disk change
+			diskChanger.forceDiskChange();
+		}
 	} else {
 		int firstFileToken = 1;
 		if (tokens[1] == "insert") {
@@ -281,16 +315,21 @@ string DiskCommand::help(const vector<string>& /*tokens*/) const
 	       driveName + " ramdsk            : create a virtual disk in RAM\n" +
 	       driveName + " insert <filename> : change the disk file\n" +
 	       driveName + " <filename>        : change the disk file\n" +
+	       driveName + " overlay           : from now on, don't write to the disk image\n" +
+	       "                        but keep the written sectors in memory\n" +
+	       driveName + " commit            : write the sectors in the overlay to the disk image\n" +
+	       driveName + " discard           : drop the sectors in the overlay\n" +
 	       driveName + "                   : show which disk image is in drive\n" +
 	       "The following options are supported when inserting a disk image:\n" +
-	       "-ips <filename> : apply the given IPS patch to the disk image";
+	       "-ips <filename> : apply the given IPS patch to the disk image\n" +
+	       "-overlay        : insert the disk image in overlay mode";
 }
 
 void DiskCommand::tabCompletion(vector<string>& tokens) const
 {
 	if (tokens.size() >= 2) {
 		static const char* const extra[] = {
-			"eject", "ramdsk", "insert",
+			"eject", "ramdsk", "insert", "overlay", "commit", "discard",
 		};
 		completeFileName(tokens, userFileContext(), extra);
 	}
@@ -298,7 +337,9 @@ void DiskCommand::tabCompletion(vector<string>& tokens) const
 
 bool DiskCommand::needRecord(array_ref<TclObject> tokens) const
 {
-	return tokens.size() > 1;
+	// committing doesn't change the emulated state (and it should not
+	// write to the image again during replay)
+	return (tokens.size() > 1) && (tokens[1] != "commit");
 }
 
 static string calcSha1(SectorAccessibleDisk* disk, FilePool& filePool)
@@ -308,6 +349,7 @@ static string calcSha1(SectorAccessibleDisk* disk, FilePool& filePool)
 
 // version 1:  initial version
 // version 2:  replaced Filename with DiskName
+// version 3:  added overlay mode and overlay sectors
 template<typename Archive>
 void DiskChanger::serialize(Archive& ar, unsigned version)
 {
@@ -338,6 +380,11 @@ void DiskChanger::serialize(Archive& ar, unsigned version)
 	}
 	ar.serialize("checksum", oldChecksum);
 
+	bool overlay = !ar.isLoader() && disk->hasOverlay();
+	if (ar.versionAtLeast(version, 3)) {
+		ar.serialize("overlay", overlay);
+	}
+
 	if (ar.isLoader()) {
 		diskname.updateAfterLoadState();
 		string name = diskname.getResolved(); // TODO use Filename
@@ -362,6 +409,7 @@ void DiskChanger::serialize(Archive& ar, unsigned version)
 				p.updateAfterLoadState();
 				args.emplace_back(p.getResolved()); // TODO
 			}
+			if (overlay) args.emplace_back("-overlay");
 
 			try {
 				insertDisk(args);
@@ -373,7 +421,15 @@ void DiskChanger::serialize(Archive& ar, unsigned version)
 				//   without diskimage. Is this better?
 			}
 		}
+	}
 
+	// Must be restored after the disk is inserted, but before the
+	// checksum is verified (the checksum includes the overlay).
+	if (ar.versionAtLeast(version, 3)) {
+		disk->serializeOverlay(ar);
+	}
+
+	if (ar.isLoader()) {
 		string newChecksum = calcSha1(getSectorAccessibleDisk(), filePool);
 		if (oldChecksum != newChecksum) {
 			controller.getCliComm().printWarning(
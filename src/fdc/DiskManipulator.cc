@@ -17,6 +17,7 @@
 #include "TclObject.hh"
 #include "memory.hh"
 #include "xrange.hh"
+#include <algorithm>
 #include <cassert>
 #include <cctype>
 #include <stdexcept>
@@ -72,6 +73,23 @@ void DiskManipulator::unregisterDrive(DiskContainer& drive)
 	move_pop_back(drives, it);
 }
 
+vector<DiskContainer*> DiskManipulator::getDrives(string_ref machineID) const
+{
+	string prefix = machineID.str() + "::";
+	vector<const DriveSettings*> found;
+	for (auto& ds : drives) {
+		if (StringOp::startsWith(ds.driveName, prefix)) {
+			found.push_back(&ds);
+		}
+	}
+	sort(begin(found), end(found),
+	     [](const DriveSettings* a, const DriveSettings* b) {
+		return a->driveName < b->driveName; });
+	vector<DiskContainer*> result;
+	for (auto* ds : found) result.push_back(ds->drive);
+	return result;
+}
+
 DiskManipulator::Drives::iterator DiskManipulator::findDriveSettings(
 	DiskContainer& drive)
 {
@@ -25,6 +25,11 @@ public:
 	void registerDrive(DiskContainer& drive, const std::string& prefix);
 	void unregisterDrive(DiskContainer& drive);
 
+	/** Get the drives (disk drives and hard disks) of the given machine,
+	  * sorted on name.
+	  */
+	std::vector<DiskContainer*> getDrives(string_ref machineID) const;
+
 private:
 	static const unsigned MAX_PARTITIONS = 31;
 	struct DriveSettings
@@ -2,9 +2,13 @@
 #include "EmptyDiskPatch.hh"
 #include "IPSPatch.hh"
 #include "DiskExceptions.hh"
+#include "MemBuffer.hh"
+#include "serialize.hh"
+#include "serialize_stl.hh"
 #include "sha1.hh"
 #include "xrange.hh"
 #include "memory.hh"
+#include <vector>
 
 namespace openmsx {
 
@@ -19,6 +23,7 @@ SectorAccessibleDisk::SectorAccessibleDisk()
 	: patch(make_unique<EmptyDiskPatch>(*this))
 	, forcedWriteProtect(false)
 	, peekMode(false)
+	, overlayEnabled(false)
 {
 }
 
@@ -34,6 +39,13 @@ void SectorAccessibleDisk::readSector(size_t sector, SectorBuffer& buf)
 	    (getNbSectors() <= sector)) {
 		throw NoSuchSectorException("No such sector");
 	}
+	if (overlayEnabled) {
+		auto it = overlay.find(sector);
+		if (it != end(overlay)) {
+			buf = it->second;
+			return;
+		}
+	}
 	try {
 		// in the end this calls readSectorImpl()
 		patch->copyBlock(sector * sizeof(buf), buf.raw, sizeof(buf));
@@ -50,6 +62,12 @@ void SectorAccessibleDisk::writeSector(size_t sector, const SectorBuffer& buf)
 	if (!isDummyDisk() && (getNbSectors() <= sector)) {
 		throw NoSuchSectorException("No such sector");
 	}
+	if (overlayEnabled) {
+		overlay[sector] = buf;
+		overlayChanged(sector);
+		flushCaches();
+		return;
+	}
 	try {
 		writeSectorImpl(sector, buf);
 	} catch (MSXException& e) {
@@ -78,11 +96,83 @@ bool SectorAccessibleDisk::hasPatches() const
 	return !patch->isEmptyPatch();
 }
 
+void SectorAccessibleDisk::enableOverlay()
+{
+	overlayEnabled = true;
+}
+
+void SectorAccessibleDisk::commitOverlay()
+{
+	if (overlay.empty()) return;
+	if (forcedWriteProtect || isWriteProtectedImpl()) {
+		throw WriteProtectedException({});
+	}
+	// Remove each sector only after it's written, so that on an error
+	// the remaining sectors are still in the overlay.
+	try {
+		for (auto it = begin(overlay); it != end(overlay);
+		     it = overlay.erase(it)) {
+			writeSectorImpl(it->first, it->second);
+		}
+	} catch (MSXException& e) {
+		flushCaches();
+		throw DiskIOErrorException("Disk I/O error: " + e.getMessage());
+	}
+	flushCaches();
+}
+
+void SectorAccessibleDisk::discardOverlay()
+{
+	if (overlay.empty()) return;
+	auto sectors = std::move(overlay);
+	overlay.clear();
+	for (auto& p : sectors) {
+		overlayChanged(p.first);
+	}
+	flushCaches();
+}
+
+template<typename Archive>
+void SectorAccessibleDisk::serializeOverlay(Archive& ar)
+{
+	std::vector<unsigned> sectors;
+	MemBuffer<SectorBuffer> data;
+	if (!ar.isLoader()) {
+		data.resize(overlay.size());
+		for (auto& p : overlay) {
+			data[sectors.size()] = p.second;
+			sectors.push_back(unsigned(p.first));
+		}
+	}
+	ar.serialize("overlaySectors", sectors);
+	if (ar.isLoader()) data.resize(sectors.size());
+	ar.serialize_blob("overlayData", data.data(),
+	                  sectors.size() * SECTOR_SIZE);
+	if (ar.isLoader()) {
+		discardOverlay();
+		for (auto i : xrange(sectors.size())) {
+			overlay[sectors[i]] = data[i];
+			overlayChanged(sectors[i]);
+		}
+		flushCaches();
+	}
+}
+template void SectorAccessibleDisk::serializeOverlay(MemInputArchive&);
+template void SectorAccessibleDisk::serializeOverlay(MemOutputArchive&);
+template void SectorAccessibleDisk::serializeOverlay(BinInputArchive&);
+template void SectorAccessibleDisk::serializeOverlay(BinOutputArchive&);
+template void SectorAccessibleDisk::serializeOverlay(XmlInputArchive&);
+template void SectorAccessibleDisk::serializeOverlay(XmlOutputArchive&);
+
 Sha1Sum SectorAccessibleDisk::getSha1Sum(FilePool& filePool)
 {
 	checkCaches();
 	if (sha1cache.empty()) {
-		sha1cache = getSha1SumImpl(filePool);
+		// the optimized implementations (e.g. via the filepool) only
+		// look at the underlying image, not at the overlay
+		sha1cache = overlay.empty()
+		          ? getSha1SumImpl(filePool)
+		          : SectorAccessibleDisk::getSha1SumImpl(filePool);
 	}
 	return sha1cache;
 }
@@ -133,7 +223,8 @@ int SectorAccessibleDisk::writeSectors(
 
 bool SectorAccessibleDisk::isWriteProtected() const
 {
-	return forcedWriteProtect || isWriteProtectedImpl();
+	// in overlay mode the underlying image is never written
+	return forcedWriteProtect || (!overlayEnabled && isWriteProtectedImpl());
 }
 
 void SectorAccessibleDisk::forceWriteProtect()
@@ -157,4 +248,9 @@ void SectorAccessibleDisk::flushCaches()
 	sha1cache.clear();
 }
 
+void SectorAccessibleDisk::overlayChanged(size_t /*sector*/)
+{
+	// nothing
+}
+
 } // namespace openmsx
@@ -5,6 +5,7 @@
 #include "Filename.hh"
 #include "sha1.hh"
 #include <vector>
+#include <map>
 #include <memory>
 
 namespace openmsx {
@@ -33,6 +34,24 @@ public:
 	std::vector<Filename> getPatches() const;
 	bool hasPatches() const;
 
+	// copy-on-write overlay stuff
+	/** In overlay mode, writes don't modify the underlying image. Instead
+	 * the written sectors are stored in memory, and reads of those
+	 * sectors return the overlay data. This allows to use the same image
+	 * from many openMSX instances at once, even if it's read-only.
+	 * The overlay can later be written back to the image (commit) or be
+	 * dropped (discard). Both leave overlay mode enabled.
+	 */
+	void enableOverlay();
+	bool hasOverlay() const { return overlayEnabled; }
+	size_t getOverlaySize() const { return overlay.size(); }
+	void commitOverlay();
+	void discardOverlay();
+	/** (De)serialize the sectors in the overlay (not the overlay mode
+	 * itself). On load this replaces the current overlay content.
+	 */
+	template<typename Archive> void serializeOverlay(Archive& ar);
+
 	/** Calculate SHA1 of the content of this disk.
 	 * This value is cached (and flushed on writes).
 	 */
@@ -60,6 +79,9 @@ protected:
 	virtual void checkCaches();
 	virtual void flushCaches();
 	virtual Sha1Sum getSha1SumImpl(FilePool& filepool);
+	// Called when the content of a sector changed without going through
+	// writeSectorImpl() (writes to or discarding of the overlay).
+	virtual void overlayChanged(size_t sector);
 
 private:
 	virtual void readSectorImpl (size_t sector,       SectorBuffer& buf) = 0;
@@ -68,9 +90,11 @@ private:
 	virtual bool isWriteProtectedImpl() const = 0;
 
 	std::unique_ptr<const PatchInterface> patch;
+	std::map<size_t, SectorBuffer> overlay;
 	Sha1Sum sha1cache;
 	bool forcedWriteProtect;
 	bool peekMode;
+	bool overlayEnabled;
 
 	friend class EmptyDiskPatch;
 };
@@ -1,7 +1,11 @@
 #include "CompressedFileAdapter.hh"
+#include "DeflateIndex.hh"
 #include "FileException.hh"
+#include "StringOp.hh"
 #include "hash_set.hh"
+#include "memory.hh"
 #include "xxhash.hh"
+#include <mutex>
 #include <cstring>
 
 using std::string;
@@ -15,15 +19,22 @@ struct GetURLFromDecompressed {
 };
 static hash_set<std::shared_ptr<CompressedFileAdapter::Decompressed>,
                 GetURLFromDecompressed, XXHasher> decompressCache;
+// Files can be opened from multiple threads (e.g. the filepool indexer).
+static std::mutex decompressCacheMutex;
+
+// Files that decompress to at least this size are not decompressed as a whole
+// on first access, instead only the parts that are actually read are.
+static const size_t MIN_DEFLATE_INDEX_SIZE = 4 * 1024 * 1024;
 
 
 CompressedFileAdapter::CompressedFileAdapter(std::unique_ptr<FileBase> file_)
-	: file(std::move(file_)), pos(0)
+	: file(std::move(file_)), pos(0), triedDeflateIndex(false)
 {
 }
 
 CompressedFileAdapter::~CompressedFileAdapter()
 {
+	std::lock_guard<std::mutex> lock(decompressCacheMutex);
 	auto it = decompressCache.find(getURL());
 	decompressed.reset();
 	if (it != end(decompressCache) && it->unique()) {
@@ -32,28 +43,94 @@ CompressedFileAdapter::~CompressedFileAdapter()
 	}
 }
 
+void CompressedFileAdapter::prepareFork()
+{
+	decompressCacheMutex.lock();
+}
+
+void CompressedFileAdapter::afterFork()
+{
+	decompressCacheMutex.unlock();
+}
+
 void CompressedFileAdapter::decompress()
 {
 	if (decompressed) return;
 
 	string url = getURL();
-	auto it = decompressCache.find(url);
-	if (it != end(decompressCache)) {
-		decompressed = *it;
-	} else {
-		decompressed = std::make_shared<Decompressed>();
-		decompress(*file, *decompressed);
-		decompressed->cachedModificationDate = getModificationDate();
-		decompressed->cachedURL = std::move(url);
-		decompressCache.insert_noDuplicateCheck(decompressed);
+	{
+		std::lock_guard<std::mutex> lock(decompressCacheMutex);
+		auto it = decompressCache.find(url);
+		if (it != end(decompressCache)) {
+			decompressed = *it;
+		}
+	}
+	if (!decompressed) {
+		// decompress without holding the lock
+		auto result = std::make_shared<Decompressed>();
+		decompress(*file, *result);
+		result->cachedModificationDate = getModificationDate();
+		result->cachedURL = url;
+
+		std::lock_guard<std::mutex> lock(decompressCacheMutex);
+		auto it = decompressCache.find(url);
+		if (it != end(decompressCache)) {
+			// another thread was faster
+			decompressed = *it;
+		} else {
+			decompressed = std::move(result);
+			decompressCache.insert_noDuplicateCheck(decompressed);
+		}
 	}
 
 	// close original file after succesful decompress
+	deflateIndex.reset();
 	file.reset();
 }
 
+bool CompressedFileAdapter::initDeflateIndex()
+{
+	if (deflateIndex) return true;
+	if (triedDeflateIndex) return false;
+	triedDeflateIndex = true;
+
+	string url = getURL();
+	{
+		// already fully decompressed (by another File object)
+		std::lock_guard<std::mutex> lock(decompressCacheMutex);
+		if (decompressCache.find(url) != end(decompressCache)) {
+			return false;
+		}
+	}
+	try {
+		compressedData = file->mmap(compressedSize);
+		size_t sizeHint;
+		if (!findDeflateStream(compressedData, compressedSize,
+		                       streamOffset, sizeHint, originalName) ||
+		    (sizeHint < MIN_DEFLATE_INDEX_SIZE)) {
+			return false;
+		}
+		string key = url + '|' + StringOp::toString(compressedSize) +
+		             '|' + StringOp::toString(getModificationDate());
+		deflateIndex = make_unique<DeflateIndex>(
+			compressedData + streamOffset,
+			compressedSize - streamOffset, key);
+		return true;
+	} catch (FileException&) {
+		// fall back to decompressing the whole file
+		return false;
+	}
+}
+
 void CompressedFileAdapter::read(void* buffer, size_t num)
 {
+	if (!decompressed && initDeflateIndex()) {
+		deflateIndex->read(compressedData + streamOffset,
+		                   compressedSize - streamOffset,
+		                   pos, static_cast<byte*>(buffer), num);
+		pos += num;
+		return;
+	}
 	decompress();
 	if (decompressed->size < (pos + num)) {
 		throw FileException("Read beyond end of file");
@@ -82,6 +159,9 @@ void CompressedFileAdapter::munmap()
 
 size_t CompressedFileAdapter::getSize()
 {
+	if (!decompressed && initDeflateIndex()) {
+		return deflateIndex->getSize();
+	}
 	decompress();
 	return decompressed->size;
 }
@@ -113,6 +193,9 @@ const string CompressedFileAdapter::getURL() const
 
 const string CompressedFileAdapter::getOriginalName()
 {
+	if (!decompressed && initDeflateIndex()) {
+		return originalName;
+	}
 	decompress();
 	return decompressed->originalName;
 }
@@ -7,6 +7,8 @@
 
 namespace openmsx {
 
+class DeflateIndex;
+
 class CompressedFileAdapter : public FileBase
 {
 public:
@@ -32,17 +34,40 @@ public:
 	bool isReadOnly() const final override;
 	time_t getModificationDate() final override;
 
+	/** Must be called right before and right after fork(). Makes sure no
+	  * other thread (e.g. the filepool indexer) holds the lock on the
+	  * decompress cache during the fork.
+	  */
+	static void prepareFork();
+	static void afterFork();
+
 protected:
 	explicit CompressedFileAdapter(std::unique_ptr<FileBase> file);
 	~CompressedFileAdapter();
 	virtual void decompress(FileBase& file, Decompressed& decompressed) = 0;
 
+	/** Locate the raw deflate stream in the given compressed data. This
+	  * allows to only decompress the parts of a (large) file that are
+	  * actually read. 'sizeHint' is the (expected) decompressed size.
+	  * Returns false if the stream cannot be located.
+	  */
+	virtual bool findDeflateStream(const byte* data, size_t size,
+	                               size_t& offset, size_t& sizeHint,
+	                               std::string& origName) = 0;
+
 private:
 	void decompress();
+	bool initDeflateIndex();
 
 	std::unique_ptr<FileBase> file;
 	std::shared_ptr<Decompressed> decompressed;
+	std::unique_ptr<DeflateIndex> deflateIndex;
+	const byte* compressedData;
+	size_t compressedSize;
+	size_t streamOffset;
+	std::string originalName;
 	size_t pos;
+	bool triedDeflateIndex;
 };
 
 } // namespace openmsx
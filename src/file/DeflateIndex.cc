@@ -0,0 +1,285 @@
+#include "DeflateIndex.hh"
+#include "File.hh"
+#include "FileException.hh"
+#include "FileOperations.hh"
+#include "StringOp.hh"
+#include "xxhash.hh"
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <zlib.h>
+
+using std::string;
+
+namespace openmsx {
+
+// Distance (in decompressed bytes) between two checkpoints. This is also the
+// amount of data that's decompressed at once.
+static const size_t SPAN = 1024 * 1024;
+static const size_t WINDOW_SIZE = 32768;
+// Number of recently decompressed spans that are kept around.
+static const size_t NUM_CHUNKS = 4;
+
+static const char INDEX_MAGIC[8] = { 'o','M','S','X','Z','I','D','X' };
+
+// The index of a stream is cached in the user data dir, in a file named
+// after the hash of its key (the key itself is stored inside the file).
+static string getCacheFilename(const string& key)
+{
+	return FileOperations::getUserDataDir() + "/.deflateindex/" +
+	       StringOp::toHexString(xxhash(key), 8);
+}
+
+DeflateIndex::DeflateIndex(const byte* data, size_t size, const string& key)
+	: totalSize(0)
+	, useCounter(0)
+{
+	if (size > std::numeric_limits<uInt>::max()) {
+		throw FileException(
+			"Error while decompressing: input file too big");
+	}
+	string filename = getCacheFilename(key);
+	if (!load(filename, key)) {
+		build(data, size);
+		save(filename, key);
+	}
+}
+
+void DeflateIndex::build(const byte* data, size_t size)
+{
+	// the start of the stream is an implicit checkpoint
+	checkpoints.clear();
+	checkpoints.emplace_back();
+	checkpoints.back().out = 0;
+	checkpoints.back().in = 0;
+	checkpoints.back().bits = 0;
+	checkpoints.back().window.resize(WINDOW_SIZE);
+	memset(checkpoints.back().window.data(), 0, WINDOW_SIZE);
+
+	z_stream s;
+	s.zalloc = nullptr;
+	s.zfree  = nullptr;
+	s.opaque = nullptr;
+	s.next_in  = const_cast<byte*>(data);
+	s.avail_in = uInt(size);
+	int initErr = inflateInit2(&s, -MAX_WBITS);
+	if (initErr != Z_OK) {
+		throw FileException(StringOp::Builder()
+			<< "Error initializing inflate struct: " << zError(initErr));
+	}
+
+	// Decompress block by block into a circular window buffer. At the
+	// end of a block (if at least SPAN bytes were produced since the last
+	// checkpoint) record a new checkpoint.
+	MemBuffer<byte> window(WINDOW_SIZE);
+	s.avail_out = 0;
+	size_t last = 0;
+	while (true) {
+		if (s.avail_out == 0) {
+			s.next_out = window.data();
+			s.avail_out = WINDOW_SIZE;
+		}
+		int err = ::inflate(&s, Z_BLOCK);
+		if (err == Z_STREAM_END) break;
+		if ((err != Z_OK) || ((s.avail_in == 0) && (s.avail_out != 0))) {
+			inflateEnd(&s);
+			throw FileException(StringOp::Builder()
+				<< "Error decompressing: "
+				<< ((err != Z_OK) ? zError(err) : "unexpected end of file"));
+		}
+		size_t out = s.total_out;
+		if ((s.data_type & 128) && !(s.data_type & 64) &&
+		    ((out - last) >= SPAN)) {
+			Checkpoint cp;
+			cp.out = out;
+			cp.in = s.total_in;
+			cp.bits = s.data_type & 7;
+			cp.window.resize(WINDOW_SIZE);
+			// unroll the circular window
+			size_t left = s.avail_out;
+			memcpy(cp.window.data(), &window[WINDOW_SIZE - left], left);
+			memcpy(cp.window.data() + left, window.data(), WINDOW_SIZE - left);
+			checkpoints.push_back(std::move(cp));
+			last = out;
+		}
+	}
+	totalSize = s.total_out;
+	inflateEnd(&s);
+}
+
+// File layout: magic, key size, key, total size, number of checkpoints,
+// the checkpoints (out, in, bits, window) and an adler32 checksum over
+// everything after the magic.
+bool DeflateIndex::load(const string& filename, const string& key)
+{
+	try {
+		File file(filename);
+		uLong checksum = adler32(0, nullptr, 0);
+		auto read = [&](void* buf, size_t num) {
+			file.read(buf, num);
+			checksum = adler32(checksum, static_cast<Bytef*>(buf), uInt(num));
+		};
+		char magic[8];
+		file.read(magic, sizeof(magic));
+		if (memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0) return false;
+		uint64_t keySize, total, num;
+		read(&keySize, sizeof(keySize));
+		if (keySize != key.size()) return false;
+		string fileKey(keySize, '\0');
+		read(&fileKey[0], keySize);
+		if (fileKey != key) return false;
+		read(&total, sizeof(total));
+		read(&num, sizeof(num));
+		if ((num == 0) ||
+		    (file.getSize() != (file.getPos() +
+		                        num * (3 * sizeof(uint64_t) + WINDOW_SIZE) +
+		                        sizeof(uint64_t)))) {
+			return false;
+		}
+		checkpoints.resize(num);
+		for (auto& cp : checkpoints) {
+			uint64_t tmp[3];
+			read(tmp, sizeof(tmp));
+			cp.out  = tmp[0];
+			cp.in   = tmp[1];
+			cp.bits = unsigned(tmp[2]);
+			cp.window.resize(WINDOW_SIZE);
+			read(cp.window.data(), WINDOW_SIZE);
+		}
+		uint64_t fileChecksum;
+		file.read(&fileChecksum, sizeof(fileChecksum));
+		if ((fileChecksum != checksum) ||
+		    (checkpoints.front().out != 0)) {
+			checkpoints.clear();
+			return false;
+		}
+		totalSize = total;
+		return true;
+	} catch (FileException&) {
+		checkpoints.clear();
+		return false;
+	}
+}
+
+void DeflateIndex::save(const string& filename, const string& key) const
+{
+	// Other openMSX processes may read (or write) the same index at the
+	// same time, so replace the file as a whole.
+	try {
+		FileOperations::mkdirp(FileOperations::getUserDataDir() + "/.deflateindex");
+		FileOperations::replaceFile(filename, [&](FILE* file) {
+			uLong checksum = adler32(0, nullptr, 0);
+			auto write = [&](const void* buf, size_t num) {
+				checksum = adler32(checksum,
+					static_cast<const Bytef*>(buf), uInt(num));
+				return fwrite(buf, 1, num, file) == num;
+			};
+			uint64_t keySize = key.size();
+			uint64_t total = totalSize;
+			uint64_t num = checkpoints.size();
+			bool ok = (fwrite(INDEX_MAGIC, 1, sizeof(INDEX_MAGIC), file) == sizeof(INDEX_MAGIC)) &&
+			          write(&keySize, sizeof(keySize)) &&
+			          write(key.data(), key.size()) &&
+			          write(&total, sizeof(total)) &&
+			          write(&num, sizeof(num));
+			for (auto& cp : checkpoints) {
+				uint64_t tmp[3] = { cp.out, cp.in, cp.bits };
+				ok = ok && write(tmp, sizeof(tmp)) &&
+				     write(cp.window.data(), WINDOW_SIZE);
+			}
+			uint64_t fileChecksum = checksum;
+			return ok && (fwrite(&fileChecksum, 1, sizeof(fileChecksum), file) ==
+			              sizeof(fileChecksum));
+		});
+	} catch (MSXException&) {
+		// ignore, the index is rebuilt next time
+	}
+}
+
+// Get the decompressed data starting at the given checkpoint.
+const DeflateIndex::Chunk& DeflateIndex::getChunk(
+	const byte* data, size_t size, size_t index)
+{
+	++useCounter;
+	for (auto& c : chunks) {
+		if (c.index == index) {
+			c.lastUse = useCounter;
+			return c;
+		}
+	}
+
+	// not recently used, decompress (reuse least recently used chunk)
+	Chunk* chunk;
+	if (chunks.size() < NUM_CHUNKS) {
+		chunks.emplace_back();
+		chunk = &chunks.back();
+	} else {
+		chunk = &*std::min_element(begin(chunks), end(chunks),
+			[](const Chunk& a, const Chunk& b) {
+				return a.lastUse < b.lastUse; });
+	}
+	const auto& cp = checkpoints[index];
+	size_t chunkEnd = ((index + 1) < checkpoints.size())
+	                ? checkpoints[index + 1].out : totalSize;
+	size_t chunkSize = chunkEnd - cp.out;
+	chunk->buf.resize(chunkSize);
+	chunk->size = chunkSize;
+	chunk->index = size_t(-1); // invalid till fully decompressed
+	chunk->lastUse = useCounter;
+
+	z_stream s;
+	s.zalloc = nullptr;
+	s.zfree  = nullptr;
+	s.opaque = nullptr;
+	s.next_in  = const_cast<byte*>(data + cp.in);
+	s.avail_in = uInt(size - cp.in);
+	int err = inflateInit2(&s, -MAX_WBITS);
+	if (err != Z_OK) {
+		throw FileException(StringOp::Builder()
+			<< "Error initializing inflate struct: " << zError(err));
+	}
+	if (cp.bits) {
+		inflatePrime(&s, cp.bits, data[cp.in - 1] >> (8 - cp.bits));
+	}
+	if (cp.out != 0) {
+		inflateSetDictionary(&s, cp.window.data(), WINDOW_SIZE);
+	}
+	s.next_out = chunk->buf.data();
+	s.avail_out = uInt(chunkSize);
+	while (s.avail_out != 0) {
+		err = ::inflate(&s, Z_NO_FLUSH);
+		if (err == Z_STREAM_END) break;
+		if (err != Z_OK) break;
+	}
+	inflateEnd(&s);
+	if (s.avail_out != 0) {
+		throw FileException(StringOp::Builder()
+			<< "Error decompressing: "
+			<< ((err != Z_OK) ? zError(err) : "unexpected end of file"));
+	}
+	chunk->index = index;
+	return *chunk;
+}
+
+void DeflateIndex::read(const byte* data, size_t size,
+                        size_t pos, byte* buffer, size_t num)
+{
+	if ((pos + num) > totalSize) {
+		throw FileException("Read beyond end of file");
+	}
+	while (num) {
+		// last checkpoint at or before 'pos'
+		auto it = std::upper_bound(begin(checkpoints), end(checkpoints), pos,
+			[](size_t p, const Checkpoint& cp) { return p < cp.out; });
+		size_t index = (it - begin(checkpoints)) - 1;
+		const auto& chunk = getChunk(data, size, index);
+		size_t offset = pos - checkpoints[index].out;
+		size_t n = std::min(num, chunk.size - offset);
+		memcpy(buffer, chunk.buf.data() + offset, n);
+		buffer += n;
+		pos += n;
+		num -= n;
+	}
+}
+
+} // namespace openmsx
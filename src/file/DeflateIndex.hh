@@ -0,0 +1,71 @@
+#ifndef DEFLATEINDEX_HH
+#define DEFLATEINDEX_HH
+
+#include "MemBuffer.hh"
+#include "openmsx.hh"
+#include <string>
+#include <vector>
+
+namespace openmsx {
+
+/** Random access in a raw deflate stream, without decompressing the whole
+  * stream up front.
+  *
+  * During a single decompression pass, checkpoints are recorded at regular
+  * intervals. A checkpoint contains the state needed to restart
+  * decompression at that position (the input position, the bit offset and
+  * the 32kB window of preceding output). A read only has to decompress the
+  * data starting from the nearest checkpoint. The checkpoints are cached on
+  * disk, so that the (slow) initial pass is only needed once per file.
+  *
+  * This is the approach of the 'zran.c' example in the zlib distribution.
+  */
+class DeflateIndex
+{
+public:
+	/** Create the index for the deflate stream in the given buffer. The
+	  * index is loaded from the on-disk cache if possible, otherwise it is
+	  * built (and stored in the cache). 'key' uniquely identifies the
+	  * stream (e.g. filename, size and timestamp of the compressed file).
+	  * Throws FileException in case of a decompression error.
+	  */
+	DeflateIndex(const byte* data, size_t size, const std::string& key);
+
+	/** Size of the decompressed data. */
+	size_t getSize() const { return totalSize; }
+
+	/** Copy (decompressed) data [pos, pos + num) to the given buffer.
+	  * The same 'data' and 'size' as passed to the constructor must be
+	  * passed again (the compressed data is not copied).
+	  */
+	void read(const byte* data, size_t size,
+	          size_t pos, byte* buffer, size_t num);
+
+private:
+	struct Checkpoint {
+		size_t out;  // position in the decompressed data
+		size_t in;   // position in the compressed data
+		unsigned bits; // number of bits of the byte before 'in' to use
+		MemBuffer<byte> window; // preceding decompressed data
+	};
+	struct Chunk {
+		MemBuffer<byte> buf;
+		size_t size;
+		size_t index; // checkpoint number
+		unsigned lastUse;
+	};
+
+	void build(const byte* data, size_t size);
+	bool load(const std::string& filename, const std::string& key);
+	void save(const std::string& filename, const std::string& key) const;
+	const Chunk& getChunk(const byte* data, size_t size, size_t index);
+
+	std::vector<Checkpoint> checkpoints;
+	std::vector<Chunk> chunks; // recently decompressed data
+	size_t totalSize;
+	unsigned useCounter;
+};
+
+} // namespace openmsx
+
+#endif
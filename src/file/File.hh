@@ -134,6 +134,11 @@ public:
 	 */
 	bool isReadOnly() const;
 
+	/** Is this a (g)zipped file? The content of such a file is
+	 * decompressed in memory.
+	 */
+	bool isCompressed() const;
+
 	/** Get the date/time of last modification
 	 * @throws FileException
 	 */
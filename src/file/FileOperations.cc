@@ -282,6 +282,15 @@ int unlink(const std::string& path)
 #endif
 }
 
+int rename(const std::string& oldPath, const std::string& newPath)
+{
+#ifdef _WIN32
+	return _wrename(utf8to16(oldPath).c_str(), utf8to16(newPath).c_str());
+#else
+	return ::rename(oldPath.c_str(), newPath.c_str());
+#endif
+}
+
 int rmdir(const std::string& path)
 {
 #ifdef _WIN32
@@ -805,6 +814,29 @@ FILE_t openUniqueFile(const std::string& directory, std::string& filename)
 #endif
 }
 
+void replaceFile(const std::string& filename,
+                 const std::function<bool(FILE*)>& write)
+{
+	string dir = getBaseName(filename).str();
+	if (dir.empty()) dir = ".";
+	string tmpName;
+	bool ok;
+	{
+		auto file = openUniqueFile(dir, tmpName);
+		// check fclose(), it can fail on a full disk
+		ok = file && write(file.get()) && (fclose(file.release()) == 0);
+	}
+	if (ok && (rename(tmpName, filename) != 0)) {
+		// on windows rename() fails if the file exists
+		unlink(filename);
+		ok = rename(tmpName, filename) == 0;
+	}
+	if (!ok) {
+		unlink(tmpName);
+		throw FileException("Error writing " + filename);
+	}
+}
+
 } // namespace FileOperations
 
 } // namespace openmsx
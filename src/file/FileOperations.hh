@@ -6,6 +6,7 @@
 #include "statp.hh"
 #include <sys/types.h>
 #include <fstream>
+#include <functional>
 #include <memory>
 
 namespace openmsx {
@@ -56,6 +57,11 @@ namespace FileOperations {
 	 */
 	int unlink(const std::string& path);
 
+	/**
+	 * Call rename() in a platform-independent manner
+	 */
+	int rename(const std::string& oldPath, const std::string& newPath);
+
 	/**
 	 * Call rmdir() in a platform-independent manner
 	 */
@@ -279,6 +285,18 @@ namespace FileOperations {
 	 */
 	FILE_t openUniqueFile(const std::string& directory, std::string& filename);
 
+	/**
+	 * Write a new file and (atomically) replace the given file with it.
+	 * A failed write keeps the old file, and other processes never see
+	 * a partially written file. The directory must already exist.
+	 * @param filename The file to create or replace
+	 * @param write Writes the content to the given (temporary) file,
+	 *              returns false on error
+	 * @throws FileException when the file couldn't be written
+	 */
+	void replaceFile(const std::string& filename,
+	                 const std::function<bool(FILE*)>& write);
+
 } // namespace FileOperations
 } // namespace openmsx
 
@@ -12,18 +12,28 @@
 #include "EventDistributor.hh"
 #include "CliComm.hh"
 #include "Reactor.hh"
+#include "StartupProfiler.hh"
+#include "Thread.hh"
 #include "Timer.hh"
+#include "Poller.hh"
 #include "StringOp.hh"
 #include "memory.hh"
 #include "sha1.hh"
 #include "stl.hh"
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <iterator>
 #include <cassert>
+#include <cstring>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 using std::ifstream;
 using std::get;
 using std::make_tuple;
-using std::ofstream;
 using std::string;
 using std::vector;
 
@@ -41,7 +51,45 @@ private:
 };
 
 
-const char* const FILE_CACHE = "/.filecache";
+const char* const FILE_CACHE     = "/.filecache";     // old text format
+const char* const FILE_CACHE_BIN = "/.filecache.bin";
+
+// The binary cache file has the following layout:
+//  - BinHeader
+//  - BinEntry[numEntries], sorted on sha1sum
+//  - the filenames (not zero-terminated), 'namesSize' bytes in total
+//  - journal records, appended by later sessions: each is a BinRecord
+//    followed by the filename. These are replayed on top of the entries.
+// Everything is stored in native byte order; this cache is machine-local.
+static const char BIN_MAGIC[8] = { 'o','M','S','X','F','P','C','1' };
+static const uint32_t BIN_BYTE_ORDER = 0x01020304;
+static const uint32_t RECORD_ADD    = 1;
+static const uint32_t RECORD_REMOVE = 2;
+
+struct BinHeader {
+	char magic[8];
+	uint32_t byteOrder;
+	uint32_t numEntries;
+	uint32_t namesSize;
+	uint32_t padding;
+};
+struct FilePool::BinEntry {
+	Sha1Sum sum;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	int64_t time;
+};
+struct BinRecord {
+	uint32_t type; // RECORD_ADD or RECORD_REMOVE
+	uint32_t nameLength;
+	int64_t time;
+	Sha1Sum sum;
+};
+static_assert(sizeof(Sha1Sum) == 20, "must be a plain 160-bit value");
+
+// Write the journal when it's small compared to the whole cache, otherwise
+// rewrite the (compacted) cache file.
+static const size_t MAX_JOURNAL_RECORDS = 1024;
 
 static string initialFilePoolSettingValue()
 {
@@ -72,19 +120,33 @@ FilePool::FilePool(CommandController& controller, Reactor& reactor_)
 		"instead use the 'filepool' command.",
 		initialFilePoolSettingValue())
 	, reactor(reactor_)
+	, table(nullptr)
+	, tableNames(nullptr)
+	, tableSize(0)
 	, quit(false)
+	, amountIndexed(0)
+	, amountToIndex(0)
+	, indexComplete(false)
+	, indexerWatchFd(-1)
+	, diskEntries(0)
+	, diskRecords(0)
+	, rewriteCache(false)
+	, ownsCache(true)
 {
 	filePoolSetting.attach(*this);
 	reactor.getEventDistributor().registerEventListener(OPENMSX_QUIT_EVENT, *this);
 	readSha1sums();
-	needWrite = false;
 
 	sha1SumCommand = make_unique<Sha1SumCommand>(controller, *this);
+
+	startIndexer();
 }
 
 FilePool::~FilePool()
 {
-	if (needWrite) {
+	stopIndexer();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
 		writeSha1sums();
 	}
 	reactor.getEventDistributor().unregisterEventListener(OPENMSX_QUIT_EVENT, *this);
@@ -96,13 +158,68 @@ void FilePool::insert(const Sha1Sum& sum, time_t time, const string& filename)
 	auto it = upper_bound(begin(pool), end(pool), sum,
 	                      LessTupleElement<0>());
 	pool.insert(it, make_tuple(sum, time, filename));
-	needWrite = true;
+	log(true, sum, time, filename);
 }
 
 void FilePool::remove(Pool::iterator it)
 {
+	log(false, get<0>(*it), get<1>(*it), get<2>(*it));
 	pool.erase(it);
-	needWrite = true;
+}
+
+// Remember a change of the pool, so that it can later be appended to the
+// cache file.
+void FilePool::log(bool add, const Sha1Sum& sum, time_t time, string_ref filename)
+{
+	JournalEntry j;
+	j.add = add;
+	j.sum = sum;
+	j.time = time;
+	j.filename = filename.str();
+	journal.push_back(std::move(j));
+}
+
+// Merge the given entries (in any order) into the pool. Much cheaper than
+// inserting them one by one.
+void FilePool::merge(Pool& entries)
+{
+	if (entries.empty()) return;
+	for (auto& e : entries) log(true, get<0>(e), get<1>(e), get<2>(e));
+	sort(begin(entries), end(entries), LessTupleElement<0>());
+	auto middle = pool.size();
+	pool.insert(end(pool), std::make_move_iterator(begin(entries)),
+	                       std::make_move_iterator(end(entries)));
+	inplace_merge(begin(pool), begin(pool) + middle, end(pool),
+	              LessTupleElement<0>());
+	entries.clear();
+}
+
+// Insert a new entry for 'filename' or update the existing one.
+void FilePool::updateEntry(const Sha1Sum& sum, time_t time, const string& filename)
+{
+	auto it = findInDatabase(filename);
+	if (it != end(pool)) {
+		get<1>(*it) = time;
+		adjust(it, sum);
+		return;
+	}
+	auto i = findInTable(filename);
+	if (i != tableSize) {
+		if ((table[i].sum == sum) && (time_t(table[i].time) == time)) {
+			return; // unchanged
+		}
+		// the table is read-only, replace the entry by one in 'pool'
+		removeFromTable(i);
+	}
+	insert(sum, time, filename);
+}
+
+void FilePool::removeEntry(const string& filename)
+{
+	auto it = findInDatabase(filename);
+	if (it != end(pool)) remove(it);
+	auto i = findInTable(filename);
+	if (i != tableSize) removeFromTable(i);
 }
 
 // Change the sha1sum of the element pointed to by 'it' into 'newSum'.
@@ -112,10 +229,11 @@ void FilePool::remove(Pool::iterator it)
 // Returns true  if the new position is after          the old position.
 bool FilePool::adjust(Pool::iterator it, const Sha1Sum& newSum)
 {
-	needWrite = true;
+	log(false, get<0>(*it), get<1>(*it), get<2>(*it));
 	auto newIt = upper_bound(begin(pool), end(pool), newSum,
 	                         LessTupleElement<0>());
 	get<0>(*it) = newSum; // update sum
+	log(true, get<0>(*it), get<1>(*it), get<2>(*it));
 	if (newIt > it) {
 		// move to back
 		rotate(it, it + 1, newIt);
@@ -154,7 +272,25 @@ void FilePool::readSha1sums()
 {
 	assert(pool.empty());
 
-	string cacheFile = FileOperations::getUserDataDir() + FILE_CACHE;
+	string dir = FileOperations::getUserDataDir();
+	if (!readBinaryCache(dir + FILE_CACHE_BIN)) {
+		// No (valid) binary cache, migrate from the old text format.
+		pool.clear();
+		readTextCache(dir + FILE_CACHE);
+		rewriteCache = true;
+	}
+
+	if (!std::is_sorted(begin(pool), end(pool), LessTupleElement<0>())) {
+		// This should _rarely_ happen. In fact it should only happen
+		// when .filecache was manually edited. Though because it's
+		// very important that pool is indeed sorted I've added this
+		// safety mechanism.
+		sort(begin(pool), end(pool), LessTupleElement<0>());
+	}
+}
+
+void FilePool::readTextCache(const string& cacheFile)
+{
 	ifstream file(cacheFile.c_str());
 	string line;
 	Sha1Sum sum;
@@ -166,30 +302,239 @@ void FilePool::readSha1sums()
 			pool.emplace_back(sum, time, filename);
 		}
 	}
+}
 
-	if (!std::is_sorted(begin(pool), end(pool), LessTupleElement<0>())) {
-		// This should _rarely_ happen. In fact it should only happen
-		// when .filecache was manually edited. Though because it's
-		// very important that pool is indeed sorted I've added this
-		// safety mechanism.
-		sort(begin(pool), end(pool), LessTupleElement<0>());
+static string journalKey(const Sha1Sum& sum, const char* filename, size_t length)
+{
+	string key(reinterpret_cast<const char*>(&sum), sizeof(sum));
+	key.append(filename, length);
+	return key;
+}
+
+bool FilePool::readBinaryCache(const string& cacheFile)
+{
+	static_assert((sizeof(BinHeader) % alignof(BinEntry)) == 0,
+	              "entries must be aligned");
+	try {
+		File file(cacheFile);
+		size_t size;
+		const byte* data = file.mmap(size);
+		BinHeader header;
+		if (size < sizeof(header)) return false;
+		memcpy(&header, data, sizeof(header));
+		if (memcmp(header.magic, BIN_MAGIC, sizeof(BIN_MAGIC)) ||
+		    (header.byteOrder != BIN_BYTE_ORDER)) {
+			return false;
+		}
+		size_t namesStart = sizeof(header) +
+		                    size_t(header.numEntries) * sizeof(BinEntry);
+		size_t journalStart = namesStart + header.namesSize;
+		if (journalStart > size) return false;
+		auto* entries = reinterpret_cast<const BinEntry*>(data + sizeof(header));
+		auto* names = reinterpret_cast<const char*>(data + namesStart);
+		for (unsigned i = 0; i < header.numEntries; ++i) {
+			const auto& e = entries[i];
+			if (((size_t(e.nameOffset) + e.nameLength) > header.namesSize) ||
+			    ((i != 0) && (e.sum < entries[i - 1].sum))) {
+				return false;
+			}
+		}
+
+		// Collect the journal, only the last change of each
+		// (sha1sum, filename) pair matters.
+		hash_map<string, JournalEntry, XXHasher> changes;
+		size_t pos = journalStart;
+		diskRecords = 0;
+		while (pos != size) {
+			BinRecord record;
+			if ((size - pos) < sizeof(record)) break;
+			memcpy(&record, data + pos, sizeof(record));
+			pos += sizeof(record);
+			if (((size - pos) < record.nameLength) ||
+			    ((record.type != RECORD_ADD) &&
+			     (record.type != RECORD_REMOVE))) {
+				break;
+			}
+			auto* name = reinterpret_cast<const char*>(data + pos);
+			pos += record.nameLength;
+			JournalEntry j;
+			j.add = record.type == RECORD_ADD;
+			j.sum = record.sum;
+			j.time = time_t(record.time);
+			j.filename.assign(name, record.nameLength);
+			changes[journalKey(j.sum, name, record.nameLength)] = std::move(j);
+			++diskRecords;
+		}
+		if (pos != size) {
+			// Incomplete journal (e.g. crash while writing it), the
+			// valid part is used, but the file must be rewritten.
+			rewriteCache = true;
+		}
+
+		// The entries are used directly from the mmap'ed file, only
+		// the changes in the journal are copied.
+		table = entries;
+		tableNames = names;
+		tableSize = header.numEntries;
+		tableRemoved.assign(tableSize, false);
+		tableFile = std::move(file);
+		for (size_t i = 0; (i < tableSize) && !changes.empty(); ++i) {
+			const auto& e = table[i];
+			auto it = changes.find(journalKey(
+				e.sum, tableNames + e.nameOffset, e.nameLength));
+			if (it == end(changes)) continue;
+			const auto& c = it->second;
+			if (!c.add || (c.time != time_t(e.time))) {
+				tableRemoved[i] = true;
+				if (c.add) pool.emplace_back(c.sum, c.time, c.filename);
+			}
+			changes.erase(it);
+		}
+		// Remaining additions are new entries. This breaks the sort
+		// order, that's fixed by our caller.
+		for (auto& c : changes) {
+			if (c.second.add) {
+				pool.emplace_back(c.second.sum, c.second.time,
+				                  std::move(c.second.filename));
+			}
+		}
+		diskEntries = header.numEntries;
+		return true;
+	} catch (FileException&) {
+		return false;
 	}
 }
 
 void FilePool::writeSha1sums()
 {
-	string cacheFile = FileOperations::getUserDataDir() + FILE_CACHE;
-	ofstream file;
-	FileOperations::openofstream(file, cacheFile);
-	if (!file.is_open()) {
-		return;
+	if (!ownsCache) return;
+	if (journal.empty() && !rewriteCache) return;
+
+	string cacheFile = FileOperations::getUserDataDir() + FILE_CACHE_BIN;
+	size_t numRecords = diskRecords + journal.size();
+	if (!rewriteCache &&
+	    (numRecords <= std::max<size_t>(MAX_JOURNAL_RECORDS, diskEntries / 4))) {
+		try {
+			appendJournal(cacheFile);
+			return;
+		} catch (FileException&) {
+			// try to rewrite the whole file instead
+		}
+	}
+	try {
+		writeBinaryCache(cacheFile);
+	} catch (FileException&) {
+		// ignore, cache will be rebuilt
+	}
+}
+
+void FilePool::appendJournal(const string& cacheFile)
+{
+	std::vector<char> buf;
+	for (auto& j : journal) {
+		BinRecord record = {}; // also zero the padding
+		record.type = j.add ? RECORD_ADD : RECORD_REMOVE;
+		record.nameLength = uint32_t(j.filename.size());
+		record.time = j.time;
+		record.sum = j.sum;
+		auto* r = reinterpret_cast<const char*>(&record);
+		buf.insert(end(buf), r, r + sizeof(record));
+		buf.insert(end(buf), begin(j.filename), end(j.filename));
+	}
+	// Open in append mode: when another openMSX process appends at the
+	// same time, the records don't overwrite each other.
+	if (!FileOperations::isRegularFile(cacheFile)) {
+		throw FileException("Missing " + cacheFile);
+	}
+	auto file = FileOperations::openFile(cacheFile, "ab");
+	if (!file ||
+	    (fwrite(buf.data(), 1, buf.size(), file.get()) != buf.size()) ||
+	    (fclose(file.release()) != 0)) {
+		throw FileException("Error writing " + cacheFile);
+	}
+	diskRecords += unsigned(journal.size());
+	journal.clear();
+}
+
+void FilePool::writeBinaryCache(const string& cacheFile)
+{
+	// Merge the table (without the removed entries) and 'pool', both are
+	// sorted on sha1sum.
+	size_t num = 0;
+	size_t namesSize = 0;
+	for (size_t i = 0; i < tableSize; ++i) {
+		if (tableRemoved[i]) continue;
+		++num;
+		namesSize += table[i].nameLength;
 	}
 	for (auto& p : pool) {
-		file << get<0>(p).toString()      << "  " // sum
-		     << Date::toString(get<1>(p)) << "  " // date
-		     << get<2>(p)                         // filename
-		     << '\n';
+		++num;
+		namesSize += get<2>(p).size();
 	}
+	size_t entriesSize = num * sizeof(BinEntry);
+	MemBuffer<byte> newTable(entriesSize + namesSize);
+	memset(newTable.data(), 0, entriesSize); // also zeroes the padding
+	auto* entries = reinterpret_cast<BinEntry*>(newTable.data());
+	auto* names = reinterpret_cast<char*>(newTable.data() + entriesSize);
+	size_t n = 0;
+	uint32_t nameOffset = 0;
+	auto add = [&](const Sha1Sum& sum, time_t time, string_ref name) {
+		auto& e = entries[n++];
+		e.sum = sum;
+		e.time = time;
+		e.nameOffset = nameOffset;
+		e.nameLength = uint32_t(name.size());
+		memcpy(names + nameOffset, name.data(), name.size());
+		nameOffset += uint32_t(name.size());
+	};
+	size_t i = 0;
+	auto it = begin(pool);
+	while (true) {
+		while ((i < tableSize) && tableRemoved[i]) ++i;
+		if (i < tableSize) {
+			if ((it == end(pool)) || !(get<0>(*it) < table[i].sum)) {
+				add(table[i].sum, time_t(table[i].time), getTableName(i));
+				++i;
+				continue;
+			}
+		} else if (it == end(pool)) {
+			break;
+		}
+		add(get<0>(*it), get<1>(*it), get<2>(*it));
+		++it;
+	}
+	assert(n == num);
+
+	BinHeader header = {};
+	memcpy(header.magic, BIN_MAGIC, sizeof(BIN_MAGIC));
+	header.byteOrder = BIN_BYTE_ORDER;
+	header.numEntries = uint32_t(num);
+	header.namesSize = uint32_t(namesSize);
+
+	// From now on use the merged table. Release the mmap'ed file first,
+	// on windows it can't be replaced while it's mapped.
+	ownTable = std::move(newTable);
+	table = entries;
+	tableNames = names;
+	tableSize = num;
+	tableRemoved.assign(num, false);
+	tableFile.close();
+	pool.clear();
+
+	// Write to a new file and then replace the old one. So a crash while
+	// writing, or another openMSX process that reads or writes the cache
+	// at the same time, never sees a partially written file. On error
+	// the journal is kept, it still applies to the old file.
+	FileOperations::mkdirp(FileOperations::getUserDataDir());
+	FileOperations::replaceFile(cacheFile, [&](FILE* file) {
+		return (fwrite(&header, 1, sizeof(header), file) == sizeof(header)) &&
+		       (fwrite(ownTable.data(), 1, entriesSize + namesSize, file) ==
+		        (entriesSize + namesSize));
+	});
+	diskEntries = header.numEntries;
+	diskRecords = 0;
+	journal.clear();
+	rewriteCache = false;
 }
 
 static int parseTypes(Interpreter& interp, const TclObject& list)
@@ -217,6 +562,7 @@ void FilePool::update(const Setting& setting)
 {
 	assert(&setting == &filePoolSetting); (void)setting;
 	getDirectories(); // check for syntax errors
+	startIndexer(); // re-index with the new directories
 }
 
 FilePool::Directories FilePool::getDirectories() const
@@ -264,30 +610,51 @@ FilePool::Directories FilePool::getDirectories() const
 
 File FilePool::getFile(FileType fileType, const Sha1Sum& sha1sum)
 {
-	File result = getFromPool(sha1sum);
+	// The background indexer keeps the pool up-to-date with the content
+	// of all filepool directories (of all types), so a lookup only needs
+	// to consult the pool.
+	std::unique_lock<std::mutex> lock(mutex);
+	File result = getFromPool(sha1sum, fileType, lock);
 	if (result.is_open()) return result;
 
-	// not found in cache, need to scan directories
-	ScanProgress progress;
-	progress.lastTime = Timer::getTime();
-	progress.amountScanned = 0;
-
-	Directories directories;
-	try {
-		directories = getDirectories();
-	} catch (CommandException& e) {
-		reactor.getCliComm().printWarning(
-			"Error while parsing '__filepool' setting" + e.getMessage());
+	// not found, maybe the indexer didn't finish its initial scan yet
+	while (!quit && waitForIndexer(sha1sum, fileType, lock)) {
+		result = getFromPool(sha1sum, fileType, lock);
+		if (result.is_open()) break;
 	}
-	for (auto& d : directories) {
-		if (d.types & fileType) {
-			string path = FileOperations::expandTilde(d.path);
-			result = scanDirectory(sha1sum, path, d.path, progress);
-			if (result.is_open()) return result;
+	return result;
+}
+
+// Wait till either the indexer finished or it found a file with the given
+// sha1sum. Returns false if there's no need to search the pool again. The
+// given lock (on 'mutex') is temporarily released while waiting.
+bool FilePool::waitForIndexer(const Sha1Sum& sha1sum, FileType fileType,
+                              std::unique_lock<std::mutex>& lock)
+{
+	if (indexComplete) return false;
+	StartupProfiler::Phase profile("file pool scan");
+
+	auto lastTime = Timer::getTime();
+	while (!indexComplete && !isInPool(sha1sum, fileType)) {
+		indexerCondition.wait_for(lock, std::chrono::milliseconds(100));
+
+		lock.unlock();
+		auto now = Timer::getTime();
+		if (now > (lastTime + 250000)) { // 4Hz
+			lastTime = now;
+			reactor.getCliComm().printProgress(
+				"Searching for file with sha1sum " +
+				sha1sum.toString() + "...\nIndexing filepool: [" +
+				StringOp::toString(amountIndexed) + '/' +
+				StringOp::toString(amountToIndex) + ']');
 		}
+		// Indexing can take a long time. Allow to exit openmsx when
+		// it takes too long.
+		reactor.getEventDistributor().deliverEvents();
+		lock.lock();
+		if (quit) break;
 	}
-
-	return result; // not found
+	return true;
 }
 
 static void reportProgress(const string& filename, size_t percentage,
@@ -335,142 +702,355 @@ static Sha1Sum calcSha1sum(File& file, Reactor& reactor)
 	return sha1.digest();
 }
 
-File FilePool::getFromPool(const Sha1Sum& sha1sum)
+// Is 'filename' a possible match for a file of the given type? Files in the
+// filepool directories only match when the directory has that type. Other
+// files (added via getSha1Sum()) match any type.
+bool FilePool::matchesType(const string& filename, FileType fileType) const
 {
+	bool inDirectory = false;
+	for (auto& d : indexedDirectories) {
+		if (StringOp::startsWith(filename, d.path + '/')) {
+			if (d.types & fileType) return true;
+			inDirectory = true;
+		}
+	}
+	return !inDirectory;
+}
+
+// All (not yet verified) matches for the given sha1sum, both in the table
+// and in 'pool'.
+FilePool::Candidates FilePool::getCandidates(
+	const Sha1Sum& sha1sum, FileType fileType) const
+{
+	Candidates result;
+	struct CompareSum {
+		bool operator()(const BinEntry& e, const Sha1Sum& s) const { return e.sum < s; }
+		bool operator()(const Sha1Sum& s, const BinEntry& e) const { return s < e.sum; }
+	};
+	auto tableBound = std::equal_range(table, table + tableSize, sha1sum,
+	                                   CompareSum());
+	for (auto* e = tableBound.first; e != tableBound.second; ++e) {
+		size_t i = e - table;
+		if (tableRemoved[i]) continue;
+		auto name = getTableName(i).str();
+		if (matchesType(name, fileType)) {
+			result.emplace_back(std::move(name), time_t(e->time));
+		}
+	}
 	auto bound = equal_range(begin(pool), end(pool), sha1sum,
 	                         LessTupleElement<0>());
-	// use indices instead of iterators
-	auto i    = distance(begin(pool), bound.first);
-	auto last = distance(begin(pool), bound.second);
-	while (i != last) {
-		auto it = begin(pool) + i;
-		auto& time           = get<1>(*it);
-		const auto& filename = get<2>(*it);
+	for (auto it = bound.first; it != bound.second; ++it) {
+		if (matchesType(get<2>(*it), fileType)) {
+			result.emplace_back(get<2>(*it), get<1>(*it));
+		}
+	}
+	return result;
+}
+
+// Is there a (not yet verified) match for the given sha1sum in the pool?
+bool FilePool::isInPool(const Sha1Sum& sha1sum, FileType fileType) const
+{
+	return !getCandidates(sha1sum, fileType).empty();
+}
+
+// Search the pool for a file with the given sha1sum. The given lock (on
+// 'mutex') is released while files are opened or hashed, this can take
+// long and would block the indexer. So the pool can change in the mean time,
+// that's why the candidates are copied and looked up again by name.
+File FilePool::getFromPool(const Sha1Sum& sha1sum, FileType fileType,
+                           std::unique_lock<std::mutex>& lock)
+{
+	auto candidates = getCandidates(sha1sum, fileType);
+	lock.unlock();
+	for (auto& c : candidates) {
+		const auto& filename = c.first;
 		try {
 			File file(filename);
 			auto newTime = file.getModificationDate();
-			if (time == newTime) {
+			if (c.second == newTime) {
 				// When modification time is unchanged, assume
 				// sha1sum is also unchanged. So avoid
 				// expensive sha1sum calculation.
+				lock.lock();
 				return file;
 			}
-			time = newTime; // update timestamp
-			needWrite = true;
 			auto newSum = calcSha1sum(file, reactor);
-			if (newSum == sha1sum) {
-				// Modification time was changed, but
-				// (recalculated) sha1sum is still the same.
-				return file;
-			}
-			// Sha1sum has changed: update sha1sum, move entry to
-			// new position new sum and continue searching.
-			if (adjust(it, newSum)) {
-				// after
-				--last; // no ++i
-			} else {
-				// before (or at)
-				++i;
-			}
+			lock.lock();
+			// Update timestamp and (possibly changed) sha1sum.
+			updateEntry(newSum, newTime, filename);
+			if (newSum == sha1sum) return file;
+			lock.unlock();
 		} catch (FileException&) {
 			// Error reading file: remove from db and continue
 			// searching.
-			remove(it);
-			--last;
+			lock.lock();
+			removeEntry(filename);
+			lock.unlock();
 		}
 	}
+	lock.lock();
 	return File(); // not found
 }
 
-File FilePool::scanDirectory(
-	const Sha1Sum& sha1sum, const string& directory, const string& poolPath,
-	ScanProgress& progress)
+void FilePool::startIndexer()
 {
+	stopIndexer();
+
+	indexedDirectories.clear();
+	try {
+		for (auto& d : getDirectories()) {
+			indexedDirectories.push_back(d);
+			indexedDirectories.back().path =
+				FileOperations::expandTilde(d.path);
+		}
+	} catch (CommandException& e) {
+		reactor.getCliComm().printWarning(
+			"Error while parsing '__filepool' setting" + e.getMessage());
+	}
+	vector<string> directories;
+	for (auto& d : indexedDirectories) directories.push_back(d.path);
+
+	indexComplete = false;
+	amountIndexed = 0;
+	amountToIndex = 0;
+	indexerPoller = make_unique<Poller>();
+	indexerThread = std::thread([this, directories]() {
+		indexerMain(directories);
+	});
+}
+
+void FilePool::stopIndexer()
+{
+	if (!indexerThread.joinable()) return;
+	indexerPoller->abort();
+	indexerThread.join();
+}
+
+void FilePool::prepareFork()
+{
+	// The indexer thread might hold the lock, the child process would
+	// then never be able to acquire it.
+	mutex.lock();
+}
+
+void FilePool::afterFork(bool child)
+{
+	mutex.unlock();
+	if (!child) return;
+
+	// The indexer thread only exists in the parent process. The new
+	// indexer sets up its own inotify watches, so close the inherited
+	// inotify instance.
+	Thread::forgetAfterFork(indexerThread);
+#ifdef __linux__
+	if (indexerWatchFd != -1) close(indexerWatchFd);
+#endif
+	indexerWatchFd = -1;
+	ownsCache = false;
+	startIndexer();
+}
+
+void FilePool::indexerMain(vector<string> directories)
+{
+	int watchFd = -1;
+#ifdef __linux__
+	// Start watching before scanning, so that no changes are missed.
+	watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		indexerWatchFd = watchFd;
+	}
+	Watches watches;
+
+	KnownFiles known;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < tableSize; ++i) {
+			if (tableRemoved[i]) continue;
+			known[getTableName(i).str()] = time_t(table[i].time);
+		}
+		for (auto& p : pool) {
+			known[get<2>(p)] = get<1>(p);
+		}
+	}
+	vector<IndexJob> jobs;
+	for (auto& d : directories) {
+		collectFiles(d, &known, jobs, watchFd, watches);
+	}
+	known.clear();
+	amountToIndex = unsigned(jobs.size());
+	indexFiles(jobs);
+
+	if (!indexerPoller->aborted()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			indexComplete = true;
+			// Don't wait till exit to store the results, that
+			// would lose them on a crash.
+			writeSha1sums();
+		}
+		indexerCondition.notify_all();
+		watchDirectories(watchFd, watches);
+	}
+#ifdef __linux__
+	std::lock_guard<std::mutex> lock(mutex);
+	if (watchFd != -1) close(watchFd);
+	indexerWatchFd = -1;
+#endif
+}
+
+// Recursively collect the files in 'directory' that must be (re)hashed, these
+// are files that are not in 'known' or that have a different timestamp. When
+// 'known' is nullptr all files are collected.
+void FilePool::collectFiles(
+	const string& directory, const KnownFiles* known,
+	vector<IndexJob>& jobs, int watchFd, Watches& watches)
+{
+#ifdef __linux__
+	if (watchFd != -1) {
+		int wd = inotify_add_watch(watchFd, directory.c_str(),
+			IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+			IN_CREATE | IN_DELETE | IN_ONLYDIR);
+		if (wd != -1) watches[wd] = directory;
+	}
+#else
+	(void)watchFd; (void)watches;
+#endif
+
 	ReadDir dir(directory);
 	while (dirent* d = dir.getEntry()) {
-		if (quit) {
-			// Scanning can take a long time. Allow to exit
-			// openmsx when it takes too long. Stop scanning
-			// by pretending we didn't find the file.
-			return File();
-		}
+		if (indexerPoller->aborted()) return;
 		string file = d->d_name;
 		string path = directory + '/' + file;
 		FileOperations::Stat st;
-		if (FileOperations::getStat(path, st)) {
-			File result;
-			if (FileOperations::isRegularFile(st)) {
-				result = scanFile(sha1sum, path, st, poolPath, progress);
-			} else if (FileOperations::isDirectory(st)) {
-				if ((file != ".") && (file != "..")) {
-					result = scanDirectory(sha1sum, path, poolPath, progress);
+		if (!FileOperations::getStat(path, st)) continue;
+		if (FileOperations::isRegularFile(st)) {
+			auto time = FileOperations::getModificationDate(st);
+			bool isNew = false;
+			if (known) {
+				auto it = known->find(path);
+				if (it != known->end()) {
+					if (it->second == time) continue; // up-to-date
+				} else {
+					isNew = true;
 				}
 			}
-			if (result.is_open()) return result;
+			IndexJob job;
+			job.filename = path;
+			job.time = time;
+			job.isNew = isNew;
+			jobs.push_back(std::move(job));
+		} else if (FileOperations::isDirectory(st)) {
+			if ((file != ".") && (file != "..")) {
+				collectFiles(path, known, jobs, watchFd, watches);
+			}
 		}
 	}
-	return File(); // not found
 }
 
-File FilePool::scanFile(const Sha1Sum& sha1sum, const string& filename,
-                        const FileOperations::Stat& st, const string& poolPath,
-                        ScanProgress& progress)
+// Calculate the sha1sums of the given files using all available cores.
+void FilePool::indexFiles(const vector<IndexJob>& jobs)
 {
-	++progress.amountScanned;
-	// Periodically send a progress message with the current filename
-	auto now = Timer::getTime();
-	if (now > (progress.lastTime + 250000)) { // 4Hz
-		progress.lastTime = now;
-		reactor.getCliComm().printProgress("Searching for file with sha1sum " +
-			sha1sum.toString() + "...\nIndexing filepool " + poolPath +
-			": [" + StringOp::toString(progress.amountScanned) + "]: " +
-			filename.substr(poolPath.size()));
+	// Results for new files are merged in batches to keep the number of
+	// (expensive) pool modifications low.
+	static const size_t BATCH_SIZE = 256;
+
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		Pool batch;
+		while (!indexerPoller->aborted()) {
+			size_t i = next++;
+			if (i >= jobs.size()) break;
+			auto& job = jobs[i];
+			try {
+				File file(job.filename);
+				size_t size;
+				const byte* data = file.mmap(size);
+				auto sum = SHA1::calc(data, size);
+				if (job.isNew) {
+					batch.emplace_back(sum, job.time, job.filename);
+				} else {
+					std::lock_guard<std::mutex> lock(mutex);
+					updateEntry(sum, job.time, job.filename);
+				}
+			} catch (FileException&) {
+				// ignore, also don't remove from pool, this
+				// is done on the next lookup
+			}
+			++amountIndexed;
+			if (batch.size() == BATCH_SIZE) {
+				std::lock_guard<std::mutex> lock(mutex);
+				merge(batch);
+				indexerCondition.notify_all();
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		merge(batch);
+	};
+
+	unsigned numThreads = std::max(1u, std::thread::hardware_concurrency());
+	numThreads = unsigned(std::min<size_t>(numThreads, jobs.size()));
+	vector<std::thread> workers;
+	for (unsigned i = 1; i < numThreads; ++i) {
+		workers.emplace_back(worker);
 	}
+	worker(); // also work in this thread
+	for (auto& w : workers) w.join();
+}
 
-	// deliverEvents() is relatively cheap when there are no events to
-	// deliver, so it's ok to call on each file.
-	reactor.getEventDistributor().deliverEvents();
+// Keep the pool up-to-date with changes in the filepool directories (only
+// implemented on Linux, using inotify). Returns when the indexer is aborted.
+void FilePool::watchDirectories(int watchFd, Watches& watches)
+{
+#ifdef __linux__
+	if (watchFd == -1) return;
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	while (!indexerPoller->poll(watchFd)) {
+		ssize_t len = read(watchFd, buf, sizeof(buf));
+		if (len <= 0) continue;
+		for (char* p = buf; p < (buf + len); ) {
+			auto* event = reinterpret_cast<inotify_event*>(p);
+			p += sizeof(inotify_event) + event->len;
 
-	auto it = findInDatabase(filename);
-	if (it == end(pool)) {
-		// not in pool
-		try {
-			File file(filename);
-			auto sum = calcSha1sum(file, reactor);
-			auto time = FileOperations::getModificationDate(st);
-			insert(sum, time, filename);
-			if (sum == sha1sum) {
-				return file;
+			auto it = watches.find(event->wd);
+			if (it == end(watches)) continue;
+			if (event->mask & IN_IGNORED) {
+				// directory was removed
+				watches.erase(it);
+				continue;
 			}
-		} catch (FileException&) {
-			// ignore
-		}
-	} else {
-		// already in pool
-		assert(filename == get<2>(*it));
-		try {
-			auto time = FileOperations::getModificationDate(st);
-			if (time == get<1>(*it)) {
-				// db is still up to date
-				if (get<0>(*it) == sha1sum) {
-					return File(filename);
-				}
-			} else {
-				// db outdated
-				File file(filename);
-				auto sum = calcSha1sum(file, reactor);
-				get<1>(*it) = time;
-				adjust(it, sum);
-				if (sum == sha1sum) {
-					return file;
+			if (event->len == 0) continue;
+			string path = it->second + '/' + event->name;
+
+			if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+				// For directories, the entries of the contained
+				// files are removed on the next lookup.
+				if (event->mask & IN_ISDIR) continue;
+				std::lock_guard<std::mutex> lock(mutex);
+				removeEntry(path);
+			} else if (event->mask & IN_ISDIR) {
+				if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+					vector<IndexJob> jobs;
+					collectFiles(path, nullptr, jobs, watchFd, watches);
+					indexFiles(jobs);
 				}
+			} else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+				FileOperations::Stat st;
+				if (!FileOperations::getStat(path, st)) continue;
+				IndexJob job;
+				job.filename = path;
+				job.time = FileOperations::getModificationDate(st);
+				job.isNew = false;
+				indexFiles(vector<IndexJob>(1, job));
 			}
-		} catch (FileException&) {
-			// error reading file, remove from db
-			remove(it);
 		}
+		std::lock_guard<std::mutex> lock(mutex);
+		writeSha1sums();
 	}
-	return File(); // not found
+#else
+	(void)watchFd; (void)watches;
+#endif
 }
 
 FilePool::Pool::iterator FilePool::findInDatabase(const string& filename)
@@ -489,28 +1069,54 @@ FilePool::Pool::iterator FilePool::findInDatabase(const string& filename)
 	return end(pool); // not found
 }
 
+string_ref FilePool::getTableName(size_t i) const
+{
+	return string_ref(tableNames + table[i].nameOffset, table[i].nameLength);
+}
+
+// Linear search in the table for filename, returns 'tableSize' if not found.
+size_t FilePool::findInTable(string_ref filename) const
+{
+	for (size_t i = 0; i < tableSize; ++i) {
+		if ((table[i].nameLength == filename.size()) &&
+		    !tableRemoved[i] && (getTableName(i) == filename)) {
+			return i;
+		}
+	}
+	return tableSize;
+}
+
+void FilePool::removeFromTable(size_t i)
+{
+	log(false, table[i].sum, time_t(table[i].time), getTableName(i));
+	tableRemoved[i] = true;
+}
+
 Sha1Sum FilePool::getSha1Sum(File& file)
 {
 	auto time = file.getModificationDate();
 	const auto& filename = file.getURL();
-
-	auto it = findInDatabase(filename);
-	if ((it != end(pool)) && (get<1>(*it) == time)) {
-		// in database and modification time matches,
-		// assume sha1sum also matches
-		return get<0>(*it);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// in database and modification time matches, assume sha1sum
+		// also matches
+		auto it = findInDatabase(filename);
+		if (it != end(pool)) {
+			if (get<1>(*it) == time) return get<0>(*it);
+		} else {
+			auto i = findInTable(filename);
+			if ((i != tableSize) && (time_t(table[i].time) == time)) {
+				return table[i].sum;
+			}
+		}
 	}
 
-	// not in database or timestamp mismatch
+	// Not in database or timestamp mismatch. Calculate without holding
+	// the lock, the pool may have changed in the mean time, so look up
+	// the entry again.
 	auto sum = calcSha1sum(file, reactor);
-	if (it == end(pool)) {
-		// was not yet in database, insert new entry
-		insert(sum, time, filename);
-	} else {
-		// was already in database, but with wrong timestamp (and sha1sum)
-		get<1>(*it) = time;
-		adjust(it, sum);
-	}
+	std::lock_guard<std::mutex> lock(mutex);
+	updateEntry(sum, time, filename);
 	return sum;
 }
 
@@ -519,6 +1125,7 @@ int FilePool::signalEvent(const std::shared_ptr<const Event>& event)
 	(void)event; // avoid warning for non-assert compiles
 	assert(event->getType() == OPENMSX_QUIT_EVENT);
 	quit = true;
+	indexerPoller->abort();
 	return 0;
 }
 
@@ -1,13 +1,22 @@
 #ifndef FILEPOOL_HH
 #define FILEPOOL_HH
 
+#include "File.hh"
 #include "FileOperations.hh"
+#include "MemBuffer.hh"
 #include "StringSetting.hh"
 #include "Observer.hh"
 #include "EventListener.hh"
 #include "sha1.hh"
+#include "hash_map.hh"
+#include "xxhash.hh"
+#include <atomic>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 #include <ctime>
@@ -17,7 +26,7 @@ namespace openmsx {
 
 class CommandController;
 class Reactor;
-class File;
+class Poller;
 class Sha1SumCommand;
 
 class FilePool final : private Observer<Setting>, private EventListener
@@ -42,11 +51,14 @@ public:
 	 */
 	Sha1Sum getSha1Sum(File& file);
 
+	/** Must be called right before and right after fork(). In the child
+	  * process the background indexer is restarted (threads don't survive
+	  * a fork) and the cache file is left to the parent process.
+	  */
+	void prepareFork();
+	void afterFork(bool child);
+
 private:
-	struct ScanProgress {
-		uint64_t lastTime;
-		unsigned amountScanned;
-	};
 	struct Entry {
 		std::string path;
 		int types;
@@ -55,25 +67,67 @@ private:
 
 	// <sha1sum, timestamp, filename>, sorted on sha1sum
 	using Pool = std::vector<std::tuple<Sha1Sum, time_t, std::string>>;
+	// An entry in the table of the binary cache file.
+	struct BinEntry;
+	// <filename, timestamp> of the files that have a given sha1sum
+	using Candidates = std::vector<std::pair<std::string, time_t>>;
+
+	// A file that must be (re)hashed by the background indexer.
+	struct IndexJob {
+		std::string filename;
+		time_t time;
+		bool isNew; // known to be not yet present in the pool
+	};
+	// A change of the pool that's not yet written to the cache file.
+	struct JournalEntry {
+		bool add; // added or removed
+		Sha1Sum sum;
+		time_t time;
+		std::string filename;
+	};
+	// <filename, timestamp> of all files in the pool
+	using KnownFiles = hash_map<std::string, time_t, XXHasher>;
+	// inotify watch descriptor -> directory
+	using Watches = std::map<int, std::string>;
 
+	// The methods below require that 'mutex' is locked.
+	void log(bool add, const Sha1Sum& sum, time_t time, string_ref filename);
 	void insert(const Sha1Sum& sum, time_t time, const std::string& filename);
 	void remove(Pool::iterator it);
 	bool adjust(Pool::iterator it, const Sha1Sum& newSum);
-
-	void readSha1sums();
+	void merge(Pool& entries);
+	void updateEntry(const Sha1Sum& sum, time_t time, const std::string& filename);
+	void removeEntry(const std::string& filename);
+	Pool::iterator findInDatabase(const std::string& filename);
+	string_ref getTableName(size_t i) const;
+	size_t findInTable(string_ref filename) const;
+	void removeFromTable(size_t i);
+	Candidates getCandidates(const Sha1Sum& sha1sum, FileType fileType) const;
 	void writeSha1sums();
+	void appendJournal(const std::string& cacheFile);
+	void writeBinaryCache(const std::string& cacheFile);
 
-	File getFromPool(const Sha1Sum& sha1sum);
-	File scanDirectory(const Sha1Sum& sha1sum,
-	                   const std::string& directory,
-	                   const std::string& poolPath,
-	                   ScanProgress& progress);
-	File scanFile(const Sha1Sum& sha1sum,
-	              const std::string& filename,
-	              const FileOperations::Stat& st,
-	              const std::string& poolPath,
-	              ScanProgress& progress);
-	Pool::iterator findInDatabase(const std::string& filename);
+	// These temporarily release the given lock on 'mutex'.
+	File getFromPool(const Sha1Sum& sha1sum, FileType fileType,
+	                 std::unique_lock<std::mutex>& lock);
+	bool waitForIndexer(const Sha1Sum& sha1sum, FileType fileType,
+	                    std::unique_lock<std::mutex>& lock);
+	bool isInPool(const Sha1Sum& sha1sum, FileType fileType) const;
+	bool matchesType(const std::string& filename, FileType fileType) const;
+
+	void readSha1sums();
+	void readTextCache(const std::string& cacheFile);
+	bool readBinaryCache(const std::string& cacheFile);
+
+	// background indexer
+	void startIndexer();
+	void stopIndexer();
+	void indexerMain(std::vector<std::string> directories);
+	void collectFiles(const std::string& directory, const KnownFiles* known,
+	                  std::vector<IndexJob>& jobs,
+	                  int watchFd, Watches& watches);
+	void indexFiles(const std::vector<IndexJob>& jobs);
+	void watchDirectories(int watchFd, Watches& watches);
 
 	Directories getDirectories() const;
 
@@ -87,9 +141,40 @@ private:
 	StringSetting filePoolSetting;
 	Reactor& reactor;
 
+	// All known files: the table of the binary cache file (as loaded at
+	// startup, or as last written) plus the changes since then in 'pool'.
+	// Table entries that were removed (or changed) since are marked in
+	// 'tableRemoved'. The table is mmap'ed from the cache file (in
+	// 'tableFile') or, after the file was rewritten, kept in 'ownTable'.
+	// Both are sorted on sha1sum. Only the table is normally large.
+	const BinEntry* table;
+	const char* tableNames;
+	size_t tableSize;
+	std::vector<bool> tableRemoved;
+	File tableFile;
+	MemBuffer<byte> ownTable;
 	Pool pool;
+	std::vector<JournalEntry> journal;
+	Directories indexedDirectories; // with expanded paths
 	bool quit;
-	bool needWrite;
+
+	// Protects the table, 'pool', 'journal', 'indexComplete' and
+	// 'indexerWatchFd'.
+	// Also used to wait for the indexer via 'indexerCondition'.
+	std::mutex mutex;
+	std::condition_variable indexerCondition;
+	std::thread indexerThread;
+	std::unique_ptr<Poller> indexerPoller; // to abort the indexer
+	std::atomic<unsigned> amountIndexed;
+	std::atomic<unsigned> amountToIndex;
+	bool indexComplete;
+	int indexerWatchFd; // inotify fd of the indexer, -1 if none
+
+	// state of the binary cache file
+	unsigned diskEntries; // number of (compacted) entries
+	unsigned diskRecords; // number of journal records
+	bool rewriteCache;    // must be rewritten (instead of appended to)
+	bool ownsCache;       // false in a forked child process
 
 	std::unique_ptr<Sha1SumCommand> sha1SumCommand;
 };
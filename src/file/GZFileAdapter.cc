@@ -1,6 +1,7 @@
 #include "GZFileAdapter.hh"
 #include "ZlibInflate.hh"
 #include "FileException.hh"
+#include "endian.hh"
 
 namespace openmsx {
 
@@ -64,4 +65,17 @@ void GZFileAdapter::decompress(FileBase& f, Decompressed& d)
 	d.size = zlib.inflate(d.buf);
 }
 
+bool GZFileAdapter::findDeflateStream(
+	const byte* data, size_t size, size_t& offset, size_t& sizeHint,
+	std::string& origName)
+{
+	ZlibInflate zlib(data, size);
+	if (!skipHeader(zlib, origName)) return false;
+	offset = size - zlib.getRemaining();
+	// gzip trailer: crc32 and (modulo 2^32) uncompressed size
+	if ((size - offset) < 8) return false;
+	sizeHint = Endian::read_UA_L32(data + size - 4);
+	return true;
+}
+
 } // namespace openmsx
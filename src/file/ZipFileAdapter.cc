@@ -40,4 +40,22 @@ void ZipFileAdapter::decompress(FileBase& f, Decompressed& d)
 	d.size = zlib.inflate(d.buf, origSize);
 }
 
+bool ZipFileAdapter::findDeflateStream(
+	const byte* data, size_t size, size_t& offset, size_t& sizeHint,
+	std::string& origName)
+{
+	ZlibInflate zlib(data, size);
+	if (zlib.get32LE() != 0x04034B50) return false;
+	zlib.skip(2 + 2);
+	if (zlib.get16LE() != 0x0008) return false;
+	zlib.skip(2 + 2 + 4 + 4);
+	sizeHint = zlib.get32LE();
+	unsigned filenameLen = zlib.get16LE();
+	unsigned extraFieldLen = zlib.get16LE();
+	origName = zlib.getString(filenameLen);
+	zlib.skip(extraFieldLen);
+	offset = size - zlib.getRemaining();
+	return true;
+}
+
 } // namespace openmsx
@@ -12,6 +12,9 @@ public:
 
 private:
 	void decompress(FileBase& file, Decompressed& decompressed) override;
+	bool findDeflateStream(const byte* data, size_t size,
+	                       size_t& offset, size_t& sizeHint,
+	                       std::string& origName) override;
 };
 
 } // namespace openmsx
@@ -20,6 +20,7 @@ public:
 	unsigned get32LE();
 	std::string getString(size_t len);
 	std::string getCString();
+	size_t getRemaining() const { return s.avail_in; }
 
 	size_t inflate(MemBuffer<byte>& output, size_t sizeHint = 65536);
 
@@ -9,22 +9,42 @@
 #include "Reactor.hh"
 #include "Display.hh"
 #include "GlobalSettings.hh"
+#include "BooleanSetting.hh"
 #include "MSXException.hh"
 #include "HDCommand.hh"
 #include "Timer.hh"
 #include "serialize.hh"
 #include "memory.hh"
 #include "xrange.hh"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 namespace openmsx {
 
 using std::string;
 
+// The image is cached in blocks of 64kB, with at most 2MB in total.
+static const size_t BLOCK_SECTORS = 128;
+static const size_t NUM_BLOCKS = 32;
+// On a sequential read miss, this many blocks are read at once.
+static const size_t READ_AHEAD = 4;
+
 HD::HD(const DeviceConfig& config)
-	: motherBoard(config.getMotherBoard())
+	: RTSchedulable(config.getReactor().getRTScheduler())
+	, motherBoard(config.getMotherBoard())
+	, powerSetting(config.getGlobalSettings().getPowerSetting())
 	, name("hdX")
+	, cache(NUM_BLOCKS)
+	, cacheUseCounter(0)
+	, lastMissBlock(size_t(-1))
 {
+	for (auto& cb : cache) {
+		cb.block = size_t(-1);
+		cb.lastUse = 0;
+		cb.dirtyBegin = BLOCK_SECTORS;
+		cb.dirtyEnd = 0;
+	}
 	hdInUse = motherBoard.getSharedStuff<HDInUse>("hdInUse");
 
 	unsigned id = 0;
@@ -59,6 +79,7 @@ HD::HD(const DeviceConfig& config)
 		file.truncate(size_t(config.getChildDataAsInt("size")) * 1024 * 1024);
 		filesize = file.getSize();
 	}
+	fileTime = file.getModificationDate();
 	tigerTree = make_unique<TigerTree>(
 		*this, filesize, filename.getResolved());
 
@@ -68,13 +89,16 @@ HD::HD(const DeviceConfig& config)
 		motherBoard.getStateChangeDistributor(),
 		motherBoard.getScheduler(),
 		*this,
-		motherBoard.getReactor().getGlobalSettings().getPowerSetting());
+		powerSetting);
+	powerSetting.attach(*this);
 
 	motherBoard.getMSXCliComm().update(CliComm::HARDWARE, name, "add");
 }
 
 HD::~HD()
 {
+	powerSetting.detach(*this);
+	syncImage();
 	motherBoard.getMSXCliComm().update(CliComm::HARDWARE, name, "remove");
 
 	unsigned id = name[2] - 'a';
@@ -84,9 +108,15 @@ HD::~HD()
 
 void HD::switchImage(const Filename& newFilename)
 {
-	file = File(newFilename);
+	File newFile(newFilename);
+	flushBlockCache();
+	dropBlockCache();
+	// overlay data belongs to the old image (overlay mode stays enabled)
+	discardOverlay();
+	file = std::move(newFile);
 	filename = newFilename;
 	filesize = file.getSize();
+	fileTime = file.getModificationDate();
 	tigerTree = make_unique<TigerTree>(*this, filesize,
 			filename.getResolved());
 	motherBoard.getMSXCliComm().update(CliComm::MEDIA, getName(),
@@ -100,16 +130,146 @@ size_t HD::getNbSectorsImpl() const
 
 void HD::readSectorImpl(size_t sector, SectorBuffer& buf)
 {
-	file.seek(sector * sizeof(buf));
-	file.read(&buf, sizeof(buf));
+	auto& cb = getBlock(sector / BLOCK_SECTORS, true);
+	buf = cb.data[sector % BLOCK_SECTORS];
 }
 
 void HD::writeSectorImpl(size_t sector, const SectorBuffer& buf)
 {
-	file.seek(sector * sizeof(buf));
-	file.write(&buf, sizeof(buf));
-	tigerTree->notifyChange(sector * sizeof(buf), sizeof(buf),
-	                        file.getModificationDate());
+	auto& cb = getBlock(sector / BLOCK_SECTORS, false);
+	unsigned i = sector % BLOCK_SECTORS;
+	cb.data[i] = buf;
+	cb.dirtyBegin = std::min(cb.dirtyBegin, i);
+	cb.dirtyEnd   = std::max(cb.dirtyEnd, i + 1);
+	// the image itself is only written when the block is written back
+	if (!isPendingRT()) {
+		scheduleRT(5000000); // write back after 5s
+	}
+	tigerTree->notifyChange(sector * sizeof(buf), sizeof(buf), fileTime);
+}
+
+HD::CacheBlock& HD::getBlock(size_t block, bool readAhead)
+{
+	++cacheUseCounter;
+	for (auto& cb : cache) {
+		if (cb.block == block) {
+			cb.lastUse = cacheUseCounter;
+			return cb;
+		}
+	}
+
+	size_t num = 1;
+	if (readAhead) {
+		if (block == (lastMissBlock + 1)) {
+			// sequential access, also fetch the next (not yet
+			// cached) blocks
+			size_t numBlocks = (getNbSectors() + BLOCK_SECTORS - 1) /
+			                   BLOCK_SECTORS;
+			auto isCached = [&](size_t b) {
+				return std::any_of(begin(cache), end(cache),
+					[&](const CacheBlock& cb) { return cb.block == b; });
+			};
+			while ((num < READ_AHEAD) && ((block + num) < numBlocks) &&
+			       !isCached(block + num)) {
+				++num;
+			}
+		}
+		lastMissBlock = block + num - 1;
+	}
+	loadBlocks(block, num);
+	auto it = std::find_if(begin(cache), end(cache),
+		[&](const CacheBlock& cb) { return cb.block == block; });
+	assert(it != end(cache));
+	return *it;
+}
+
+HD::CacheBlock& HD::allocBlock()
+{
+	// reuse the least recently used block
+	auto& cb = *std::min_element(begin(cache), end(cache),
+		[](const CacheBlock& a, const CacheBlock& b) {
+			return a.lastUse < b.lastUse; });
+	writeBack(cb);
+	cb.block = size_t(-1); // invalid till loaded
+	if (cb.data.empty()) cb.data.resize(BLOCK_SECTORS);
+	cb.lastUse = ++cacheUseCounter;
+	return cb;
+}
+
+// Read 'num' consecutive blocks from the image in a single file access.
+void HD::loadBlocks(size_t first, size_t num)
+{
+	size_t firstSector = first * BLOCK_SECTORS;
+	size_t numSectors = std::min(num * BLOCK_SECTORS,
+	                             getNbSectors() - firstSector);
+	MemBuffer<SectorBuffer> buf(numSectors);
+	file.seek(firstSector * sizeof(SectorBuffer));
+	file.read(buf.data(), numSectors * sizeof(SectorBuffer));
+
+	for (auto i : xrange(num)) {
+		auto& cb = allocBlock();
+		size_t offset = i * BLOCK_SECTORS;
+		size_t n = std::min(BLOCK_SECTORS, numSectors - offset);
+		memcpy(cb.data.data(), &buf[offset], n * sizeof(SectorBuffer));
+		cb.block = first + i;
+	}
+}
+
+void HD::writeBack(CacheBlock& cb)
+{
+	if (cb.dirtyBegin >= cb.dirtyEnd) return;
+	size_t sector = cb.block * BLOCK_SECTORS + cb.dirtyBegin;
+	size_t num = cb.dirtyEnd - cb.dirtyBegin;
+	file.seek(sector * sizeof(SectorBuffer));
+	file.write(&cb.data[cb.dirtyBegin], num * sizeof(SectorBuffer));
+	cb.dirtyBegin = BLOCK_SECTORS;
+	cb.dirtyEnd = 0;
+	// keep the tiger-tree cache in sync with the new timestamp
+	fileTime = file.getModificationDate();
+	tigerTree->notifyChange(sector * sizeof(SectorBuffer),
+	                        num * sizeof(SectorBuffer), fileTime);
+}
+
+void HD::flushBlockCache()
+{
+	for (auto& cb : cache) {
+		writeBack(cb);
+	}
+}
+
+// Write back all changes, report (instead of throw) errors.
+void HD::syncImage()
+{
+	try {
+		flushBlockCache();
+	} catch (MSXException& e) {
+		motherBoard.getMSXCliComm().printWarning(
+			"Couldn't write to harddisk image " +
+			filename.getResolved() + ": " + e.getMessage());
+	}
+}
+
+void HD::executeRT()
+{
+	syncImage();
+}
+
+void HD::update(const Setting& setting)
+{
+	assert(&setting == &powerSetting); (void)setting;
+	if (!powerSetting.getBoolean()) {
+		syncImage();
+	}
+}
+
+void HD::dropBlockCache()
+{
+	for (auto& cb : cache) {
+		assert(cb.dirtyBegin >= cb.dirtyEnd);
+		cb.block = size_t(-1);
+		cb.lastUse = 0;
+	}
+	lastMissBlock = size_t(-1);
 }
 
 bool HD::isWriteProtectedImpl() const
@@ -122,9 +282,16 @@ Sha1Sum HD::getSha1SumImpl(FilePool& filePool)
 	if (hasPatches()) {
 		return SectorAccessibleDisk::getSha1SumImpl(filePool);
 	}
+	flushBlockCache();
 	return filePool.getSha1Sum(file);
 }
 
+void HD::overlayChanged(size_t sector)
+{
+	tigerTree->notifyChange(sector * sizeof(SectorBuffer),
+	                        sizeof(SectorBuffer), fileTime);
+}
+
 void HD::showProgress(size_t position, size_t maxPosition)
 {
 	// only show progress iff:
@@ -146,6 +313,9 @@ void HD::showProgress(size_t position, size_t maxPosition)
 
 std::string HD::getTigerTreeHash()
 {
+	// Write back first: the timestamp of the image changes, and while
+	// calculating the hash the cache should not be modified.
+	flushBlockCache();
 	lastProgressTime = Timer::getTime();
 	everDidProgress = false;
 	auto callback = [this](size_t p, size_t t) { showProgress(p, t); };
@@ -175,9 +345,9 @@ uint8_t* HD::getData(size_t offset, size_t size)
 
 bool HD::isCacheStillValid(time_t& cacheTime)
 {
-	time_t fileTime = file.getModificationDate();
-	bool result = fileTime == cacheTime;
-	cacheTime = fileTime;
+	time_t modTime = file.getModificationDate();
+	bool result = modTime == cacheTime;
+	cacheTime = modTime;
 	return result;
 }
 
@@ -208,6 +378,7 @@ int HD::insertDisk(string_ref newDisk)
 
 // version 1: initial version
 // version 2: replaced 'checksum'(=sha1) with 'tthsum`
+// version 3: added overlay mode and overlay sectors
 template<typename Archive>
 void HD::serialize(Archive& ar, unsigned version)
 {
@@ -231,6 +402,8 @@ void HD::serialize(Archive& ar, unsigned version)
 			//  - So to get in the same state as the initial
 			//    savestate we again close the file. Otherwise the
 			//    checksum-check code below goes wrong.
+			flushBlockCache();
+			dropBlockCache();
 			file.close();
 		} else {
 			tmp.updateAfterLoadState();
@@ -239,6 +412,15 @@ void HD::serialize(Archive& ar, unsigned version)
 		}
 	}
 
+	// Restore the overlay before the checksum is verified (the checksum
+	// includes the overlay).
+	if (ar.versionAtLeast(version, 3)) {
+		bool withOverlay = hasOverlay();
+		ar.serialize("overlay", withOverlay);
+		if (ar.isLoader() && withOverlay) enableOverlay();
+		serializeOverlay(ar);
+	}
+
 	// store/check checksum
 	if (file.is_open()) {
 		bool mismatch = false;
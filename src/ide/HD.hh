@@ -6,19 +6,25 @@
 #include "SectorAccessibleDisk.hh"
 #include "DiskContainer.hh"
 #include "TigerTree.hh"
+#include "RTSchedulable.hh"
+#include "Observer.hh"
+#include "MemBuffer.hh"
 #include "serialize_meta.hh"
 #include <bitset>
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace openmsx {
 
 class MSXMotherBoard;
 class HDCommand;
 class DeviceConfig;
+class BooleanSetting;
+class Setting;
 
 class HD : public SectorAccessibleDisk, public DiskContainer
-         , public TTData
+         , public TTData, private RTSchedulable, private Observer<Setting>
 {
 public:
 	explicit HD(const DeviceConfig& config);
@@ -42,6 +48,7 @@ private:
 	size_t getNbSectorsImpl() const override;
 	bool isWriteProtectedImpl() const override;
 	Sha1Sum getSha1SumImpl(FilePool& filePool) override;
+	void overlayChanged(size_t sector) override;
 
 	// Diskcontainer:
 	SectorAccessibleDisk* getSectorAccessibleDisk() override;
@@ -53,9 +60,34 @@ private:
 	uint8_t* getData(size_t offset, size_t size) override;
 	bool isCacheStillValid(time_t& time) override;
 
+	// RTSchedulable
+	void executeRT() override;
+
+	// Observer<Setting>
+	void update(const Setting& setting) override;
+
 	void showProgress(size_t position, size_t maxPosition);
 
+	// Block cache: the image is read and written in blocks of several
+	// sectors. Sequential reads also fetch the following blocks, writes
+	// are collected in the cached blocks and written back later (at the
+	// latest a few seconds after the write, or on power off).
+	struct CacheBlock {
+		MemBuffer<SectorBuffer> data;
+		size_t block;     // block number, size_t(-1) if unused
+		unsigned lastUse;
+		unsigned dirtyBegin, dirtyEnd; // dirty sectors within this block
+	};
+	CacheBlock& getBlock(size_t block, bool readAhead);
+	CacheBlock& allocBlock();
+	void loadBlocks(size_t first, size_t num);
+	void writeBack(CacheBlock& cb);
+	void flushBlockCache();
+	void dropBlockCache();
+	void syncImage();
+
 	MSXMotherBoard& motherBoard;
+	BooleanSetting& powerSetting;
 	std::string name;
 	std::unique_ptr<HDCommand> hdCommand;
 	std::unique_ptr<TigerTree> tigerTree;
@@ -64,6 +96,11 @@ private:
 	Filename filename;
 	size_t filesize;
 
+	std::vector<CacheBlock> cache;
+	unsigned cacheUseCounter;
+	size_t lastMissBlock;
+	time_t fileTime; // modification time after our last write
+
 	static const unsigned MAX_HD = 26;
 	using HDInUse = std::bitset<MAX_HD>;
 	std::shared_ptr<HDInUse> hdInUse;
@@ -73,7 +110,7 @@ private:
 };
 
 REGISTER_BASE_CLASS(HD, "HD");
-SERIALIZE_CLASS_VERSION(HD, 2);
+SERIALIZE_CLASS_VERSION(HD, 3);
 
 } // namespace openmsx
 
@@ -3,6 +3,7 @@
 #include "FileContext.hh"
 #include "FileException.hh"
 #include "CommandException.hh"
+#include "MSXException.hh"
 #include "BooleanSetting.hh"
 #include "TclObject.hh"
 
@@ -31,11 +32,32 @@ void HDCommand::execute(array_ref<TclObject> tokens, TclObject& result,
 		result.addListElement(hd.getName() + ':');
 		result.addListElement(hd.getImageName().getResolved());
 
+		TclObject options;
+		if (hd.hasOverlay()) {
+			options.addListElement("overlay");
+		}
 		if (hd.isWriteProtected()) {
-			TclObject options;
 			options.addListElement("readonly");
+		}
+		if (options.getListLength(getInterpreter()) != 0) {
 			result.addListElement(options);
 		}
+	} else if ((tokens.size() == 2) && (tokens[1] == "overlay")) {
+		hd.enableOverlay();
+	} else if ((tokens.size() == 2) && (tokens[1] == "commit")) {
+		try {
+			hd.commitOverlay();
+		} catch (MSXException& e) {
+			throw CommandException("Can't commit overlay: " +
+			                       e.getMessage());
+		}
+	} else if ((tokens.size() == 2) && (tokens[1] == "discard")) {
+		if (powerSetting.getBoolean()) {
+			throw CommandException(
+				"Can only discard the overlay when MSX is "
+				"powered down.");
+		}
+		hd.discardOverlay();
 	} else if ((tokens.size() == 2) ||
 	           ((tokens.size() == 3) && tokens[1] == "insert")) {
 		if (powerSetting.getBoolean()) {
@@ -70,21 +92,30 @@ void HDCommand::execute(array_ref<TclObject> tokens, TclObject& result,
 
 string HDCommand::help(const vector<string>& /*tokens*/) const
 {
-	return hd.getName() + ": change the hard disk image for this hard disk drive\n";
+	const string& hdName = hd.getName();
+	return hdName + " insert <filename> : change the hard disk image for this hard disk drive\n" +
+	       hdName + " <filename>        : change the hard disk image for this hard disk drive\n" +
+	       hdName + " overlay           : from now on, don't write to the image but\n" +
+	       "                        keep the written sectors in memory\n" +
+	       hdName + " commit            : write the sectors in the overlay to the image\n" +
+	       hdName + " discard           : drop the sectors in the overlay\n" +
+	       hdName + "                   : show which hard disk image is used\n";
 }
 
 void HDCommand::tabCompletion(vector<string>& tokens) const
 {
 	vector<const char*> extra;
 	if (tokens.size() < 3) {
-		extra = { "insert" };
+		extra = { "insert", "overlay", "commit", "discard" };
 	}
 	completeFileName(tokens, userFileContext(), extra);
 }
 
 bool HDCommand::needRecord(array_ref<TclObject> tokens) const
 {
-	return tokens.size() > 1;
+	// committing doesn't change the emulated state (and it should not
+	// write to the image again during replay)
+	return (tokens.size() > 1) && (tokens[1] != "commit");
 }
 
 } // namespace openmsx
@@ -9,6 +9,7 @@ namespace openmsx {
 
 StateChangeDistributor::StateChangeDistributor()
 	: recorder(nullptr)
+	, lastEventTime(EmuTime::zero)
 	, viewOnlyMode(false)
 {
 }
@@ -70,6 +71,7 @@ void StateChangeDistributor::distribute(const EventPtr& event)
 	//   e.g. signalStateChange() -> .. -> PlugCmd::execute() -> .. ->
 	//        Connector::plug() -> .. -> Joystick::plugHelper() ->
 	//        registerListener()
+	lastEventTime = event->getTime();
 	if (recorder) recorder->signalStateChange(event);
 	auto copy = listeners;
 	for (auto& l : copy) {
@@ -67,12 +67,18 @@ public:
 
 	bool isReplaying() const;
 
+	/** The time of the most recent event (new or replayed), or
+	 * EmuTime::zero if there were no events yet.
+	 */
+	EmuTime::param getLastEventTime() const { return lastEventTime; }
+
 private:
 	bool isRegistered(StateChangeListener* listener) const;
 	void distribute(const EventPtr& event);
 
 	std::vector<StateChangeListener*> listeners; // unordered
 	StateChangeRecorder* recorder;
+	EmuTime lastEventTime;
 	bool viewOnlyMode;
 };
 
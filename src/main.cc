@@ -11,6 +11,7 @@
 #include "Display.hh"
 #include "EventDistributor.hh"
 #include "RenderSettings.hh"
+#include "StartupProfiler.hh"
 #include "EnumSetting.hh"
 #include "MSXException.hh"
 #include "StringOp.hh"
@@ -146,12 +147,16 @@ static int main(int argc, char **argv)
 				reactor.getEventDistributor().deliverEvents();
 			}
 			if (parseStatus != CommandLineParser::TEST) {
-				CliServer cliServer(reactor.getCommandController(),
+				CliServer cliServer(reactor,
+				                    reactor.getCommandController(),
 				                    reactor.getEventDistributor(),
 				                    reactor.getGlobalCliComm());
 				reactor.run(parser);
 			}
 		}
+		// Normally already done in Reactor::run(), but not e.g. for
+		// -testconfig.
+		StartupProfiler::finish();
 	} catch (FatalError& e) {
 		cerr << "Fatal error: " << e.getMessage() << endl;
 		err = 1;
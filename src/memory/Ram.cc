@@ -1,5 +1,6 @@
 #include "Ram.hh"
 #include "DeviceConfig.hh"
+#include "GlobalSettings.hh"
 #include "SimpleDebuggable.hh"
 #include "XMLElement.hh"
 #include "Base64.hh"
@@ -26,11 +27,16 @@ private:
 	Ram& ram;
 };
 
+// See PageWriteTracker.
+static bool trackWrites(const DeviceConfig& config)
+{
+	return config.getGlobalSettings().getRamWriteTrackingSetting().getBoolean();
+}
 
 Ram::Ram(const DeviceConfig& config, const string& name,
          const string& description, unsigned size_)
 	: xml(*config.getXML())
-	, ram(size_)
+	, ram(size_, trackWrites(config))
 	, size(size_)
 	, debuggable(make_unique<RamDebuggable>(
 		config.getMotherBoard(), name, description, *this))
@@ -40,7 +46,7 @@ Ram::Ram(const DeviceConfig& config, const string& name,
 
 Ram::Ram(const DeviceConfig& config, unsigned size_)
 	: xml(*config.getXML())
-	, ram(size_)
+	, ram(size_, trackWrites(config))
 	, size(size_)
 {
 	clear();
@@ -109,6 +115,7 @@ byte RamDebuggable::read(unsigned address)
 void RamDebuggable::write(unsigned address, byte value)
 {
 	ram[address] = value;
+	if (ram.debugWriteCallback) ram.debugWriteCallback(address);
 }
 
 
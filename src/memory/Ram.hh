@@ -1,8 +1,9 @@
 #ifndef RAM_HH
 #define RAM_HH
 
-#include "MemBuffer.hh"
+#include "PageWriteTracker.hh"
 #include "openmsx.hh"
+#include <functional>
 #include <string>
 #include <memory>
 
@@ -37,14 +38,25 @@ public:
 	const std::string& getName() const;
 	void clear(byte c = 0xff);
 
+	/** The given callback is called after a write via the debuggable
+	  * (e.g. the 'debug write' command). Those writes don't go via the
+	  * owner of this Ram object, so this is the only way it can notice
+	  * them. */
+	void setDebugWriteCallback(std::function<void(unsigned)> callback) {
+		debugWriteCallback = std::move(callback);
+	}
+
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version);
 
 private:
 	const XMLElement& xml;
-	MemBuffer<byte> ram;
+	WriteTrackedBuffer ram;
 	unsigned size; // must come before debuggable
 	const std::unique_ptr<RamDebuggable> debuggable; // can be nullptr
+	std::function<void(unsigned)> debugWriteCallback;
+
+	friend class RamDebuggable;
 };
 
 } // namespace openmsx
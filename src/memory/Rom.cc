@@ -13,13 +13,17 @@
 #include "Debuggable.hh"
 #include "CliComm.hh"
 #include "FilePool.hh"
+#include "FileOperations.hh"
+#include "GlobalSettings.hh"
 #include "ConfigException.hh"
 #include "EmptyPatch.hh"
 #include "IPSPatch.hh"
+#include "StartupProfiler.hh"
 #include "StringOp.hh"
 #include "sha1.hh"
 #include "memory.hh"
 #include <limits>
+#include <cstdio>
 #include <cstring>
 
 using std::string;
@@ -43,6 +47,56 @@ private:
 };
 
 
+// A (g)zipped ROM image is decompressed in private memory, so each openMSX
+// process has its own copy. With the 'shared_rom_cache' setting, a
+// decompressed copy is stored in the user data dir (named after its sha1sum)
+// and that copy is mmap'ed instead. Then all processes share the same pages.
+// Returns a closed file if the cache can't be used.
+static File openRomCache(File& file, const Sha1Sum& sha1, FilePool& filePool)
+{
+	string dir = FileOperations::getUserDataDir() + "/.romcache";
+	string filename = dir + '/' + sha1.toString();
+	// Don't trust the content of the cache file, it could e.g. be
+	// truncated after a full disk. Only look at the cache file itself,
+	// 'file' must not be decompressed when the cache is valid. The
+	// sha1sum of the cache file is normally taken from the filepool
+	// cache.
+	auto isValid = [&](File& cache) {
+		return (cache.getSize() != 0) &&
+		       (filePool.getSha1Sum(cache) == sha1);
+	};
+	try {
+		if (FileOperations::isRegularFile(filename)) {
+			File cache(filename, "rb");
+			if (isValid(cache)) return cache;
+			cache.close();
+			FileOperations::unlink(filename); // recreate
+		}
+
+		size_t size;
+		const byte* data = file.mmap(size);
+		FileOperations::mkdirp(dir);
+		// Write to a temporary file first, so that other processes
+		// never see a partially written file.
+		string tmpName;
+		auto tmp = FileOperations::openUniqueFile(dir, tmpName);
+		bool ok = tmp &&
+		          (fwrite(data, 1, size, tmp.get()) == size) &&
+		          (fclose(tmp.release()) == 0);
+		tmp.reset(); // close on error
+		if (!ok || (FileOperations::rename(tmpName, filename) != 0)) {
+			// rename() also fails (on windows) when another
+			// process already created the file
+			FileOperations::unlink(tmpName);
+		}
+		File cache(filename, "rb");
+		if (isValid(cache)) return cache;
+	} catch (FileException&) {
+		// ignore
+	}
+	return File(); // use the in-memory copy
+}
+
 Rom::Rom(string name_, string description_,
          const DeviceConfig& config, const string& id /*= {}*/)
 	: name(std::move(name_)), description(std::move(description_))
@@ -81,6 +135,8 @@ Rom::Rom(string name_, string description_,
 void Rom::init(MSXMotherBoard& motherBoard, const XMLElement& config,
                const FileContext& context)
 {
+	StartupProfiler::Phase profile("ROM loading");
+
 	// (Only) if the content of this ROM depends on state that is not part
 	// of a savestate, we want to compare the sha1sum of the ROM from the
 	// time the savestate was created with the one from the loaded
@@ -183,7 +239,15 @@ void Rom::init(MSXMotherBoard& motherBoard, const XMLElement& config,
 		}
 		try {
 			size_t size2;
-			rom = file.mmap(size2);
+			auto& globalSettings = motherBoard.getReactor().getGlobalSettings();
+			if (file.isCompressed() &&
+			    globalSettings.getSharedRomCacheSetting().getBoolean()) {
+				if (originalSha1.empty()) {
+					originalSha1 = filepool.getSha1Sum(file);
+				}
+				romCache = openRomCache(file, originalSha1, filepool);
+			}
+			rom = (romCache.is_open() ? romCache : file).mmap(size2);
 			if (size2 > std::numeric_limits<decltype(size)>::max()) {
 				throw MSXException("Rom file too big: " +
 				                   file.getURL());
@@ -212,6 +276,13 @@ void Rom::init(MSXMotherBoard& motherBoard, const XMLElement& config,
 		// We loaded an extrenal file, so check.
 		checkResolvedSha1 = true;
 
+		if (romCache.is_open()) {
+			// Drop the (private) decompressed copy, only the
+			// shared cache file remains mapped.
+			fileURL = file.getURL();
+			file.close();
+		}
+
 	} else {
 		// for an empty SCC the <size> tag is missing, so take 0
 		// for MegaFlashRomSCC the <size> tag is used to specify
@@ -270,7 +341,10 @@ void Rom::init(MSXMotherBoard& motherBoard, const XMLElement& config,
 			name = title.str();
 		} else {
 			// unknown ROM, use file name
-			name = file.getOriginalName();
+			name = file.is_open()
+			     ? file.getOriginalName()
+			     : FileOperations::stripExtension(
+			           FileOperations::getFilename(fileURL)).str();
 		}
 	}
 
@@ -294,7 +368,8 @@ void Rom::init(MSXMotherBoard& motherBoard, const XMLElement& config,
 		const auto& actualSha1Elem = mutableConfig.getCreateChild(
 			"resolvedSha1", patchedSha1Str);
 		if (actualSha1Elem.getData() != patchedSha1Str) {
-			string tmp = file.is_open() ? file.getURL() : name;
+			string tmp = file.is_open() ? file.getURL()
+			           : !fileURL.empty() ? fileURL : name;
 			// can only happen in case of loadstate
 			motherBoard.getMSXCliComm().printWarning(
 				"The content of the rom " + tmp + " has "
@@ -339,6 +414,8 @@ Rom::Rom(Rom&& r) noexcept
 	: rom          (std::move(r.rom))
 	, extendedRom  (std::move(r.extendedRom))
 	, file         (std::move(r.file))
+	, romCache     (std::move(r.romCache))
+	, fileURL      (std::move(r.fileURL))
 	, originalSha1 (std::move(r.originalSha1))
 	, name         (std::move(r.name))
 	, description  (std::move(r.description))
@@ -352,7 +429,7 @@ Rom::~Rom() = default;
 
 string Rom::getFilename() const
 {
-	return file.is_open() ? file.getURL() : string{};
+	return file.is_open() ? file.getURL() : fileURL;
 }
 
 const Sha1Sum& Rom::getOriginalSHA1() const
@@ -49,6 +49,8 @@ private:
 	MemBuffer<byte> extendedRom;
 
 	File file; // can be a closed file
+	File romCache; // decompressed copy of 'file', can be a closed file
+	std::string fileURL; // URL of 'file' after it's closed (for romCache)
 
 	mutable Sha1Sum originalSha1;
 	std::string name;
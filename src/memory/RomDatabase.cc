@@ -15,6 +15,7 @@
 #include "stl.hh"
 #include "xxhash.hh"
 #include <stdexcept>
+#include <cstring>
 
 using std::string;
 using std::vector;
@@ -563,13 +564,157 @@ static void parseDB(CliComm& cliComm, char* buf, char* bufStart,
 	}
 }
 
+// Layout of the precompiled index file (native byte order, it's only a
+// machine-local cache):
+//  - IndexHeader
+//  - the signature, padded to a multiple of 4 bytes
+//  - IndexEntry[numEntries], sorted on sha1sum
+//  - zero-terminated strings, 'stringsSize' bytes in total
+// The signature identifies the softwaredb.xml files (and their timestamps)
+// the index was generated from. When it doesn't match the index is rebuilt.
+static const char* const INDEX_FILE = "/.softwaredb.idx";
+static const char INDEX_MAGIC[8] = { 'o','M','S','X','S','D','B','1' };
+static const uint32_t INDEX_BYTE_ORDER = 0x01020304;
+
+struct IndexHeader {
+	char magic[8];
+	uint32_t byteOrder;
+	uint32_t signatureSize;
+	uint32_t numEntries;
+	uint32_t stringsSize;
+};
+struct RomDatabase::IndexEntry {
+	Sha1Sum sha1;
+	uint32_t title;
+	uint32_t year;
+	uint32_t company;
+	uint32_t country;
+	uint32_t origType;
+	uint32_t remark;
+	uint32_t romType;
+	int32_t genMSXid;
+	uint32_t original;
+};
+
+static size_t align4(size_t size)
+{
+	return (size + 3) & ~3;
+}
+
+bool RomDatabase::loadIndex(const string& filename, const string& signature)
+{
+	try {
+		indexFile = File(filename);
+		size_t size;
+		const byte* data = indexFile.mmap(size);
+		IndexHeader header;
+		if (size < sizeof(header)) return false;
+		memcpy(&header, data, sizeof(header));
+		if (memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) ||
+		    (header.byteOrder != INDEX_BYTE_ORDER) ||
+		    (header.signatureSize != signature.size())) {
+			return false;
+		}
+		size_t entriesStart = sizeof(header) + align4(header.signatureSize);
+		size_t stringsStart = entriesStart +
+			size_t(header.numEntries) * sizeof(IndexEntry);
+		if ((size < stringsStart) ||
+		    ((size - stringsStart) != header.stringsSize) ||
+		    (header.stringsSize == 0) ||
+		    memcmp(data + sizeof(header), signature.data(), signature.size())) {
+			return false;
+		}
+		indexEntries = reinterpret_cast<const IndexEntry*>(data + entriesStart);
+		numIndexEntries = header.numEntries;
+		indexStrings = reinterpret_cast<const char*>(data + stringsStart);
+		return true;
+	} catch (MSXException& /*e*/) {
+		return false;
+	}
+}
+
+void RomDatabase::writeIndex(const string& filename, const string& signature) const
+{
+	string strings(1, '\0'); // empty string at offset 0
+	hash_map<string_ref, uint32_t, XXHasher> offsets;
+	const char* bufStart = buffer.data();
+	auto addString = [&](string_ref str) -> uint32_t {
+		if (str.empty()) return 0;
+		auto it = offsets.find(str);
+		if (it != end(offsets)) return it->second;
+		auto offset = uint32_t(strings.size());
+		strings.append(str.data(), str.size());
+		strings += '\0';
+		offsets.emplace_noDuplicateCheck(str, offset);
+		return offset;
+	};
+
+	vector<IndexEntry> entries(db.size()); // value-initialized, also the padding
+	for (size_t i = 0; i < db.size(); ++i) {
+		auto& e = entries[i];
+		auto& info = db[i].second;
+		e.sha1     = db[i].first;
+		e.title    = addString(info.getTitle   (bufStart));
+		e.year     = addString(info.getYear    (bufStart));
+		e.company  = addString(info.getCompany (bufStart));
+		e.country  = addString(info.getCountry (bufStart));
+		e.origType = addString(info.getOrigType(bufStart));
+		e.remark   = addString(info.getRemark  (bufStart));
+		e.romType  = info.getRomType();
+		e.genMSXid = info.getGenMSXid();
+		e.original = info.getOriginal();
+	}
+
+	IndexHeader header = {};
+	memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header.byteOrder = INDEX_BYTE_ORDER;
+	header.signatureSize = uint32_t(signature.size());
+	header.numEntries = uint32_t(entries.size());
+	header.stringsSize = uint32_t(strings.size());
+	string paddedSignature = signature;
+	paddedSignature.resize(align4(signature.size()));
+
+	// Other openMSX processes may have the current index mmap'ed, so it
+	// must not be modified in place. Instead write a new file and rename
+	// it, those processes keep using the old (unlinked) file.
+	try {
+		FileOperations::mkdirp(FileOperations::getUserDataDir());
+		size_t entriesSize = entries.size() * sizeof(IndexEntry);
+		FileOperations::replaceFile(filename, [&](FILE* file) {
+			return (fwrite(&header, 1, sizeof(header), file) == sizeof(header)) &&
+			       (fwrite(paddedSignature.data(), 1, paddedSignature.size(), file) == paddedSignature.size()) &&
+			       (fwrite(entries.data(), 1, entriesSize, file) == entriesSize) &&
+			       (fwrite(strings.data(), 1, strings.size(), file) == strings.size());
+		});
+	} catch (MSXException& /*e*/) {
+		// ignore, we'll retry next time
+	}
+}
+
 RomDatabase::RomDatabase(GlobalCommandController& commandController, CliComm& cliComm)
-	: softwareInfoTopic(commandController.getOpenMSXInfoCommand())
+	: indexEntries(nullptr)
+	, numIndexEntries(0)
+	, indexStrings(nullptr)
+	, softwareInfoTopic(commandController.getOpenMSXInfoCommand())
 {
-	db.reserve(3500);
-	UnknownTypes unknownTypes;
 	// first user- then system-directory
 	vector<string> paths = systemFileContext().getPaths();
+	string signature;
+	for (auto& p : paths) {
+		string filename = FileOperations::join(p, "softwaredb.xml");
+		FileOperations::Stat st;
+		if (FileOperations::getStat(filename, st)) {
+			signature += filename + '|' +
+				StringOp::toString(st.st_size) + '|' +
+				StringOp::toString(FileOperations::getModificationDate(st)) + '\n';
+		}
+	}
+	string indexFilename = FileOperations::getUserDataDir() + INDEX_FILE;
+	if (loadIndex(indexFilename, signature)) return;
+	indexFile = File();
+
+	db.reserve(3500);
+	UnknownTypes unknownTypes;
 	vector<File> files;
 	size_t bufferSize = 0;
 	for (auto& p : paths) {
@@ -606,6 +751,8 @@ RomDatabase::RomDatabase(GlobalCommandController& commandController, CliComm& cl
 		cliComm.printWarning(
 			"Couldn't load software database.\n"
 			"This may cause incorrect ROM mapper types to be used.");
+	} else {
+		writeIndex(indexFilename, signature);
 	}
 	if (!unknownTypes.empty()) {
 		StringOp::Builder output;
@@ -619,6 +766,28 @@ RomDatabase::RomDatabase(GlobalCommandController& commandController, CliComm& cl
 
 const RomInfo* RomDatabase::fetchRomInfo(const Sha1Sum& sha1sum) const
 {
+	if (indexEntries) {
+		auto cached = indexLookups.find(sha1sum);
+		if (cached != end(indexLookups)) return &cached->second;
+
+		auto* last = indexEntries + numIndexEntries;
+		auto* e = std::lower_bound(indexEntries, last, sha1sum,
+			[](const IndexEntry& entry, const Sha1Sum& sum) {
+				return entry.sha1 < sum; });
+		if ((e == last) || (e->sha1 != sha1sum)) return nullptr;
+
+		auto str = [&](uint32_t offset) {
+			String32 result;
+			toString32(indexStrings, indexStrings + offset, result);
+			return result;
+		};
+		auto it = indexLookups.emplace(sha1sum, RomInfo(
+			str(e->title), str(e->year), str(e->company),
+			str(e->country), e->original != 0, str(e->origType),
+			str(e->remark), RomType(e->romType), e->genMSXid)).first;
+		return &it->second;
+	}
+
 	auto it = lower_bound(begin(db), end(db), sha1sum,
 	                      LessTupleElement<0>());
 	return ((it != end(db)) && (it->first == sha1sum))
@@ -650,7 +819,7 @@ void RomDatabase::SoftwareInfoTopic::execute(
 			"Software with sha1sum " + sha1sum.toString() + " not found");
 	}
 
-	const char* bufStart = romDatabase.buffer.data();
+	const char* bufStart = romDatabase.getBufferStart();
 	result.addListElement("title");
 	result.addListElement(romInfo->getTitle(bufStart));
 	result.addListElement("year");
@@ -4,7 +4,10 @@
 #include "RomInfo.hh"
 #include "MemBuffer.hh"
 #include "InfoTopic.hh"
+#include "File.hh"
 #include "sha1.hh"
+#include <map>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -25,12 +28,28 @@ public:
 	 */
 	const RomInfo* fetchRomInfo(const Sha1Sum& sha1sum) const;
 
-	const char* getBufferStart() const { return buffer.data(); }
+	const char* getBufferStart() const {
+		return indexStrings ? indexStrings : buffer.data();
+	}
 
 private:
+	struct IndexEntry;
+
+	bool loadIndex(const std::string& filename, const std::string& signature);
+	void writeIndex(const std::string& filename, const std::string& signature) const;
+
 	RomDB db;
 	MemBuffer<char> buffer;
 
+	// Precompiled (binary) index, used instead of 'db' when it's up-to-date
+	// with the softwaredb.xml files. Entries are only converted to RomInfo
+	// objects when they're looked up.
+	File indexFile;
+	const IndexEntry* indexEntries;
+	unsigned numIndexEntries;
+	const char* indexStrings;
+	mutable std::map<Sha1Sum, RomInfo> indexLookups;
+
 	struct SoftwareInfoTopic final : InfoTopic {
 		explicit SoftwareInfoTopic(InfoCommand& openMSXInfoCommand);
 		void execute(array_ref<TclObject> tokens,
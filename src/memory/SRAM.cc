@@ -4,18 +4,41 @@
 #include "FileContext.hh"
 #include "FileException.hh"
 #include "FileNotFoundException.hh"
+#include "FileOperations.hh"
 #include "Reactor.hh"
+#include "MSXMotherBoard.hh"
 #include "CliComm.hh"
 #include "serialize.hh"
 #include "openmsx.hh"
 #include "vla.hh"
 #include "memory.hh"
+#include "MemBuffer.hh"
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
 
 using std::string;
 
 namespace openmsx {
 
+// Granularity of the dirty tracking.
+static const unsigned BLOCK_SIZE = 4096;
+
+struct SRAM::SaveJob
+{
+	string name;     // as specified in the config
+	string filename; // resolved
+	string header;
+	unsigned size;   // size of the SRAM
+	bool full;       // write the whole file (otherwise only 'ranges')
+	std::vector<std::pair<unsigned, unsigned>> ranges; // offset, size
+	MemBuffer<byte> data; // content of all ranges, concatenated
+	string error;    // set by the save thread
+};
+
+// All existing SRAMs. Only accessed from the main thread.
+static std::vector<SRAM*> allSRAMs;
+
 // class SRAM
 
 /* Creates a SRAM that is not loaded from or saved to a file.
@@ -27,7 +50,10 @@ SRAM::SRAM(const std::string& name, const std::string& description,
 	: RTSchedulable(config_.getReactor().getRTScheduler())
 	, ram(config_, name, description, size)
 	, header(nullptr) // not used
+	, dirty((size + BLOCK_SIZE - 1) / BLOCK_SIZE, false)
+	, needFullSave(true)
 {
+	init();
 }
 
 SRAM::SRAM(const string& name, int size,
@@ -36,7 +62,10 @@ SRAM::SRAM(const string& name, int size,
 	, config(config_)
 	, ram(config, name, "sram", size)
 	, header(header_)
+	, dirty((size + BLOCK_SIZE - 1) / BLOCK_SIZE, false)
+	, needFullSave(true)
 {
+	init();
 	load(loaded);
 }
 
@@ -46,30 +75,51 @@ SRAM::SRAM(const string& name, const string& description, int size,
 	, config(config_)
 	, ram(config, name, description, size)
 	, header(header_)
+	, dirty((size + BLOCK_SIZE - 1) / BLOCK_SIZE, false)
+	, needFullSave(true)
 {
+	init();
 	load(loaded);
 }
 
 SRAM::~SRAM()
 {
 	save();
+	waitForSave();
+	allSRAMs.erase(std::find(begin(allSRAMs), end(allSRAMs), this));
 }
 
-void SRAM::write(unsigned addr, byte value)
+void SRAM::init()
+{
+	allSRAMs.push_back(this);
+	// Also save the changes made via the debugger.
+	ram.setDebugWriteCallback([this](unsigned addr) { changed(addr, 1); });
+}
+
+// Mark [addr, addr + size) as changed, to be written to disk.
+void SRAM::changed(unsigned addr, unsigned size)
 {
 	if (!isPendingRT()) {
 		scheduleRT(5000000); // sync to disk after 5s
 	}
+	assert((addr + size) <= getSize());
+	if (size == 0) return;
+	for (unsigned b = addr / BLOCK_SIZE; b <= (addr + size - 1) / BLOCK_SIZE; ++b) {
+		dirty[b] = true;
+	}
+}
+
+void SRAM::write(unsigned addr, byte value)
+{
 	assert(addr < getSize());
+	changed(addr, 1);
 	ram.write(addr, value);
 }
 
 void SRAM::memset(unsigned addr, byte c, unsigned size)
 {
-	if (!isPendingRT()) {
-		scheduleRT(5000000); // sync to disk after 5s
-	}
-	assert((addr + size) <= getSize());
+	changed(addr, size);
+	if (size == 0) return;
 	::memset(ram.getWriteBackdoor() + addr, c, size);
 }
 
@@ -93,6 +143,9 @@ void SRAM::load(bool* loaded)
 		if (headerOk) {
 			file.read(ram.getWriteBackdoor(), getSize());
 			loadedFilename = file.getURL();
+			// the file on disk matches, later only write the changes
+			// (unless it has extra data at the end)
+			needFullSave = file.getSize() != file.getPos();
 			if (loaded) *loaded = true;
 		} else {
 			config.getCliComm().printWarning(
@@ -109,22 +162,128 @@ void SRAM::load(bool* loaded)
 	}
 }
 
+// Start writing the changes to disk (in a background thread).
 void SRAM::save()
 {
 	if (!config.getXML()) return;
-	const string& filename = config.getChildData("sramname");
+	waitForSave();
+	if (!needFullSave &&
+	    std::none_of(begin(dirty), end(dirty), [](bool d) { return d; })) {
+		return; // nothing changed
+	}
+
+	auto job = make_unique<SaveJob>();
+	job->name = config.getChildData("sramname");
 	try {
-		File file(config.getFileContext().resolveCreate(filename),
-			  File::SAVE_PERSISTENT);
-		if (header) {
-			int length = int(strlen(header));
-			file.write(header, length);
-		}
-		file.write(&ram[0], getSize());
+		job->filename = config.getFileContext().resolveCreate(job->name);
 	} catch (FileException& e) {
 		config.getCliComm().printWarning(
-			"Couldn't save SRAM " + filename +
+			"Couldn't save SRAM " + job->name +
 			" (" + e.getMessage() + ").");
+		return;
+	}
+	if (header) job->header = header;
+	job->size = getSize();
+
+	// Only update the changed parts when the file on disk is as expected,
+	// e.g. it could have been removed or replaced in the mean time.
+	FileOperations::Stat st;
+	job->full = needFullSave ||
+	            !FileOperations::getStat(job->filename, st) ||
+	            (size_t(st.st_size) != (job->header.size() + job->size));
+	if (job->full) {
+		job->ranges.emplace_back(0, getSize());
+	} else {
+		// merge consecutive dirty blocks
+		for (unsigned b = 0; b < dirty.size(); ++b) {
+			if (!dirty[b]) continue;
+			unsigned offset = b * BLOCK_SIZE;
+			unsigned size = std::min(BLOCK_SIZE, getSize() - offset);
+			if (!job->ranges.empty() &&
+			    ((job->ranges.back().first + job->ranges.back().second) == offset)) {
+				job->ranges.back().second += size;
+			} else {
+				job->ranges.emplace_back(offset, size);
+			}
+		}
+		if (job->ranges.empty()) return; // nothing changed
+	}
+
+	// Copy the data, so that emulation can continue while it's written.
+	size_t total = 0;
+	for (auto& r : job->ranges) total += r.second;
+	job->data.resize(total);
+	byte* dst = job->data.data();
+	for (auto& r : job->ranges) {
+		memcpy(dst, &ram[r.first], r.second);
+		dst += r.second;
+	}
+	dirty.assign(dirty.size(), false);
+	needFullSave = false;
+
+	saveJob = std::move(job);
+	auto* j = saveJob.get();
+	saveThread = std::thread([j]() { writeFile(*j); });
+}
+
+// Wait till the previous save (if any) is finished.
+void SRAM::waitForSave()
+{
+	if (!saveThread.joinable()) return;
+	saveThread.join();
+	if (!saveJob->error.empty()) {
+		config.getCliComm().printWarning(
+			"Couldn't save SRAM " + saveJob->name +
+			" (" + saveJob->error + ").");
+		// we don't know what's on disk now, next time write all
+		needFullSave = true;
+	}
+	saveJob.reset();
+}
+
+void SRAM::waitForPendingSaves()
+{
+	for (auto* sram : allSRAMs) {
+		sram->waitForSave();
+	}
+}
+
+bool SRAM::hasPersistentSRAM(MSXMotherBoard& board)
+{
+	return std::any_of(begin(allSRAMs), end(allSRAMs), [&](SRAM* sram) {
+		return sram->config.getXML() &&
+		       (&sram->config.getMotherBoard() == &board);
+	});
+}
+
+// Executed in the save thread.
+void SRAM::writeFile(SaveJob& job)
+{
+	try {
+		size_t headerSize = job.header.size();
+		if (job.full) {
+			// Write to a new file and then replace the old one, so
+			// that the old content is kept when writing fails.
+			string dir = FileOperations::getBaseName(job.filename).str();
+			if (!dir.empty()) FileOperations::mkdirp(dir);
+			FileOperations::replaceFile(job.filename, [&](FILE* file) {
+				return (fwrite(job.header.data(), 1, headerSize, file) == headerSize) &&
+				       (fwrite(job.data.data(), 1, job.size, file) == job.size);
+			});
+		} else {
+			// Update the changed parts of the existing file (save()
+			// already checked its size).
+			File file(job.filename);
+			const byte* src = job.data.data();
+			for (auto& r : job.ranges) {
+				file.seek(headerSize + r.first);
+				file.write(src, r.second);
+				src += r.second;
+			}
+			file.flush();
+		}
+	} catch (MSXException& e) {
+		job.error = e.getMessage();
 	}
 }
 
@@ -137,6 +296,10 @@ template<typename Archive>
 void SRAM::serialize(Archive& ar, unsigned /*version*/)
 {
 	ar.serialize("ram", ram);
+	if (ar.isLoader()) {
+		// content may have changed completely
+		dirty.assign(dirty.size(), true);
+	}
 }
 INSTANTIATE_SERIALIZE_METHODS(SRAM);
 
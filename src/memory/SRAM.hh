@@ -4,9 +4,15 @@
 #include "TrackedRam.hh"
 #include "DeviceConfig.hh"
 #include "RTSchedulable.hh"
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace openmsx {
 
+class MSXMotherBoard;
+
 class SRAM final : private RTSchedulable
 {
 public:
@@ -38,18 +44,41 @@ public:
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version);
 
+	/** Wait till the background saves of all SRAMs are finished. Must be
+	  * called right before fork(), the save threads don't exist in the
+	  * child process.
+	  */
+	static void waitForPendingSaves();
+
+	/** Does the given board contain a SRAM that is loaded from and saved
+	  * to a file?
+	  */
+	static bool hasPersistentSRAM(MSXMotherBoard& board);
+
 private:
 	// RTSchedulable
 	void executeRT() override;
 
+	struct SaveJob;
+	void init();
+	void changed(unsigned addr, unsigned size);
 	void load(bool* loaded);
 	void save();
+	void waitForSave();
+	static void writeFile(SaveJob& job);
 
 	const DeviceConfig config;
 	TrackedRam ram;
 	const char* const header;
 
 	std::string loadedFilename;
+
+	// The file is saved in a background thread. Only the blocks that
+	// changed since the previous save are written.
+	std::vector<bool> dirty;
+	bool needFullSave; // file on disk is missing or in an unknown state
+	std::unique_ptr<SaveJob> saveJob;
+	std::thread saveThread;
 };
 
 } // namespace openmsx
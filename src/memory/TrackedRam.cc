@@ -1,17 +1,52 @@
 #include "TrackedRam.hh"
 #include "serialize.hh"
+#include <algorithm>
 
 namespace openmsx {
 
+TrackedRam::TrackedRam(const DeviceConfig& config, const std::string& name,
+                       const std::string& description, unsigned size)
+	: ram(config, name, description, size)
+{
+	init();
+}
+
+TrackedRam::TrackedRam(const DeviceConfig& config, unsigned size)
+	: ram(config, size)
+{
+	init();
+}
+
+void TrackedRam::init()
+{
+	unsigned pageSize = 1 << PageWriteTracker::SOFT_PAGE_BITS;
+	dirtyPages.assign((getSize() + pageSize - 1) / pageSize, 1);
+	PageWriteTracker::registerMemory(&ram[0], getSize(), dirtyPages.data());
+	ram.setDebugWriteCallback([this](unsigned addr) {
+		writeSinceLastReverseSnapshot = true;
+		dirtyPages[addr >> PageWriteTracker::SOFT_PAGE_BITS] = 1;
+		if (debugWriteCallback) debugWriteCallback(addr);
+	});
+}
+
+TrackedRam::~TrackedRam()
+{
+	PageWriteTracker::unregisterMemory(&ram[0]);
+}
+
+void TrackedRam::markAllWritten()
+{
+	writeSinceLastReverseSnapshot = true;
+	std::fill(dirtyPages.begin(), dirtyPages.end(), 1);
+}
+
 template<typename Archive>
 void TrackedRam::serialize(Archive& ar, unsigned /*version*/)
 {
 	// Note: This is the exact same serialization format as the Ram class.
 	//  This allows to change from Ram to TrackedRam without having to
 	//  increase the class serialization version (of the user).
-	bool diff = writeSinceLastReverseSnapshot || !ar.isReverseSnapshot();
-	ar.serialize_blob("ram", &ram[0], getSize(), diff);
-	if (ar.isReverseSnapshot()) writeSinceLastReverseSnapshot = false;
+	serializeBlob(ar, "ram", getSize());
 }
 INSTANTIATE_SERIALIZE_METHODS(TrackedRam);
 
@@ -2,20 +2,22 @@
 #define TRACKED_RAM_HH
 
 #include "Ram.hh"
+#include "PageWriteTracker.hh"
+#include <vector>
 
 namespace openmsx {
 
-// Ram with dirty tracking
+// Ram with dirty tracking. Besides a flag for the whole ram, the written
+// pages are tracked, so that reverse snapshots only have to compare those
+// (see PageWriteTracker).
 class TrackedRam
 {
 public:
 	// Most methods simply delegate to the internal 'ram' object.
 	TrackedRam(const DeviceConfig& config, const std::string& name,
-	           const std::string& description, unsigned size)
-		: ram(config, name, description, size) {}
-
-	TrackedRam(const DeviceConfig& config, unsigned size)
-		: ram(config, size) {}
+	           const std::string& description, unsigned size);
+	TrackedRam(const DeviceConfig& config, unsigned size);
+	~TrackedRam();
 
 	unsigned getSize() const {
 		return ram.getSize();
@@ -37,11 +39,12 @@ public:
 	// Only allow write/clear via an explicit method.
 	void write(unsigned addr, byte value) {
 		writeSinceLastReverseSnapshot = true;
+		dirtyPages[addr >> PageWriteTracker::SOFT_PAGE_BITS] = 1;
 		ram[addr] = value;
 	}
 
 	void clear(byte c = 0xff) {
-		writeSinceLastReverseSnapshot = true;
+		markAllWritten();
 		ram.clear(c);
 	}
 
@@ -50,15 +53,36 @@ public:
 	// invocation, so the resulting pointer (although the same each time)
 	// should not be reused for multiple (distinct) bulk write operations.
 	byte* getWriteBackdoor() {
-		writeSinceLastReverseSnapshot = true;
+		markAllWritten();
 		return &ram[0];
 	}
 
+	// See Ram::setDebugWriteCallback(). The written page is always
+	// marked as dirty, also without callback.
+	void setDebugWriteCallback(std::function<void(unsigned)> callback) {
+		debugWriteCallback = std::move(callback);
+	}
+
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version);
 
+	// Serialize the first 'size' bytes as a single blob. This is the same
+	// format as ar.serialize_blob(tag, ptr, size).
+	template<typename Archive>
+	void serializeBlob(Archive& ar, const char* tag, unsigned size) {
+		bool diff = writeSinceLastReverseSnapshot || !ar.isReverseSnapshot();
+		if (ar.isLoader()) markAllWritten();
+		ar.serialize_blob(tag, &ram[0], size, diff);
+		if (ar.isReverseSnapshot()) writeSinceLastReverseSnapshot = false;
+	}
+
 private:
+	void init();
+	void markAllWritten();
+
 	Ram ram;
+	std::vector<uint8_t> dirtyPages;
+	std::function<void(unsigned)> debugWriteCallback;
 	bool writeSinceLastReverseSnapshot = true;
 };
 
@@ -2,16 +2,21 @@
 #include "Base64.hh"
 #include "HexDump.hh"
 #include "XMLLoader.hh"
+#include "rapidsax.hh"
 #include "XMLElement.hh"
-#include "ConfigException.hh"
 #include "XMLException.hh"
 #include "DeltaBlock.hh"
+#include "PageWriteTracker.hh"
+#include "FileException.hh"
 #include "MemBuffer.hh"
 #include "StringOp.hh"
 #include "FileOperations.hh"
 #include "Version.hh"
 #include "Date.hh"
+#include "xrange.hh"
+#include "snappy.hh"
 #include "cstdiop.hh" // for dup()
+#include <algorithm>
 #include <cstring>
 #include <limits>
 
@@ -26,6 +31,7 @@ void ArchiveBase<Derived>::attribute(const char* name, const char* value)
 	self().attribute(name, valueStr);
 }
 template class ArchiveBase<MemOutputArchive>;
+template class ArchiveBase<BinOutputArchive>;
 template class ArchiveBase<XmlOutputArchive>;
 
 ////
@@ -79,23 +85,41 @@ void OutputArchiveBase<Derived>::serialize_blob(
 {
 	auto* data = static_cast<const uint8_t*>(data_);
 
+	// Possibly store the difference with the corresponding blob in the
+	// previous group (see BlobDeltas).
+	bool grouped = blobDeltas.isEnabled();
+	unsigned index = 0;
+	std::vector<uint8_t> delta;
+	if (grouped) {
+		index = blobDeltas.nextIndex();
+		if (auto* base = blobDeltas.getBase(index, len)) {
+			delta = calcDelta(base, data, len);
+		}
+		blobDeltas.store(index, data, len);
+	}
+	bool useDelta = grouped && !delta.empty() && (delta.size() < len);
+
 	string encoding;
 	string tmp;
 	if (false) {
 		// useful for debugging
 		encoding = "hex";
 		tmp = HexDump::encode(data, len);
+		useDelta = false;
 	} else if (false) {
 		encoding = "base64";
 		tmp = Base64::encode(data, len);
+		useDelta = false;
 	} else {
-		encoding = "gz-base64";
+		encoding = useDelta ? "delta-gz-base64" : "gz-base64";
+		const uint8_t* src = useDelta ? delta.data() : data;
+		size_t srcLen = useDelta ? delta.size() : len;
 		// TODO check for overflow?
-		auto dstLen = uLongf(len + len / 1000 + 12 + 1); // worst-case
+		auto dstLen = uLongf(srcLen + srcLen / 1000 + 12 + 1); // worst-case
 		MemBuffer<byte> buf(dstLen);
 		if (compress2(buf.data(), &dstLen,
-		              reinterpret_cast<const Bytef*>(data),
-		              uLong(len), 9)
+		              reinterpret_cast<const Bytef*>(src),
+		              uLong(srcLen), 9)
 		    != Z_OK) {
 			throw MSXException("Error while compressing blob.");
 		}
@@ -103,12 +127,20 @@ void OutputArchiveBase<Derived>::serialize_blob(
 	}
 	this->self().beginTag(tag);
 	this->self().attribute("encoding", encoding);
+	if (grouped) {
+		this->self().attribute("index", index);
+	}
+	if (useDelta) {
+		auto deltaSize = unsigned(delta.size());
+		this->self().attribute("delta_size", deltaSize);
+	}
 	Saver<string> saver;
 	saver(this->self(), tmp, false);
 	this->self().endTag(tag);
 }
 
 template class OutputArchiveBase<MemOutputArchive>;
+template class OutputArchiveBase<BinOutputArchive>;
 template class OutputArchiveBase<XmlOutputArchive>;
 
 ////
@@ -140,11 +172,40 @@ void InputArchiveBase<Derived>::serialize_blob(
 	this->self().beginTag(tag);
 	string encoding;
 	this->self().attribute("encoding", encoding);
+	bool grouped = blobDeltas.isEnabled();
+	unsigned index = 0;
+	if (grouped) {
+		this->self().attribute("index", index);
+	}
+	unsigned deltaSize = 0;
+	bool useDelta = encoding == "delta-gz-base64";
+	if (useDelta) {
+		this->self().attribute("delta_size", deltaSize);
+	}
 
 	string_ref tmp = this->self().loadStr();
 	this->self().endTag(tag);
 
-	if (encoding == "gz-base64") {
+	if (useDelta) {
+		auto* base = grouped ? blobDeltas.getBase(index, len) : nullptr;
+		if (!base) {
+			throw MSXException("Missing base for delta encoded blob.");
+		}
+		auto p = Base64::decode(tmp);
+		MemBuffer<uint8_t> delta(deltaSize);
+		auto dstLen = uLongf(deltaSize);
+		if ((uncompress(reinterpret_cast<Bytef*>(delta.data()), &dstLen,
+		                reinterpret_cast<const Bytef*>(p.first.data()), uLong(p.second))
+		     != Z_OK) ||
+		    (dstLen != deltaSize)) {
+			throw MSXException("Error while decompressing blob.");
+		}
+		memcpy(data, base, len);
+		if (!applyDelta(static_cast<uint8_t*>(data), len,
+		                delta.data(), deltaSize)) {
+			throw MSXException("Error while applying blob delta.");
+		}
+	} else if (encoding == "gz-base64") {
 		auto p = Base64::decode(tmp);
 		auto dstLen = uLongf(len); // TODO check for overflow?
 		if ((uncompress(reinterpret_cast<Bytef*>(data), &dstLen,
@@ -165,13 +226,30 @@ void InputArchiveBase<Derived>::serialize_blob(
 	} else {
 		throw XMLException("Unsupported encoding \"" + encoding + "\" for blob");
 	}
+	if (grouped) {
+		blobDeltas.store(index, data, len);
+	}
 }
 
 template class InputArchiveBase<MemInputArchive>;
+template class InputArchiveBase<BinInputArchive>;
 template class InputArchiveBase<XmlInputArchive>;
 
 ////
 
+MemOutputArchive::MemOutputArchive(
+		LastDeltaBlocks& lastDeltaBlocks_,
+		std::vector<std::shared_ptr<DeltaBlock>>& deltaBlocks_,
+		bool reverseSnapshot_)
+	: lastDeltaBlocks(lastDeltaBlocks_)
+	, deltaBlocks(deltaBlocks_)
+	, reverseSnapshot(reverseSnapshot_)
+{
+	// Only pages written after this point can differ from the blocks
+	// stored in this snapshot.
+	PageWriteTracker::newEpoch();
+}
+
 void MemOutputArchive::save(const std::string& s)
 {
 	auto size = s.size();
@@ -254,6 +332,296 @@ void MemInputArchive::serialize_blob(const char*, void* data, size_t len, bool /
 
 ////
 
+// Layout of a binary archive file (all values in native byte order):
+//   header:  magic, format version, byte order mark, sizeof(size_t)
+//            and the number of blobs
+//   index:   for each blob its file offset, raw size, stored size and
+//            checksum
+//   data:    the blobs themselves
+// The first blob is the main stream, the other blobs are referenced from
+// the main stream by their index.
+static const char BIN_MAGIC[8] = { 'o','M','S','X','B','I','N','S' };
+static const uint32_t BIN_FORMAT_VERSION = 1;
+static const uint32_t BIN_BYTE_ORDER = 0x01020304;
+
+namespace {
+struct BinHeader {
+	char magic[8];
+	uint32_t formatVersion;
+	uint32_t byteOrder;
+	uint32_t sizeofSizeT;
+	uint32_t numBlobs;
+};
+struct BinIndexEntry {
+	uint64_t offset;
+	uint64_t rawSize;
+	uint64_t size;
+	uint64_t checksum;
+};
+}
+
+BinOutputArchive::BinOutputArchive(const string& filename_)
+	: filename(filename_)
+	, blobs(1) // placeholder for the main stream
+{
+}
+
+void BinOutputArchive::save(const std::string& s)
+{
+	auto size = s.size();
+	byte* buf = buffer.allocate(sizeof(size) + size);
+	memcpy(buf, &size, sizeof(size));
+	memcpy(buf + sizeof(size), s.data(), size);
+}
+
+void BinOutputArchive::addBlob(Blob& blob, const byte* data, size_t len)
+{
+	// Snappy is much faster than zlib (both compression and
+	// decompression), that's more important here than the compression
+	// ratio. Incompressible data is stored as-is.
+	size_t dstLen = snappy::maxCompressedLength(len);
+	blob.data.resize(dstLen);
+	snappy::compress(reinterpret_cast<const char*>(data), len,
+	                 reinterpret_cast<char*>(blob.data.data()), dstLen);
+	if (dstLen >= len) {
+		memcpy(blob.data.data(), data, len);
+		dstLen = len;
+	}
+	blob.rawSize = len;
+	blob.size = dstLen;
+	blob.checksum = adler32(adler32(0, nullptr, 0), blob.data.data(), uInt(dstLen));
+}
+
+void BinOutputArchive::serialize_blob(const char*, const void* data, size_t len,
+                                      bool /*diff*/)
+{
+	if (len > SMALL_SIZE) {
+		unsigned blobIdx = unsigned(blobs.size());
+		save(blobIdx);
+		blobs.emplace_back();
+		if (blobDeltas.isEnabled()) {
+			// see BlobDeltas
+			unsigned index = blobDeltas.nextIndex();
+			std::vector<uint8_t> delta;
+			if (auto* base = blobDeltas.getBase(index, len)) {
+				delta = calcDelta(base, static_cast<const uint8_t*>(data), len);
+			}
+			blobDeltas.store(index, data, len);
+			bool useDelta = !delta.empty() && (delta.size() < len);
+			save(index);
+			save(useDelta);
+			if (useDelta) {
+				addBlob(blobs.back(), delta.data(), delta.size());
+				return;
+			}
+		}
+		addBlob(blobs.back(), static_cast<const byte*>(data), len);
+	} else {
+		put(data, len);
+	}
+}
+
+void BinOutputArchive::close()
+{
+	assert(openSections.empty());
+	size_t size;
+	auto stream = buffer.release(size);
+	addBlob(blobs.front(), stream.data(), size);
+
+	BinHeader header;
+	memcpy(header.magic, BIN_MAGIC, sizeof(BIN_MAGIC));
+	header.formatVersion = BIN_FORMAT_VERSION;
+	header.byteOrder = BIN_BYTE_ORDER;
+	header.sizeofSizeT = sizeof(size_t);
+	header.numBlobs = uint32_t(blobs.size());
+
+	std::vector<BinIndexEntry> index(blobs.size());
+	uint64_t offset = sizeof(header) + index.size() * sizeof(BinIndexEntry);
+	for (size_t i = 0; i < blobs.size(); ++i) {
+		index[i].offset   = offset;
+		index[i].rawSize  = blobs[i].rawSize;
+		index[i].size     = blobs[i].size;
+		index[i].checksum = blobs[i].checksum;
+		offset += blobs[i].size;
+	}
+
+	// Write to a new file and then replace the old one, so that an
+	// existing file is kept when writing fails.
+	size_t indexSize = index.size() * sizeof(BinIndexEntry);
+	FileOperations::replaceFile(filename, [&](FILE* file) {
+		bool ok = (fwrite(&header, 1, sizeof(header), file) == sizeof(header)) &&
+		          (fwrite(index.data(), 1, indexSize, file) == indexSize);
+		for (auto& b : blobs) {
+			ok = ok && (fwrite(b.data.data(), 1, b.size, file) == b.size);
+		}
+		return ok;
+	});
+}
+
+////
+
+BinInputArchive::BinInputArchive(const string& filename)
+	: file(filename, "rb")
+{
+	size_t fileSize;
+	const byte* data = file.mmap(fileSize);
+
+	BinHeader header;
+	if (fileSize < sizeof(header)) {
+		throw MSXException("Not a binary savestate: file too short");
+	}
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, BIN_MAGIC, sizeof(BIN_MAGIC)) != 0) {
+		throw MSXException("Not a binary savestate");
+	}
+	if (header.formatVersion > BIN_FORMAT_VERSION) {
+		throw MSXException(StringOp::Builder() <<
+			"your openMSX installation is too old (binary format "
+			"version " << header.formatVersion << ", while this "
+			"openMSX installation only supports up to version " <<
+			BIN_FORMAT_VERSION << ").");
+	}
+	if ((header.byteOrder != BIN_BYTE_ORDER) ||
+	    (header.sizeofSizeT != sizeof(size_t))) {
+		throw MSXException(
+			"Binary savestate was created on an incompatible "
+			"platform (use the XML format to transfer savestates "
+			"between platforms).");
+	}
+	if ((header.numBlobs == 0) ||
+	    (header.numBlobs > ((fileSize - sizeof(header)) /
+	                        sizeof(BinIndexEntry)))) {
+		throw MSXException("Corrupt savestate: invalid index");
+	}
+
+	blobs.resize(header.numBlobs);
+	const byte* indexData = data + sizeof(header);
+	for (auto& b : blobs) {
+		BinIndexEntry entry;
+		memcpy(&entry, indexData, sizeof(entry));
+		indexData += sizeof(entry);
+		if ((entry.offset > fileSize) ||
+		    (entry.size > (fileSize - entry.offset)) ||
+		    (entry.size > entry.rawSize)) {
+			throw MSXException("Corrupt savestate: invalid index");
+		}
+		b.data     = data + entry.offset;
+		b.rawSize  = size_t(entry.rawSize);
+		b.size     = size_t(entry.size);
+		b.checksum = uint32_t(entry.checksum);
+	}
+
+	auto& main = blobs.front();
+	stream.resize(main.rawSize);
+	uncompressBlob(main, stream.data());
+	streamPos = stream.data();
+	streamEnd = streamPos + main.rawSize;
+}
+
+bool BinInputArchive::isBinaryArchive(const string& filename)
+{
+	try {
+		File file(filename, "rb");
+		char magic[sizeof(BIN_MAGIC)];
+		if (file.getSize() < sizeof(magic)) return false;
+		file.read(magic, sizeof(magic));
+		return memcmp(magic, BIN_MAGIC, sizeof(magic)) == 0;
+	} catch (FileException&) {
+		return false;
+	}
+}
+
+void BinInputArchive::truncatedError()
+{
+	throw MSXException("Corrupt savestate: unexpected end of data");
+}
+
+void BinInputArchive::uncompressBlob(const Blob& blob, byte* output) const
+{
+	// The snappy decompressor doesn't validate its input, so check the
+	// stored data before feeding it to the decompressor.
+	if (adler32(adler32(0, nullptr, 0), blob.data, uInt(blob.size)) !=
+	    blob.checksum) {
+		throw MSXException("Corrupt savestate: checksum mismatch");
+	}
+	if (blob.size == blob.rawSize) {
+		memcpy(output, blob.data, blob.size);
+	} else {
+		snappy::uncompress(reinterpret_cast<const char*>(blob.data),
+		                   blob.size,
+		                   reinterpret_cast<char*>(output), blob.rawSize);
+	}
+}
+
+void BinInputArchive::load(std::string& s)
+{
+	size_t length;
+	load(length);
+	// check before allocating, the length can be garbage
+	if (unlikely(length > size_t(streamEnd - streamPos))) truncatedError();
+	s.resize(length);
+	if (length) {
+		get(&s[0], length);
+	}
+}
+
+string_ref BinInputArchive::loadStr()
+{
+	size_t length;
+	load(length);
+	const byte* p = streamPos;
+	skipBytes(length);
+	return string_ref(reinterpret_cast<const char*>(p), length);
+}
+
+void BinInputArchive::serialize_blob(const char*, void* data, size_t len,
+                                     bool /*diff*/)
+{
+	if (len > SMALL_SIZE) {
+		// Like in MemInputArchive, the index is needed because blobs
+		// in skipped sections are stored but not loaded.
+		unsigned blobIdx; load(blobIdx);
+		if ((blobIdx == 0) || (blobIdx >= blobs.size())) {
+			throw MSXException("Corrupt savestate: invalid blob");
+		}
+		const auto& blob = blobs[blobIdx];
+		// see BlobDeltas
+		bool grouped = blobDeltas.isEnabled();
+		unsigned index = 0;
+		bool useDelta = false;
+		if (grouped) {
+			load(index);
+			load(useDelta);
+		}
+		if (useDelta) {
+			auto* base = blobDeltas.getBase(index, len);
+			if (!base) {
+				throw MSXException("Corrupt savestate: "
+					"missing base for delta encoded blob");
+			}
+			MemBuffer<uint8_t> delta(blob.rawSize);
+			uncompressBlob(blob, delta.data());
+			memcpy(data, base, len);
+			if (!applyDelta(static_cast<uint8_t*>(data), len,
+			                delta.data(), blob.rawSize)) {
+				throw MSXException("Corrupt savestate: invalid blob delta");
+			}
+		} else {
+			if (blob.rawSize != len) {
+				throw MSXException("Corrupt savestate: invalid blob");
+			}
+			uncompressBlob(blob, static_cast<byte*>(data));
+		}
+		if (grouped) {
+			blobDeltas.store(index, data, len);
+		}
+	} else {
+		get(data, len);
+	}
+}
+
+////
+
 XmlOutputArchive::XmlOutputArchive(const string& filename)
 	: root("serial")
 {
@@ -363,18 +731,273 @@ void XmlOutputArchive::endTag(const char* tag)
 
 ////
 
-XmlInputArchive::XmlInputArchive(const string& filename)
-	: rootElem(XMLLoader::load(filename, "openmsx-serialize.dtd"))
+// Text is parsed without entity translation (that would modify the XML text,
+// but some parts of the text are parsed multiple times). Instead entities are
+// expanded when the text or attribute value is actually requested.
+static const int PULL_FLAGS = rapidsax::noEntityTranslation;
+
+// Read at least this much text from the file at once.
+static const size_t CHUNK_SIZE = 64 * 1024;
+
+static const size_t NO_CONTENTS = size_t(-1);
+
+namespace {
+struct DoctypeHandler : rapidsax::NullHandler
 {
-	elems.emplace_back(&rootElem, 0);
+	void doctype(string_ref txt)
+	{
+		systemID = XMLLoader::parseSystemID(txt).str();
+	}
+	std::string systemID;
+};
 }
 
-string_ref XmlInputArchive::loadStr()
+// Collects the name and (unexpanded) attributes of a start tag.
+template<typename Element> struct StartTagHandler : rapidsax::NullHandler
+{
+	explicit StartTagHandler(Element& elem_) : elem(elem_) {}
+	void start(string_ref name)
+	{
+		elem.name = name.str();
+	}
+	void attribute(string_ref name, string_ref value)
+	{
+		elem.attributes.emplace_back(name.str(), value.str());
+	}
+	Element& elem;
+};
+
+XmlInputArchive::XmlInputArchive(const string& filename_)
+	: filename(filename_)
+	, bufPos(0)
+	, bufLen(0)
+	, depth(0)
+{
+	try {
+		file = File(filename);
+		fileSize = file.getSize();
+	} catch (FileException& e) {
+		throw XMLException(filename + ": failed to read: " + e.getMessage());
+	}
+
+	DoctypeHandler handler;
+	rapidsax::PullParser<PULL_FLAGS, DoctypeHandler> parser(handler);
+	size_t root = 0;
+	bool hasRoot = parse(root, [&](char*& p) -> bool {
+		char* bufEnd = buf.data() + bufLen;
+		char* r = parser.parseProlog(p);
+		if (r == bufEnd) {
+			throw rapidsax::ParseError("unexpected end of data", bufEnd);
+		}
+		if (!r) {
+			if (bufPos + bufLen != fileSize) {
+				throw rapidsax::ParseError("unexpected end of data", bufEnd);
+			}
+			return false;
+		}
+		p = r;
+		return true;
+	});
+	if (!hasRoot) {
+		throw XMLException(filename +
+			": Document doesn't contain mandatory root Element");
+	}
+	XMLLoader::checkSystemID(filename, handler.systemID,
+	                         "openmsx-serialize.dtd");
+	openElement(root);
+}
+
+// Run 'f' on the text at file position 'pos'. For 'f' the text seems to end
+// at the end of the buffered window. If 'f' fails because of that, a larger
+// window is read and 'f' is retried. On success 'pos' is moved to the end of
+// the parsed text.
+template<typename F> bool XmlInputArchive::parse(size_t& pos, F f)
+{
+	size_t num = ((bufPos <= pos) && (pos < (bufPos + bufLen)))
+	           ? (bufPos + bufLen - pos) : CHUNK_SIZE;
+	while (true) {
+		char* start = fillBuffer(pos, num);
+		char* p = start;
+		try {
+			bool result = f(p);
+			pos += p - start;
+			return result;
+		} catch (rapidsax::ParseError& e) {
+			if ((e.where() != (buf.data() + bufLen)) ||
+			    ((bufPos + bufLen) == fileSize)) {
+				throw XMLException(filename +
+					": Document parsing failed: " + e.what());
+			}
+			num = std::max(2 * num, CHUNK_SIZE);
+		}
+	}
+}
+
+// Make sure the text at [pos, pos + num) (or up to the end of the file) is in
+// the buffer. Returns a pointer to the text at 'pos'.
+char* XmlInputArchive::fillBuffer(size_t pos, size_t num)
+{
+	size_t end = std::min(pos + num, fileSize);
+	if ((bufPos <= pos) && (end <= (bufPos + bufLen))) {
+		return buf.data() + (pos - bufPos);
+	}
+
+	// Drop the text in front of 'pos', keep the remainder of the current
+	// window and read what's missing.
+	size_t keep = 0;
+	if ((bufPos <= pos) && (pos < (bufPos + bufLen))) {
+		keep = bufPos + bufLen - pos;
+		memmove(buf.data(), buf.data() + (pos - bufPos), keep);
+	}
+	size_t len = std::max(end, std::min(pos + CHUNK_SIZE, fileSize)) - pos;
+	bufPos = pos;
+	bufLen = 0;
+	buf.resize(len + rapidsax::EXTRA_BUFFER_SPACE);
+	try {
+		file.seek(pos + keep);
+		file.read(buf.data() + keep, len - keep);
+	} catch (FileException& e) {
+		throw XMLException(filename + ": failed to read: " + e.getMessage());
+	}
+	memset(buf.data() + len, 0, rapidsax::EXTRA_BUFFER_SPACE);
+	bufLen = len;
+	return buf.data();
+}
+
+void XmlInputArchive::openElement(size_t start)
 {
-	if (!elems.back().first->getChildren().empty()) {
-		throw XMLException("No child tags expected for primitive type");
+	if (elems.size() == depth) {
+		elems.emplace_back();
 	}
-	return elems.back().first->getData();
+	auto& elem = elems[depth];
+	StartTagHandler<Element> handler(elem);
+	rapidsax::PullParser<PULL_FLAGS, StartTagHandler<Element>> parser(handler);
+	size_t pos = start;
+	bool hasContents = parse(pos, [&](char*& p) -> bool {
+		elem.attributes.clear();
+		return parser.parseStartTag(p);
+	});
+	elem.loaded.clear();
+	elem.start = start;
+	elem.contents = hasContents ? pos : NO_CONTENTS;
+	elem.next = pos;
+	++depth;
+}
+
+static bool isTagName(const char* p, const char* tag, size_t len)
+{
+	if (strncmp(p, tag, len) != 0) return false;
+	char c = p[len];
+	return (c == '>') || (c == '/') ||
+	       (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+// Move 'pos' to the next child tag (right after the '<') and make sure at
+// least 'num' characters of it are buffered. Returns false when the end tag of
+// the current element is reached instead.
+bool XmlInputArchive::nextChild(size_t& pos, size_t num)
+{
+	rapidsax::NullHandler handler;
+	rapidsax::PullParser<PULL_FLAGS, rapidsax::NullHandler> parser(handler);
+	return parse(pos, [&](char*& p) -> bool {
+		if (!parser.parseToNextChild(p)) return false;
+		char* bufEnd = buf.data() + bufLen;
+		if (size_t(bufEnd - p) < num) {
+			throw rapidsax::ParseError("unexpected end of data", bufEnd);
+		}
+		return true;
+	});
+}
+
+// Skip over the element at 'pos' (including all its children).
+void XmlInputArchive::skipElement(size_t& pos)
+{
+	rapidsax::NullHandler handler;
+	rapidsax::PullParser<PULL_FLAGS, rapidsax::NullHandler> parser(handler);
+	parse(pos, [&](char*& p) { parser.parseElement(p); return true; });
+}
+
+bool XmlInputArchive::findChild(const char* tag, size_t& child)
+{
+	auto& parent = elems[depth - 1];
+	if (parent.contents == NO_CONTENTS) return false;
+	size_t len = strlen(tag);
+	auto isMatch = [&](size_t pos) {
+		return isTagName(fillBuffer(pos, len + 1), tag, len) &&
+		       !std::binary_search(parent.loaded.begin(),
+		                           parent.loaded.end(), pos);
+	};
+
+	// Usually the requested tag is the next one, but (like in the
+	// XMLElement based implementation) also search the tags in front of
+	// the current position. Only then the file is read again.
+	size_t pos = parent.next;
+	while (nextChild(pos, len + 1)) {
+		if (isMatch(pos)) {
+			child = pos;
+			return true;
+		}
+		skipElement(pos);
+	}
+	pos = parent.contents;
+	while (nextChild(pos, len + 1) && (pos < parent.next)) {
+		if (isMatch(pos)) {
+			child = pos;
+			return true;
+		}
+		skipElement(pos);
+	}
+	return false;
+}
+
+string_ref XmlInputArchive::expand(string_ref raw)
+{
+	if (raw.find('&') == string_ref::npos) return raw;
+	expanded.assign(raw.data(), raw.size());
+	char* text = &expanded[0];
+	expanded.resize(rapidsax::expandEntities(text) - text);
+	return expanded;
+}
+
+const string* XmlInputArchive::getAttribute(const char* name) const
+{
+	for (auto& a : elems[depth - 1].attributes) {
+		if (a.first == name) return &a.second;
+	}
+	return nullptr;
+}
+
+string_ref XmlInputArchive::loadStr()
+{
+	auto& elem = elems[depth - 1];
+	if (elem.contents == NO_CONTENTS) return string_ref();
+
+	// like rapidsax::trimWhitespace
+	auto isSpace = [](char c) {
+		return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+	};
+	char* text = nullptr;
+	char* textEnd = nullptr;
+	size_t pos = elem.contents;
+	parse(pos, [&](char*& p) -> bool {
+		text = p;
+		while (isSpace(*text)) ++text;
+		char* lt = strchr(text, '<');
+		if (!lt || !lt[1]) {
+			throw rapidsax::ParseError("unexpected end of data",
+				lt ? (lt + 1) : (text + strlen(text)));
+		}
+		if (lt[1] != '/') {
+			throw XMLException("No child tags expected for primitive type");
+		}
+		textEnd = lt;
+		while ((textEnd != text) && isSpace(textEnd[-1])) --textEnd;
+		p = lt;
+		return true;
+	});
+	// (the text stays in the buffer until the next parse() call)
+	elem.next = pos;
+	return expand(string_ref(text, textEnd));
 }
 void XmlInputArchive::load(string& t)
 {
@@ -488,38 +1111,54 @@ void XmlInputArchive::load(char& c)
 
 void XmlInputArchive::beginTag(const char* tag)
 {
-	auto* child = elems.back().first->findNextChild(
-		tag, elems.back().second);
-	if (!child) {
+	size_t child;
+	if (!findChild(tag, child)) {
 		string path;
-		for (auto& e : elems) {
-			path += e.first->getName() + '/';
+		for (auto i : xrange(depth)) {
+			path += elems[i].name + '/';
 		}
 		throw XMLException(StringOp::Builder() <<
 			"No child tag \"" << tag <<
 			"\" found at location \"" << path << '\"');
 	}
-	elems.emplace_back(child, 0);
+	openElement(child);
 }
 void XmlInputArchive::endTag(const char* tag)
 {
-	const auto& elem = *elems.back().first;
-	if (elem.getName() != tag) {
-		throw XMLException("End tag \"" + elem.getName() +
+	assert(depth > 1);
+	auto& elem = elems[depth - 1];
+	if (elem.name != tag) {
+		throw XMLException("End tag \"" + elem.name +
 			"\" not equal to begin tag \"" + tag + "\"");
 	}
-	auto& elem2 = const_cast<XMLElement&>(elem);
-	elem2.clearName(); // mark this elem for later beginTag() calls
-	elems.pop_back();
+	// skip the part of the contents that wasn't loaded (one child at a
+	// time, so that they don't have to be in the buffer all at once)
+	size_t pos = elem.next;
+	if (elem.contents != NO_CONTENTS) {
+		while (nextChild(pos, 1)) {
+			skipElement(pos);
+		}
+		rapidsax::NullHandler handler;
+		rapidsax::PullParser<PULL_FLAGS, rapidsax::NullHandler> parser(handler);
+		parse(pos, [&](char*& p) { parser.parseEndTag(p); return true; });
+	}
+	// mark this elem for later beginTag() calls
+	size_t start = elem.start;
+	--depth;
+	auto& parent = elems[depth - 1];
+	parent.loaded.insert(std::upper_bound(parent.loaded.begin(),
+	                                      parent.loaded.end(), start),
+	                     start);
+	parent.next = pos;
 }
 
 void XmlInputArchive::attribute(const char* name, string& t)
 {
-	try {
-		t = elems.back().first->getAttribute(name);
-	} catch (ConfigException& ex) {
-		throw XMLException(ex.getMessage());
+	auto* value = getAttribute(name);
+	if (!value) {
+		throw XMLException(string("Missing attribute \"") + name + "\".");
 	}
+	t = expand(*value).str();
 }
 void XmlInputArchive::attribute(const char* name, int& i)
 {
@@ -531,15 +1170,26 @@ void XmlInputArchive::attribute(const char* name, unsigned& u)
 }
 bool XmlInputArchive::hasAttribute(const char* name)
 {
-	return elems.back().first->hasAttribute(name);
+	return getAttribute(name) != nullptr;
 }
 bool XmlInputArchive::findAttribute(const char* name, unsigned& value)
 {
-	return elems.back().first->findAttributeInt(name, value);
+	auto* str = getAttribute(name);
+	if (!str) return false;
+	value = StringOp::stringToInt(expand(*str).str());
+	return true;
 }
-int XmlInputArchive::countChildren() const
+int XmlInputArchive::countChildren()
 {
-	return int(elems.back().first->getChildren().size());
+	auto& elem = elems[depth - 1];
+	if (elem.contents == NO_CONTENTS) return 0;
+	int count = 0;
+	size_t pos = elem.contents;
+	while (nextChild(pos, 1)) {
+		++count;
+		skipElement(pos);
+	}
+	return count;
 }
 
 } // namespace openmsx
@@ -4,9 +4,11 @@
 #include "serialize_core.hh"
 #include "SerializeBuffer.hh"
 #include "XMLElement.hh"
+#include "File.hh"
 #include "MemBuffer.hh"
 #include "StringOp.hh"
 #include "inline.hh"
+#include "likely.hh"
 #include "unreachable.hh"
 #include <zlib.h>
 #include <string>
@@ -16,6 +18,8 @@
 #include <map>
 #include <sstream>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 
 namespace openmsx {
@@ -40,6 +44,12 @@ template<typename T> struct SerializeClassVersion;
 //      (e.g. integers are stored using native platform endianess).
 //      The main use case for this archive format is regular in memory
 //      snapshots, for example to support replay/rewind.
+//   - Bin
+//      Stores the stream in a binary file. It uses the same (native) encoding
+//      as the Mem archive, but it does store version information. Blobs are
+//      (individually) compressed and stored after the main stream, an index
+//      in the file header locates them. Like Mem it's not platform
+//      independent, but it's much faster to save and load than XML.
 //   - XML
 //      Stores the stream in a XML file. These files are meant to be portable
 //      to different architectures (e.g. little/big endian, 32/64 bit system).
@@ -325,10 +335,82 @@ protected:
 	}
 };
 
+// Support for storing blobs as the difference with an earlier blob in file
+// archives (memory archives already use DeltaBlocks for all blobs). This is
+// meant for archives that contain a sequence of similar states, like the
+// snapshots in a replay file: the blobs of each snapshot form a group, and a
+// blob is stored relative to the blob with the same index in the previous
+// group. Both while saving and loading a copy of the blobs of the previous
+// and the current group is kept.
+// Blobs inside sections (see beginSection()) are always stored in full: the
+// loader may skip such a section, and then it doesn't have the base for the
+// next group.
+class BlobDeltas
+{
+public:
+	BlobDeltas() : enabled(false), index(0), sectionDepth(0) {}
+
+	void enable() { enabled = true; }
+	bool isEnabled() const { return enabled; }
+
+	void beginGroup()
+	{
+		prev.swap(cur);
+		cur.clear();
+		index = 0;
+	}
+	unsigned nextIndex() { return index++; }
+
+	/** Blob with the given index and size in the previous group, or nullptr.
+	 * The result is writable because calcDelta() needs that.
+	 */
+	uint8_t* getBase(unsigned idx, size_t size)
+	{
+		return ((sectionDepth == 0) && (idx < prev.size()) &&
+		        (prev[idx].size == size) && !prev[idx].data.empty())
+		       ? prev[idx].data.data() : nullptr;
+	}
+	// Only called by output archives.
+	void beginSection() { ++sectionDepth; }
+	void endSection()   { assert(sectionDepth); --sectionDepth; }
+	void store(unsigned idx, const void* data, size_t size)
+	{
+		if (idx >= cur.size()) cur.resize(idx + 1);
+		cur[idx].data.resize(size);
+		cur[idx].size = size;
+		memcpy(cur[idx].data.data(), data, size);
+	}
+
+private:
+	struct Blob {
+		Blob() : size(0) {}
+		MemBuffer<uint8_t> data;
+		size_t size;
+	};
+	std::vector<Blob> prev;
+	std::vector<Blob> cur;
+	bool enabled;
+	unsigned index;
+	unsigned sectionDepth;
+};
+
 // The part of OutputArchiveBase that doesn't depend on the template parameter
 class OutputArchiveBase2
 {
 public:
+	/** Store blobs as differences with the blobs of the previous group
+	 * (see BlobDeltas). Must be called in the same location while
+	 * loading. Ignored by memory archives.
+	 */
+	void enableBlobDeltas() { blobDeltas.enable(); }
+	/** Start a new group of blobs (only has effect after
+	 * enableBlobDeltas()).
+	 */
+	void beginBlobGroup()
+	{
+		if (blobDeltas.isEnabled()) blobDeltas.beginGroup();
+	}
+
 	inline bool isLoader() const { return false; }
 	inline bool versionAtLeast(unsigned /*actual*/, unsigned /*required*/) const
 	{
@@ -405,6 +487,9 @@ private:
 	std::map<std::pair<const void*, std::type_index>, unsigned> idMap;
 	std::map<const void*, unsigned> polyIdMap;
 	unsigned lastId;
+
+protected:
+	BlobDeltas blobDeltas;
 };
 
 template<typename Derived>
@@ -486,6 +571,13 @@ class InputArchiveBase2
 public:
 	inline bool isLoader() const { return true; }
 
+	// see OutputArchiveBase2
+	void enableBlobDeltas() { blobDeltas.enable(); }
+	void beginBlobGroup()
+	{
+		if (blobDeltas.isEnabled()) blobDeltas.beginGroup();
+	}
+
 	void beginSection()
 	{
 		UNREACHABLE;
@@ -518,6 +610,8 @@ public:
 protected:
 	InputArchiveBase2() {}
 
+	BlobDeltas blobDeltas;
+
 private:
 	std::map<unsigned, void*> idMap;
 	std::map<void*, std::shared_ptr<void>> sharedPtrMap;
@@ -598,12 +692,7 @@ class MemOutputArchive final : public OutputArchiveBase<MemOutputArchive>
 public:
 	MemOutputArchive(LastDeltaBlocks& lastDeltaBlocks_,
 	                 std::vector<std::shared_ptr<DeltaBlock>>& deltaBlocks_,
-			 bool reverseSnapshot_)
-		: lastDeltaBlocks(lastDeltaBlocks_)
-		, deltaBlocks(deltaBlocks_)
-		, reverseSnapshot(reverseSnapshot_)
-	{
-	}
+			 bool reverseSnapshot_);
 
 	~MemOutputArchive()
 	{
@@ -716,6 +805,144 @@ private:
 
 ////
 
+class BinOutputArchive final : public OutputArchiveBase<BinOutputArchive>
+{
+public:
+	explicit BinOutputArchive(const std::string& filename);
+
+	template <typename T> void save(const T& t)
+	{
+		put(&t, sizeof(t));
+	}
+	inline void saveChar(char c)
+	{
+		save(c);
+	}
+	void save(const std::string& s);
+	void serialize_blob(const char*, const void* data, size_t len,
+	                    bool diff = true);
+
+	void beginSection()
+	{
+		size_t skip = 0; // filled in later
+		save(skip);
+		size_t beginPos = buffer.getPosition();
+		openSections.push_back(beginPos);
+		blobDeltas.beginSection();
+	}
+	void endSection()
+	{
+		assert(!openSections.empty());
+		size_t endPos   = buffer.getPosition();
+		size_t beginPos = openSections.back();
+		openSections.pop_back();
+		size_t skip = endPos - beginPos;
+		buffer.insertAt(beginPos - sizeof(skip),
+		                &skip, sizeof(skip));
+		blobDeltas.endSection();
+	}
+
+	/** Write the header, the main stream and all blobs to the file.
+	 * Must be called once after everything is serialized. When it's not
+	 * called (e.g. because serialization threw), or when writing fails,
+	 * an existing file with the same name is left untouched.
+	 */
+	void close();
+
+private:
+	struct Blob {
+		MemBuffer<byte> data;
+		size_t rawSize;
+		size_t size; // compressed size, equal to rawSize if stored raw
+		uint32_t checksum;
+	};
+	void put(const void* data, size_t len)
+	{
+		if (len) {
+			buffer.insert(data, len);
+		}
+	}
+	void addBlob(Blob& blob, const byte* data, size_t len);
+
+	const std::string filename;
+	OutputBuffer buffer;
+	std::vector<size_t> openSections;
+	std::vector<Blob> blobs; // blobs[0] is the main stream
+};
+
+class BinInputArchive final : public InputArchiveBase<BinInputArchive>
+{
+public:
+	explicit BinInputArchive(const std::string& filename);
+
+	/** Does the given file start with the signature of a binary archive?
+	 * Returns false (instead of throwing) if the file can't be read.
+	 */
+	static bool isBinaryArchive(const std::string& filename);
+
+	inline bool versionAtLeast(unsigned actual, unsigned required) const
+	{
+		return actual >= required;
+	}
+	inline bool versionBelow(unsigned actual, unsigned required) const
+	{
+		return actual < required;
+	}
+
+	template<typename T> void load(T& t)
+	{
+		get(&t, sizeof(t));
+	}
+	inline void loadChar(char& c)
+	{
+		load(c);
+	}
+	void load(std::string& s);
+	string_ref loadStr();
+	void serialize_blob(const char*, void* data, size_t len,
+	                    bool diff = true);
+
+	void skipSection(bool skip)
+	{
+		size_t num;
+		load(num);
+		if (skip) {
+			skipBytes(num);
+		}
+	}
+
+private:
+	struct Blob {
+		const byte* data; // points into the mmap'ed file
+		size_t rawSize;
+		size_t size;
+		uint32_t checksum;
+	};
+	void get(void* data, size_t len)
+	{
+		if (unlikely(len > size_t(streamEnd - streamPos))) truncatedError();
+		if (len) {
+			memcpy(data, streamPos, len);
+			streamPos += len;
+		}
+	}
+	void skipBytes(size_t len)
+	{
+		if (unlikely(len > size_t(streamEnd - streamPos))) truncatedError();
+		streamPos += len;
+	}
+	void uncompressBlob(const Blob& blob, byte* output) const;
+	NEVER_INLINE static void truncatedError();
+
+	File file;
+	std::vector<Blob> blobs;
+	MemBuffer<byte> stream;
+	const byte* streamPos;
+	const byte* streamEnd;
+};
+
+////
+
 class XmlOutputArchive final : public OutputArchiveBase<XmlOutputArchive>
 {
 public:
@@ -742,8 +969,8 @@ public:
 	void save(unsigned u);             // but having them non-inline
 	void save(unsigned long long ull); // saves quite a bit of code
 
-	void beginSection() { /*nothing*/ }
-	void endSection()   { /*nothing*/ }
+	void beginSection() { blobDeltas.beginSection(); }
+	void endSection()   { blobDeltas.endSection(); }
 
 //internal:
 	inline bool translateEnumToString() const { return true; }
@@ -830,16 +1057,53 @@ public:
 
 	bool hasAttribute(const char* name);
 	bool findAttribute(const char* name, unsigned& value);
-	int countChildren() const;
+	int countChildren();
 
 private:
-	XMLElement rootElem;
-	std::vector<std::pair<const XMLElement*, size_t>> elems;
+	// The XML file isn't parsed into a DOM tree, and it isn't read in
+	// memory as a whole either. Only a window of the (decompressed) XML
+	// text is kept in memory, and it's parsed on demand: beginTag()
+	// searches the requested child tag and only parses its attributes,
+	// endTag() skips over the remainder of the tag. Tags are normally
+	// requested in the order they were written, then the text is read
+	// sequentially. Only when a tag is requested out of order (or after
+	// the children were counted) an earlier part of the file is read
+	// again. So the window only needs to hold the largest element that is
+	// parsed at once (a primitive value or a skipped/counted child), not
+	// the whole file.
+	struct Element {
+		std::string name;
+		std::vector<std::pair<std::string, std::string>> attributes; // not yet expanded
+		std::vector<size_t> loaded; // sorted positions of the already loaded child tags
+		size_t start;    // file position right after the '<'
+		size_t contents; // start of the contents, NO_CONTENTS for <tag/>
+		size_t next;     // where to continue searching for child tags
+	};
+	template<typename F> bool parse(size_t& pos, F f);
+	char* fillBuffer(size_t pos, size_t num);
+	void openElement(size_t start);
+	bool nextChild(size_t& pos, size_t num);
+	void skipElement(size_t& pos);
+	bool findChild(const char* tag, size_t& child);
+	const std::string* getAttribute(const char* name) const;
+	string_ref expand(string_ref raw);
+
+	File file;
+	std::string filename;
+	size_t fileSize;
+	MemBuffer<char> buf; // text at [bufPos, bufPos + bufLen), zero-terminated
+	size_t bufPos;
+	size_t bufLen;
+	std::vector<Element> elems; // the first 'depth' elements are open
+	size_t depth;
+	std::string expanded; // storage for text with expanded entities
 };
 
 #define INSTANTIATE_SERIALIZE_METHODS(CLASS) \
 template void CLASS::serialize(MemInputArchive&,   unsigned); \
 template void CLASS::serialize(MemOutputArchive&,  unsigned); \
+template void CLASS::serialize(BinInputArchive&,   unsigned); \
+template void CLASS::serialize(BinOutputArchive&,  unsigned); \
 template void CLASS::serialize(XmlInputArchive&,   unsigned); \
 template void CLASS::serialize(XmlOutputArchive&,  unsigned);
 
@@ -495,6 +495,8 @@ template<typename T> struct EnumLoader
 
 unsigned loadVersionHelper(MemInputArchive& ar, const char* className,
                            unsigned latestVersion);
+unsigned loadVersionHelper(BinInputArchive& ar, const char* className,
+                           unsigned latestVersion);
 unsigned loadVersionHelper(XmlInputArchive& ar, const char* className,
                            unsigned latestVersion);
 template<typename T, typename Archive> unsigned loadVersion(Archive& ar)
@@ -55,6 +55,7 @@ void PolymorphicSaverRegistry<Archive>::save(
 }
 
 template class PolymorphicSaverRegistry<MemOutputArchive>;
+template class PolymorphicSaverRegistry<BinOutputArchive>;
 template class PolymorphicSaverRegistry<XmlOutputArchive>;
 
 ////
@@ -88,6 +89,7 @@ void* PolymorphicLoaderRegistry<Archive>::load(
 }
 
 template class PolymorphicLoaderRegistry<MemInputArchive>;
+template class PolymorphicLoaderRegistry<BinInputArchive>;
 template class PolymorphicLoaderRegistry<XmlInputArchive>;
 
 ////
@@ -134,6 +136,7 @@ void PolymorphicInitializerRegistry<Archive>::init(
 }
 
 template class PolymorphicInitializerRegistry<MemInputArchive>;
+template class PolymorphicInitializerRegistry<BinInputArchive>;
 template class PolymorphicInitializerRegistry<XmlInputArchive>;
 
 } // namespace openmsx
@@ -354,6 +354,8 @@ template<> struct PolymorphicConstructorArgs<C> \
 
 class MemInputArchive;
 class MemOutputArchive;
+class BinInputArchive;
+class BinOutputArchive;
 class XmlInputArchive;
 class XmlOutputArchive;
 
@@ -371,6 +373,8 @@ static RegisterLoaderHelper<MemInputArchive,  C> registerHelper3##C(N); \
 static RegisterSaverHelper <MemOutputArchive, C> registerHelper4##C(N); \
 static RegisterLoaderHelper<XmlInputArchive,  C> registerHelper5##C(N); \
 static RegisterSaverHelper <XmlOutputArchive, C> registerHelper6##C(N); \
+static RegisterLoaderHelper<BinInputArchive,  C> registerHelper7##C(N); \
+static RegisterSaverHelper <BinOutputArchive, C> registerHelper8##C(N); \
 template<> struct PolymorphicBaseClass<C> { using type = B; };
 
 #define REGISTER_POLYMORPHIC_INITIALIZER_HELPER(B,C,N) \
@@ -379,6 +383,8 @@ static RegisterInitializerHelper<MemInputArchive,  C> registerHelper3##C(N); \
 static RegisterSaverHelper      <MemOutputArchive, C> registerHelper4##C(N); \
 static RegisterInitializerHelper<XmlInputArchive,  C> registerHelper5##C(N); \
 static RegisterSaverHelper      <XmlOutputArchive, C> registerHelper6##C(N); \
+static RegisterInitializerHelper<BinInputArchive,  C> registerHelper7##C(N); \
+static RegisterSaverHelper      <BinOutputArchive, C> registerHelper8##C(N); \
 template<> struct PolymorphicBaseClass<C> { using type = B; };
 
 #define REGISTER_BASE_NAME_HELPER(B,N) \
@@ -2,9 +2,12 @@
 #include "MSXMixer.hh"
 #include "NullSoundDriver.hh"
 #include "SDLSoundDriver.hh"
+#include "Reactor.hh"
 #include "CommandController.hh"
 #include "CliComm.hh"
+#include "TclObject.hh"
 #include "MSXException.hh"
+#include "outer.hh"
 #include "memory.hh"
 #include "stl.hh"
 #include "unreachable.hh"
@@ -12,6 +15,9 @@
 #include "build-info.hh"
 #include <cassert>
 
+using std::string;
+using std::vector;
+
 namespace openmsx {
 
 #if defined(_WIN32)
@@ -49,11 +55,17 @@ Mixer::Mixer(Reactor& reactor_, CommandController& commandController_)
 	, samplesSetting(
 		commandController, "samples",
 		"mixer samples", defaultsamples, 64, 8192)
+	, adaptiveSetting(
+		commandController, "adaptive_latency",
+		"dynamically shrink the sound output buffer to the smallest "
+		"size that doesn't cause underruns", false)
+	, latencyInfo(reactor.getOpenMSXInfoCommand())
 	, muteCount(0)
 {
 	muteSetting       .attach(*this);
 	frequencySetting  .attach(*this);
 	samplesSetting    .attach(*this);
+	adaptiveSetting   .attach(*this);
 	soundDriverSetting.attach(*this);
 
 	// Set correct initial mute state.
@@ -68,6 +80,7 @@ Mixer::~Mixer()
 	driver.reset();
 
 	soundDriverSetting.detach(*this);
+	adaptiveSetting   .detach(*this);
 	samplesSetting    .detach(*this);
 	frequencySetting  .detach(*this);
 	muteSetting       .detach(*this);
@@ -90,7 +103,8 @@ void Mixer::reloadDriver()
 			driver = make_unique<SDLSoundDriver>(
 				reactor,
 				frequencySetting.getInt(),
-				samplesSetting.getInt());
+				samplesSetting.getInt(),
+				adaptiveSetting.getBoolean());
 			break;
 		default:
 			UNREACHABLE;
@@ -164,6 +178,7 @@ void Mixer::update(const Setting& setting)
 			unmute();
 		}
 	} else if ((&setting == &samplesSetting) ||
+	           (&setting == &adaptiveSetting) ||
 	           (&setting == &soundDriverSetting) ||
 	           (&setting == &frequencySetting)) {
 		reloadDriver();
@@ -172,4 +187,38 @@ void Mixer::update(const Setting& setting)
 	}
 }
 
+
+
+// class LatencyInfoTopic
+
+Mixer::LatencyInfoTopic::LatencyInfoTopic(InfoCommand& openMSXInfoCommand)
+	: InfoTopic(openMSXInfoCommand, "sound_latency")
+{
+}
+
+void Mixer::LatencyInfoTopic::execute(array_ref<TclObject> /*tokens*/,
+                                      TclObject& result) const
+{
+	auto& mixer = OUTER(Mixer, latencyInfo);
+	auto stats = mixer.driver->getStatistics();
+	double freq = mixer.driver->getFrequency();
+	result.addListElement("fragment");
+	result.addListElement(1000.0 * stats.fragmentSize / freq);
+	result.addListElement("buffer");
+	result.addListElement(1000.0 * stats.bufferSize / freq);
+	result.addListElement("filled");
+	result.addListElement(1000.0 * stats.bufferFilled / freq);
+	result.addListElement("underruns");
+	result.addListElement(int(stats.underruns));
+	result.addListElement("jitter");
+	result.addListElement(stats.jitter / 1000.0);
+}
+
+string Mixer::LatencyInfoTopic::help(const vector<string>& /*tokens*/) const
+{
+	return "Returns sound output statistics as a dictionary: fragment "
+	       "size, (adapted) buffer size, currently buffered audio and "
+	       "callback jitter (all in ms) and the number of underruns.";
+}
+
 } // namespace openmsx
@@ -5,6 +5,7 @@
 #include "BooleanSetting.hh"
 #include "EnumSetting.hh"
 #include "IntegerSetting.hh"
+#include "InfoTopic.hh"
 #include <vector>
 #include <memory>
 
@@ -46,6 +47,7 @@ public:
 	void uploadBuffer(MSXMixer& msxMixer, int16_t* buffer, unsigned len);
 
 	IntegerSetting& getMasterVolume() { return masterVolume; }
+	SoundDriverType getSoundDriverType() const { return soundDriverSetting.getEnum(); }
 
 private:
 	void reloadDriver();
@@ -65,6 +67,14 @@ private:
 	IntegerSetting masterVolume;
 	IntegerSetting frequencySetting;
 	IntegerSetting samplesSetting;
+	BooleanSetting adaptiveSetting;
+
+	struct LatencyInfoTopic final : InfoTopic {
+		explicit LatencyInfoTopic(InfoCommand& openMSXInfoCommand);
+		void execute(array_ref<TclObject> tokens,
+			     TclObject& result) const override;
+		std::string help(const std::vector<std::string>& tokens) const override;
+	} latencyInfo;
 
 	int muteCount;
 };
@@ -24,4 +24,10 @@ void NullSoundDriver::uploadBuffer(int16_t* /*buffer*/, unsigned /*len*/)
 {
 }
 
+SoundDriver::Statistics NullSoundDriver::getStatistics() const
+{
+	Statistics stats = { 0, 0, 0, 0, 0 };
+	return stats;
+}
+
 } // namespace openmsx
@@ -15,6 +15,7 @@ public:
 	unsigned getSamples() const override;
 
 	void uploadBuffer(int16_t* buffer, unsigned len) override;
+	Statistics getStatistics() const override;
 };
 
 } // namespace openmsx
@@ -12,13 +12,20 @@
 #include <SDL.h>
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
 
 namespace openmsx {
 
+// Shrink the buffer after it has been stable for this many seconds.
+static const unsigned STABLE_SECONDS = 2;
+
 SDLSoundDriver::SDLSoundDriver(Reactor& reactor_,
-                               unsigned wantedFreq, unsigned wantedSamples)
+                               unsigned wantedFreq, unsigned wantedSamples,
+                               bool adaptive_)
 	: reactor(reactor_)
+	, underruns(0)
+	, adaptive(adaptive_)
 	, muted(true)
 {
 	SDL_AudioSpec desired;
@@ -60,6 +67,10 @@ void SDLSoundDriver::reInit()
 	SDL_LockAudio();
 	readIdx  = 0;
 	writeIdx = 0;
+	prevCallbackTime = 0;
+	jitter = 0;
+	targetSize = mixBufferSize - 2;
+	stableCount = 0;
 	SDL_UnlockAudio();
 }
 
@@ -111,9 +122,10 @@ unsigned SDLSoundDriver::getBufferFree() const
 	// (in both cases readIx would be equal to writeIdx), so instead
 	// we define full as '(writeIdx + 2) == readIdx' (note that index
 	// increases in steps of 2 (stereo)).
-	int result = mixBufferSize - 2 - getBufferFilled();
-	assert((0 <= result) && (unsigned(result) < mixBufferSize));
-	return result;
+	// In adaptive mode we pretend the buffer is only 'targetSize' big.
+	int result = int(targetSize) - int(getBufferFilled());
+	assert(result < int(mixBufferSize));
+	return std::max(result, 0);
 }
 
 void SDLSoundDriver::audioCallback(int16_t* stream, unsigned len)
@@ -136,12 +148,66 @@ void SDLSoundDriver::audioCallback(int16_t* stream, unsigned len)
 		// buffer underrun
 		memset(&stream[available], 0, missing * sizeof(int16_t));
 	}
+
+	// The very first callback after (re)initialization always underruns
+	// because the emulation did not yet have a chance to fill the buffer.
+	if (prevCallbackTime != 0) {
+		if (missing > 0) ++underruns;
+		if (adaptive) adaptBufferSize(missing > 0);
+	}
+	measureJitter();
+}
+
+void SDLSoundDriver::measureJitter()
+{
+	// Keep track of how much the interval between two callbacks deviates
+	// from the nominal fragment duration. Spikes slowly decay, so the
+	// reported value reflects the worst case over the last few seconds.
+	auto now = Timer::getTime();
+	if (prevCallbackTime != 0) {
+		int64_t interval = now - prevCallbackTime;
+		int64_t expected = (uint64_t(fragmentSize) * 1000000) / frequency;
+		auto deviation = unsigned(std::abs(interval - expected));
+		jitter = std::max(deviation, jitter - (jitter + 63) / 64);
+	}
+	prevCallbackTime = now;
+}
+
+void SDLSoundDriver::adaptBufferSize(bool underrun)
+{
+	unsigned maxSize = mixBufferSize - 2;
+	unsigned step = fragmentSize / 4 * 2; // multiple of 2 (stereo)
+	if (underrun) {
+		// Grow fast: the host can't keep up with the current size.
+		targetSize = std::min(targetSize + 2 * step, maxSize);
+		stableCount = 0;
+		return;
+	}
+	if (++stableCount < (STABLE_SECONDS * frequency / fragmentSize)) {
+		return;
+	}
+	stableCount = 0;
+	// Shrink slowly, but always keep room for one fragment plus the
+	// observed callback jitter.
+	unsigned jitterSamples = unsigned(
+		(uint64_t(jitter) * frequency / 1000000) * 2);
+	unsigned minSize = std::min(2 * fragmentSize + jitterSamples, maxSize);
+	if (targetSize > minSize) {
+		targetSize = std::max(targetSize - std::min(step, targetSize), minSize);
+	}
 }
 
 void SDLSoundDriver::uploadBuffer(int16_t* buffer, unsigned len)
 {
 	SDL_LockAudio();
 	len *= 2; // stereo
+	// Never let the adapted size drop below the size of a single upload,
+	// otherwise we'd wait forever below. The audio callback can shrink
+	// it again while the lock is released, so also check after waiting.
+	auto clampTarget = [&] {
+		targetSize = std::max(targetSize, std::min(len, mixBufferSize - 2));
+	};
+	clampTarget();
 	unsigned free = getBufferFree();
 	if (len > free) {
 		if (reactor.getGlobalSettings().getThrottleManager().isThrottled()) {
@@ -152,6 +218,7 @@ void SDLSoundDriver::uploadBuffer(int16_t* buffer, unsigned len)
 				if (MSXMotherBoard* board = reactor.getMotherBoard()) {
 					board->getRealTime().resync();
 				}
+				clampTarget();
 				free = getBufferFree();
 			} while (len > free);
 		} else {
@@ -174,4 +241,17 @@ void SDLSoundDriver::uploadBuffer(int16_t* buffer, unsigned len)
 	SDL_UnlockAudio();
 }
 
+SoundDriver::Statistics SDLSoundDriver::getStatistics() const
+{
+	SDL_LockAudio();
+	Statistics stats;
+	stats.fragmentSize = fragmentSize;
+	stats.bufferSize   = targetSize / 2;
+	stats.bufferFilled = getBufferFilled() / 2;
+	stats.underruns    = underruns;
+	stats.jitter       = jitter;
+	SDL_UnlockAudio();
+	return stats;
+}
+
 } // namespace openmsx
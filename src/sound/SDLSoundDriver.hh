@@ -16,7 +16,7 @@ public:
 	SDLSoundDriver& operator=(const SDLSoundDriver&) = delete;
 
 	SDLSoundDriver(Reactor& reactor,
-	               unsigned frequency, unsigned samples);
+	               unsigned frequency, unsigned samples, bool adaptive);
 	~SDLSoundDriver();
 
 	void mute() override;
@@ -26,6 +26,7 @@ public:
 	unsigned getSamples() const override;
 
 	void uploadBuffer(int16_t* buffer, unsigned len) override;
+	Statistics getStatistics() const override;
 
 private:
 	void reInit();
@@ -33,6 +34,8 @@ private:
 	unsigned getBufferFree() const;
 	static void audioCallbackHelper(void* userdata, byte* strm, int len);
 	void audioCallback(int16_t* stream, unsigned len);
+	void measureJitter();
+	void adaptBufferSize(bool underrun);
 
 	Reactor& reactor;
 	MemBuffer<int16_t> mixBuffer;
@@ -40,6 +43,16 @@ private:
 	unsigned frequency;
 	unsigned fragmentSize;
 	unsigned readIdx, writeIdx;
+
+	// Adaptive buffer sizing. All these are only accessed with the SDL
+	// audio lock taken (or from within the audio callback).
+	uint64_t prevCallbackTime;
+	unsigned jitter;       // in micro seconds
+	unsigned targetSize;   // in int16_t units (so 2x stereo samples)
+	unsigned stableCount;  // number of callbacks without underrun
+	unsigned underruns;
+	const bool adaptive;
+
 	bool muted;
 };
 
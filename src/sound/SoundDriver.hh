@@ -30,6 +30,18 @@ public:
 
 	virtual void uploadBuffer(int16_t* buffer, unsigned len) = 0;
 
+	/** Output buffer statistics, all sizes are expressed in (stereo)
+	  * samples, times in micro seconds.
+	  */
+	struct Statistics {
+		unsigned fragmentSize; // size of one fragment requested by host
+		unsigned bufferSize;   // current (possibly adapted) buffer size
+		unsigned bufferFilled; // number of samples currently buffered
+		unsigned underruns;    // total number of buffer underruns
+		unsigned jitter;       // (decaying) max deviation between callbacks
+	};
+	virtual Statistics getStatistics() const = 0;
+
 protected:
 	SoundDriver() {}
 };
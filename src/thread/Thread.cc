@@ -1,6 +1,6 @@
 #include "Thread.hh"
 #include <cassert>
-#include <thread>
+#include <new>
 
 namespace openmsx {
 namespace Thread {
@@ -19,5 +19,12 @@ bool isMainThread()
 	return mainThreadId == std::this_thread::get_id();
 }
 
+void forgetAfterFork(std::thread& thread)
+{
+	// Overwrite without running the destructor (which would call
+	// std::terminate() for a joinable thread).
+	new (&thread) std::thread();
+}
+
 } // namespace Thread
 } // namespace openmsx
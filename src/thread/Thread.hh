@@ -1,6 +1,8 @@
 #ifndef THREAD_HH
 #define THREAD_HH
 
+#include <thread>
+
 namespace openmsx {
 namespace Thread {
 
@@ -14,6 +16,14 @@ namespace Thread {
 	  */
 	bool isMainThread();
 
+	/** To be called in a child process right after fork() for a
+	  * std::thread object that was started in the parent. The thread
+	  * itself doesn't exist in the child, so neither join() nor
+	  * detach() can be used (both operate on the parent's pthread
+	  * handle). Instead the handle is simply forgotten.
+	  */
+	void forgetAfterFork(std::thread& thread);
+
 } // namespace Thread
 } // namespace openmsx
 
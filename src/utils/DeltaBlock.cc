@@ -1,4 +1,5 @@
 #include "DeltaBlock.hh"
+#include "PageWriteTracker.hh"
 #include "snappy.hh"
 #include "likely.hh"
 #include <algorithm>
@@ -205,20 +206,18 @@ static std::pair<const uint8_t*, const uint8_t*> scan_match(
 //   n2 number of bytes are different, and here are the bytes
 //   n3 number of bytes are equal
 //   ...
-static vector<uint8_t> calcDelta(const uint8_t* oldBuf, const uint8_t* newBuf, size_t size)
-{
-	vector<uint8_t> result;
-
-	auto* p = oldBuf;
-	auto* q = newBuf;
-	auto* p_end = p + size;
-	auto* q_end = q + size;
 
+// Calculate the delta for the bytes [p, p_end), a part of the full buffers.
+// 'equal' is the number of equal bytes preceding this part that are not yet
+// stored in the result.
+static void calcDeltaPart(vector<uint8_t>& result, size_t& equal,
+                          const uint8_t* p, const uint8_t* p_end,
+                          const uint8_t* q, const uint8_t* q_end)
+{
 	// scan equal bytes (possibly zero)
 	auto* q1 = q;
 	std::tie(p, q) = scan_mismatch(p, p_end, q, q_end);
-	auto n1 = q - q1;
-	storeUleb(result, n1);
+	equal += q - q1;
 
 	while (q != q_end) {
 		assert(*p != *q);
@@ -233,12 +232,38 @@ static vector<uint8_t> calcDelta(const uint8_t* oldBuf, const uint8_t* newBuf, s
 		auto n3 = q - q3;
 		if ((q != q_end) && (n3 <= 2)) goto different;
 
+		storeUleb(result, equal);
 		storeUleb(result, n2);
 		result.insert(result.end(), q2, q3);
-
-		if (n3 != 0) storeUleb(result, n3);
+		equal = n3;
 	}
+}
 
+vector<uint8_t> calcDelta(const uint8_t* oldBuf, const uint8_t* newBuf, size_t size)
+{
+	vector<uint8_t> result;
+	size_t equal = 0;
+	calcDeltaPart(result, equal, oldBuf, oldBuf + size, newBuf, newBuf + size);
+	if ((equal != 0) || result.empty()) storeUleb(result, equal);
+	result.shrink_to_fit();
+	return result;
+}
+
+vector<uint8_t> calcDelta(const uint8_t* oldBuf, const uint8_t* newBuf, size_t size,
+                          const vector<std::pair<size_t, size_t>>& ranges)
+{
+	vector<uint8_t> result;
+	size_t equal = 0;
+	size_t pos = 0;
+	for (auto& r : ranges) {
+		assert((pos <= r.first) && (r.first <= r.second) && (r.second <= size));
+		equal += r.first - pos; // outside the ranges the bytes are equal
+		calcDeltaPart(result, equal, oldBuf + r.first, oldBuf + r.second,
+		                             newBuf + r.first, newBuf + r.second);
+		pos = r.second;
+	}
+	equal += size - pos;
+	if ((equal != 0) || result.empty()) storeUleb(result, equal);
 	result.shrink_to_fit();
 	return result;
 }
@@ -260,6 +285,41 @@ static void applyDeltaInPlace(uint8_t* buf, size_t size, const uint8_t* delta)
 	}
 }
 
+static bool loadUlebChecked(const uint8_t*& data, const uint8_t* end,
+                            size_t& result)
+{
+	result = 0;
+	for (unsigned shift = 0; (data != end) && (shift < 8 * sizeof(size_t)); shift += 7) {
+		uint8_t b = *data++;
+		result |= size_t(b & 0x7F) << shift;
+		if ((b & 0x80) == 0) return true;
+	}
+	return false;
+}
+
+bool applyDelta(uint8_t* buf, size_t size, const uint8_t* delta, size_t deltaSize)
+{
+	auto* end = buf + size;
+	auto* deltaEnd = delta + deltaSize;
+
+	while (buf != end) {
+		size_t n1;
+		if (!loadUlebChecked(delta, deltaEnd, n1)) return false;
+		if (n1 > size_t(end - buf)) return false;
+		buf += n1;
+		if (buf == end) break;
+
+		size_t n2;
+		if (!loadUlebChecked(delta, deltaEnd, n2)) return false;
+		if ((n2 > size_t(end - buf)) ||
+		    (n2 > size_t(deltaEnd - delta))) return false;
+		memcpy(buf, delta, n2);
+		buf   += n2;
+		delta += n2;
+	}
+	return true;
+}
+
 #if STATISTICS
 
 // class DeltaBlock
@@ -349,9 +409,11 @@ const uint8_t* DeltaBlockCopy::getData()
 
 DeltaBlockDiff::DeltaBlockDiff(
 		const std::shared_ptr<DeltaBlockCopy>& prev_,
-		const uint8_t* data, size_t size)
+		const uint8_t* data, size_t size,
+		const vector<std::pair<size_t, size_t>>* changed)
 	: prev(prev_)
-	, delta(calcDelta(prev->getData(), data, size))
+	, delta(changed ? calcDelta(prev->getData(), data, size, *changed)
+	                : calcDelta(prev->getData(), data, size))
 {
 #ifdef DEBUG
 	sha1 = SHA1::calc(data, size);
@@ -411,11 +473,16 @@ std::shared_ptr<DeltaBlock> LastDeltaBlocks::createNew(
 		it->ref = b;
 		it->last = b;
 		it->accSize = 0;
+		it->refEpoch = PageWriteTracker::getEpoch();
 		return b;
 	} else {
 		// Create diff based on earlier reference block.
-		// Reference remains unchanged.
-		auto b = std::make_shared<DeltaBlockDiff>(ref, data, size);
+		// Reference remains unchanged. If the memory is tracked, only
+		// the pages written since the reference was taken can differ.
+		bool tracked = PageWriteTracker::getChangedRanges(
+			data, size, it->refEpoch, changedRanges);
+		auto b = std::make_shared<DeltaBlockDiff>(
+			ref, data, size, tracked ? &changedRanges : nullptr);
 		it->last = b;
 		it->accSize += b->getDeltaSize();
 		return b;
@@ -440,6 +507,7 @@ std::shared_ptr<DeltaBlock> LastDeltaBlocks::createNullDiff(
 		it->ref = b;
 		it->last = b;
 		it->accSize = 0;
+		it->refEpoch = PageWriteTracker::getEpoch();
 		return b;
 	} else {
 #ifdef DEBUG
@@ -6,6 +6,7 @@
 #include "MemBuffer.hh"
 #include <cstdint>
 #include <memory>
+#include <utility>
 #include <vector>
 #ifdef DEBUG
 #include "sha1.hh"
@@ -13,6 +14,28 @@
 
 namespace openmsx {
 
+/** Calculate the difference between two buffers of equal size.
+  * Note: the content of 'oldBuf' is temporarily modified (and restored), so
+  * it must point to writable memory.
+  */
+std::vector<uint8_t> calcDelta(const uint8_t* oldBuf, const uint8_t* newBuf,
+                               size_t size);
+
+/** As above, but only the given (sorted, non-overlapping) ranges of
+  * [offset-begin, offset-end) can contain differences.
+  */
+std::vector<uint8_t> calcDelta(
+	const uint8_t* oldBuf, const uint8_t* newBuf, size_t size,
+	const std::vector<std::pair<size_t, size_t>>& ranges);
+
+/** Apply a delta, calculated by calcDelta(), to 'buf' (initially containing
+  * the content of 'oldBuf'). Unlike the DeltaBlock classes, this is meant for
+  * deltas loaded from a file: returns false when the delta is malformed.
+  */
+bool applyDelta(uint8_t* buf, size_t size,
+                const uint8_t* delta, size_t deltaSize);
+
+
 class DeltaBlock
 {
 public:
@@ -58,8 +81,11 @@ private:
 class DeltaBlockDiff final : public DeltaBlock
 {
 public:
+	/** When 'changed' is given, only those ranges are compared (see
+	  * calcDelta()), otherwise the full block. */
 	DeltaBlockDiff(const std::shared_ptr<DeltaBlockCopy>& prev_,
-	               const uint8_t* data, size_t size);
+	               const uint8_t* data, size_t size,
+	               const std::vector<std::pair<size_t, size_t>>* changed = nullptr);
 	void apply(uint8_t* dst, size_t size) const override;
 	size_t getDeltaSize() const;
 
@@ -81,16 +107,18 @@ public:
 private:
 	struct Info {
 		Info(const void* id_, size_t size_)
-			: id(id_), size(size_), accSize(0) {}
+			: id(id_), size(size_), accSize(0), refEpoch(0) {}
 
 		const void* id;
 		size_t size;
 		std::weak_ptr<DeltaBlockCopy> ref;
 		std::weak_ptr<DeltaBlock> last;
 		size_t accSize;
+		uint32_t refEpoch; // see PageWriteTracker
 	};
 
 	std::vector<Info> infos;
+	std::vector<std::pair<size_t, size_t>> changedRanges; // tmp buffer
 };
 
 } // namespace openmsx
@@ -198,6 +198,20 @@ inline unsigned countLeadingZeros(unsigned x)
 #endif
 }
 
+/** Count the number of 1-bits in the given word.
+  */
+inline unsigned countBits(unsigned x)
+{
+#ifdef __GNUC__
+	return __builtin_popcount(x);
+#else
+	x = x - ((x >> 1) & 0x55555555);
+	x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+	x = (x + (x >> 4)) & 0x0f0f0f0f;
+	return (x * 0x01010101) >> 24;
+#endif
+}
+
 } // namespace Math
 
 #endif // MATH_HH
@@ -0,0 +1,274 @@
+#include "PageWriteTracker.hh"
+#include <algorithm>
+#include <cassert>
+#ifdef __linux__
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace openmsx {
+
+namespace PageWriteTracker {
+
+// Maximum number of tracked blocks. The fault handler must be able to find
+// the blocks without taking locks or allocating memory, so the blocks are
+// stored in a fixed size table.
+static const unsigned MAX_REGIONS = 256;
+
+struct Region {
+	uintptr_t begin; // 0 means unused slot
+	size_t numPages;
+	size_t pageSize;
+	uint32_t* pageEpochs; // epoch in which each page was last written
+	uint8_t* dirty; // owner marked pages, nullptr when tracked via the MMU
+};
+
+static Region regions[MAX_REGIONS];
+static volatile uint32_t epoch = 1;
+
+static Region* addRegion(uintptr_t begin, size_t numPages, size_t pageSize,
+                         uint8_t* dirty)
+{
+	for (auto& r : regions) {
+		if (r.begin) continue;
+		// Initially all pages count as written in the current epoch.
+		// This also makes sure a block allocated at the same address
+		// as a freed block is never considered unchanged.
+		r.pageEpochs = new uint32_t[numPages];
+		for (size_t i = 0; i < numPages; ++i) r.pageEpochs[i] = epoch;
+		r.numPages = numPages;
+		r.pageSize = pageSize;
+		r.dirty = dirty;
+		r.begin = begin; // last, see faultHandler()
+		return &r;
+	}
+	return nullptr; // no free slot
+}
+
+static void removeRegion(Region& r)
+{
+	r.begin = 0;
+	delete[] r.pageEpochs;
+	r.pageEpochs = nullptr;
+	r.dirty = nullptr;
+}
+
+#ifdef __linux__
+
+// Blocks smaller than this number of pages are not tracked via the MMU.
+static const size_t MIN_PAGES = 4;
+
+static uintptr_t pageSize = 0;
+static struct sigaction oldAction;
+
+// Invariant: a page of a block tracked via the MMU is writable iff it was
+// written in the current epoch.
+static void faultHandler(int sig, siginfo_t* info, void* context)
+{
+	auto addr = reinterpret_cast<uintptr_t>(info->si_addr);
+	for (auto& r : regions) {
+		if (r.begin && !r.dirty && (addr >= r.begin) &&
+		    (addr < (r.begin + r.numPages * pageSize))) {
+			auto page = (addr - r.begin) / pageSize;
+			r.pageEpochs[page] = epoch;
+			mprotect(reinterpret_cast<void*>(r.begin + page * pageSize),
+			         pageSize, PROT_READ | PROT_WRITE);
+			return;
+		}
+	}
+	// not our fault, pass to the previous handler
+	if (oldAction.sa_flags & SA_SIGINFO) {
+		oldAction.sa_sigaction(sig, info, context);
+	} else if ((oldAction.sa_handler == SIG_DFL) ||
+	           (oldAction.sa_handler == SIG_IGN)) {
+		// restore default action, the faulting instruction will be
+		// retried and fault again
+		sigaction(SIGSEGV, &oldAction, nullptr);
+	} else {
+		oldAction.sa_handler(sig);
+	}
+}
+
+static bool installHandler()
+{
+	static bool installed = false;
+	if (installed) return true;
+
+	struct sigaction action;
+	action.sa_sigaction = faultHandler;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_SIGINFO | SA_NODEFER;
+	if (sigaction(SIGSEGV, &action, &oldAction) != 0) return false;
+	pageSize = sysconf(_SC_PAGESIZE);
+	installed = true;
+	return true;
+}
+
+void* allocate(size_t size)
+{
+	if (!installHandler()) return nullptr;
+	size_t numPages = (size + pageSize - 1) / pageSize;
+	if (numPages < MIN_PAGES) return nullptr;
+
+	void* data = mmap(nullptr, numPages * pageSize, PROT_READ | PROT_WRITE,
+	                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED) return nullptr;
+	if (!addRegion(reinterpret_cast<uintptr_t>(data), numPages, pageSize,
+	               nullptr)) {
+		munmap(data, numPages * pageSize);
+		return nullptr;
+	}
+	return data;
+}
+
+void release(void* data, size_t /*size*/)
+{
+	auto begin = reinterpret_cast<uintptr_t>(data);
+	for (auto& r : regions) {
+		if ((r.begin != begin) || r.dirty) continue;
+		size_t len = r.numPages * pageSize;
+		removeRegion(r);
+		munmap(data, len);
+		return;
+	}
+	assert(false);
+}
+
+// Write protect the pages that were written in the current epoch (merge
+// consecutive pages in a single system call).
+static void protectPages(const Region& r)
+{
+	size_t i = 0;
+	while (i < r.numPages) {
+		if (r.pageEpochs[i] != epoch) { ++i; continue; }
+		size_t j = i + 1;
+		while ((j < r.numPages) && (r.pageEpochs[j] == epoch)) ++j;
+		mprotect(reinterpret_cast<void*>(r.begin + i * pageSize),
+		         (j - i) * pageSize, PROT_READ);
+		i = j;
+	}
+}
+
+#else
+
+void* allocate(size_t /*size*/)
+{
+	return nullptr;
+}
+
+void release(void* /*data*/, size_t /*size*/)
+{
+	assert(false);
+}
+
+static void protectPages(const Region& /*r*/)
+{
+	assert(false);
+}
+
+#endif
+
+bool registerMemory(const void* data, size_t size, uint8_t* dirty)
+{
+	assert(dirty);
+	if (!data || !size) return false;
+	size_t numPages = (size + (1 << SOFT_PAGE_BITS) - 1) >> SOFT_PAGE_BITS;
+	return addRegion(reinterpret_cast<uintptr_t>(data), numPages,
+	                 1 << SOFT_PAGE_BITS, dirty) != nullptr;
+}
+
+void unregisterMemory(const void* data)
+{
+	auto begin = reinterpret_cast<uintptr_t>(data);
+	for (auto& r : regions) {
+		if (r.begin && (r.begin == begin) && r.dirty) {
+			removeRegion(r);
+			return;
+		}
+	}
+	// ok, registerMemory() may have failed
+}
+
+void newEpoch()
+{
+	for (auto& r : regions) {
+		if (!r.begin) continue;
+		if (r.dirty) {
+			for (size_t i = 0; i < r.numPages; ++i) {
+				if (r.dirty[i]) {
+					r.dirty[i] = 0;
+					r.pageEpochs[i] = epoch;
+				}
+			}
+		} else {
+			protectPages(r);
+		}
+	}
+	epoch = epoch + 1;
+}
+
+uint32_t getEpoch()
+{
+	return epoch;
+}
+
+bool getChangedRanges(const void* data, size_t size, uint32_t sinceEpoch,
+                      std::vector<std::pair<size_t, size_t>>& ranges)
+{
+	ranges.clear();
+	auto begin = reinterpret_cast<uintptr_t>(data);
+	for (auto& r : regions) {
+		if (!r.begin || (begin < r.begin) ||
+		    ((begin + size) > (r.begin + r.numPages * r.pageSize))) {
+			continue;
+		}
+		size_t offset = begin - r.begin;
+		size_t first = offset / r.pageSize;
+		size_t last = (offset + size + r.pageSize - 1) / r.pageSize;
+		for (size_t i = first; i < last; ++i) {
+			if ((r.pageEpochs[i] < sinceEpoch) &&
+			    !(r.dirty && r.dirty[i])) {
+				continue;
+			}
+			size_t b = std::max(i * r.pageSize, offset) - offset;
+			size_t e = std::min((i + 1) * r.pageSize, offset + size) - offset;
+			if (!ranges.empty() && (ranges.back().second == b)) {
+				ranges.back().second = e;
+			} else {
+				ranges.emplace_back(b, e);
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+} // namespace PageWriteTracker
+
+
+// class WriteTrackedBuffer
+
+WriteTrackedBuffer::WriteTrackedBuffer(size_t size_, bool track)
+	: dat(nullptr)
+	, size(size_)
+	, tracked(false)
+{
+	if (track) {
+		dat = static_cast<uint8_t*>(PageWriteTracker::allocate(size));
+		tracked = dat != nullptr;
+	}
+	if (!tracked) {
+		buf.resize(size);
+		dat = buf.data();
+	}
+}
+
+WriteTrackedBuffer::~WriteTrackedBuffer()
+{
+	if (tracked) {
+		PageWriteTracker::release(dat, size);
+	}
+}
+
+} // namespace openmsx
@@ -0,0 +1,98 @@
+#ifndef PAGEWRITETRACKER_HH
+#define PAGEWRITETRACKER_HH
+
+#include "MemBuffer.hh"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace openmsx {
+
+/** Track writes to (big) memory blocks.
+  *
+  * Each in-memory snapshot (see MemOutputArchive) starts a new 'epoch'. For
+  * each page of a tracked block the epoch in which it was last written is
+  * known. This allows to find the pages that were (possibly) written since
+  * some earlier snapshot, without comparing the full content of the block.
+  * The cost of a snapshot is then proportional to the number of pages that
+  * were touched.
+  *
+  * There are two ways to find the written pages:
+  * - Via the MMU (only implemented on Linux). At the start of an epoch all
+  *   pages are made read-only. The first write to such a page triggers a
+  *   fault, in the fault handler the page is marked as written in the
+  *   current epoch and made writable again. So after the first write to a
+  *   page, further writes run at full speed. This works for any memory,
+  *   but it must be allocated via allocate().
+  * - The owner of the memory marks the written pages itself, see
+  *   registerMemory(). This is for memory for which all writes go via a
+  *   few methods (e.g. TrackedRam).
+  *
+  * Note: the content of memory obtained via allocate() (after the first
+  * snapshot) should not be written via system calls (e.g. read() from a
+  * file). Those calls will fail instead of triggering the fault handler.
+  */
+namespace PageWriteTracker {
+
+	/** Page size for memory registered via registerMemory(). */
+	static const unsigned SOFT_PAGE_BITS = 12;
+
+	/** Allocate a block of memory that is tracked via the MMU. Returns
+	  * nullptr if that's not possible (e.g. not supported on this
+	  * platform, or the block is too small to be worth it).
+	  */
+	void* allocate(size_t size);
+
+	/** Release memory obtained via allocate(). */
+	void release(void* data, size_t size);
+
+	/** Track the given memory block, the owner marks the written pages
+	  * in 'dirty' (one byte per page of (1 << SOFT_PAGE_BITS) bytes, set
+	  * to a non-zero value on a write). Returns false if the block could
+	  * not be registered (then it's simply not tracked).
+	  */
+	bool registerMemory(const void* data, size_t size, uint8_t* dirty);
+
+	/** Stop tracking a block registered via registerMemory(). */
+	void unregisterMemory(const void* data);
+
+	/** Start a new epoch. */
+	void newEpoch();
+
+	/** The current epoch. */
+	uint32_t getEpoch();
+
+	/** Get the parts of [data, data + size) that (possibly) changed since
+	  * the start of the given epoch, as a sorted list of (begin, end)
+	  * offsets. Returns false when the memory isn't tracked (in that case
+	  * the whole block must be considered changed).
+	  */
+	bool getChangedRanges(const void* data, size_t size, uint32_t sinceEpoch,
+	                      std::vector<std::pair<size_t, size_t>>& ranges);
+}
+
+
+/** Memory block which, when requested and possible, uses tracked memory.
+  * Otherwise it uses plain heap memory.
+  */
+class WriteTrackedBuffer
+{
+public:
+	WriteTrackedBuffer(size_t size, bool track);
+	~WriteTrackedBuffer();
+
+	uint8_t* data() { return dat; }
+	const uint8_t* data() const { return dat; }
+	uint8_t& operator[](size_t i) { return dat[i]; }
+	const uint8_t& operator[](size_t i) const { return dat[i]; }
+
+private:
+	MemBuffer<uint8_t> buf; // only used when not tracked
+	uint8_t* dat;
+	const size_t size;
+	bool tracked;
+};
+
+} // namespace openmsx
+
+#endif
@@ -1,6 +1,9 @@
 #include "TigerTree.hh"
 #include "Math.hh"
+#include <algorithm>
 #include <map>
+#include <thread>
+#include <vector>
 #include <cstring>
 #include <cassert>
 
@@ -53,9 +56,67 @@ TigerTree::TigerTree(TTData& data_, size_t dataSize_, const std::string& name)
 
 const TigerHash& TigerTree::calcHash(const std::function<void(size_t, size_t)>& progressCallback)
 {
+	calcLeafHashes(progressCallback);
 	return calcHash(getTop(), progressCallback);
 }
 
+// Calculate the hashes of all invalid (full) leaf nodes, spread over all
+// cores. Only the hashing itself is done in parallel, fetching the data
+// happens in this thread (TTData is not thread-safe). The remaining nodes
+// (interior nodes and a partial last leaf) are much cheaper and are
+// calculated afterwards by the recursive calcHash().
+void TigerTree::calcLeafHashes(const std::function<void(size_t, size_t)>& progressCallback)
+{
+	if (entry.valid[getTop().n]) return; // nothing changed
+
+	unsigned numThreads = std::thread::hardware_concurrency();
+	if (numThreads <= 1) return;
+
+	// Each leaf is stored with some spare bytes in front of it, because
+	// tiger_leaf() temporarily overwrites the byte before the data.
+	static const size_t BATCH_SIZE = 4096; // number of leaves
+	static const size_t STRIDE = BLOCK_SIZE + 8;
+	MemBuffer<uint8_t> buffer(BATCH_SIZE * STRIDE);
+	std::vector<size_t> batch;
+	batch.reserve(BATCH_SIZE);
+
+	size_t numFullBlocks = dataSize / BLOCK_SIZE;
+	size_t block = 0;
+	while (block < numFullBlocks) {
+		batch.clear();
+		for (/**/; (block < numFullBlocks) && (batch.size() < BATCH_SIZE); ++block) {
+			if (entry.valid[getLeaf(block).n]) continue;
+			memcpy(&buffer[batch.size() * STRIDE + 8],
+			       data.getData(block * BLOCK_SIZE, BLOCK_SIZE),
+			       BLOCK_SIZE);
+			batch.push_back(block);
+		}
+
+		auto hashLeaves = [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i) {
+				tiger_leaf(&buffer[i * STRIDE + 8],
+				           entry.hash[getLeaf(batch[i]).n]);
+			}
+		};
+		size_t perThread = (batch.size() + numThreads - 1) / numThreads;
+		std::vector<std::thread> workers;
+		for (size_t first = perThread; first < batch.size(); first += perThread) {
+			workers.emplace_back(hashLeaves, first,
+			                     std::min(first + perThread, batch.size()));
+		}
+		hashLeaves(0, std::min(perThread, batch.size()));
+		for (auto& w : workers) w.join();
+
+		for (auto b : batch) {
+			entry.valid[getLeaf(b).n] = true;
+		}
+		entry.numNodesValid += batch.size();
+		if (progressCallback && !batch.empty()) {
+			progressCallback(entry.numNodesValid, entry.numNodes);
+		}
+	}
+}
+
 void TigerTree::notifyChange(size_t offset, size_t len, time_t time)
 {
 	entry.time = time;
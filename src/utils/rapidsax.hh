@@ -378,6 +378,125 @@ public:
 		}
 	}
 
+	// The following constructor and methods allow to use the parser in a
+	// 'pull' style: instead of parsing the whole document at once, the
+	// caller decides which parts of the document are parsed, and in which
+	// order (parts can also be skipped or parsed multiple times, as long
+	// as the input isn't modified, so use the noEntityTranslation flag
+	// and don't trim or normalize whitespace).
+	explicit Parser(HANDLER& handler_)
+		: handler(handler_)
+	{
+	}
+
+	// Parse the document prolog (XML declaration, doctype, comments, ...)
+	// up to the root element. Returns a pointer right after the '<' of
+	// the root element, or nullptr if the document has no root element.
+	char* parseProlog(char* text)
+	{
+		skipBOM(text);
+		while (true) {
+			skip<WhitespacePred>(text);
+			if (*text == 0) return nullptr;
+
+			if (*text != '<') {
+				throw ParseError("expected <", text);
+			}
+			++text; // skip '<'
+			if ((*text != '?') && (*text != '!')) return text;
+			parseNode(text);
+		}
+	}
+
+	// Parse the name and the attributes of an element. On entry 'text'
+	// points right after the '<'. Returns false for an empty element
+	// (<tag/>), otherwise 'text' points to the start of the contents.
+	bool parseStartTag(char*& text)
+	{
+		// Extract element name
+		char* name = text;
+		skip<NodeNamePred>(text);
+		char* nameEnd = text;
+		if (name == nameEnd) {
+			throw ParseError("expected element name", text);
+		}
+		handler.start(string_ref(name, nameEnd));
+
+		skip<WhitespacePred>(text); // skip ws before attributes or >
+		parseAttributes(text, false);
+
+		// Determine ending type
+		if (*text == '>') {
+			++text;
+			return true;
+		} else if (*text == '/') {
+			handler.stop();
+			++text;
+			if (*text != '>') {
+				throw ParseError("expected >", text);
+			}
+			++text;
+			return false;
+		} else {
+			throw ParseError("expected >", text);
+		}
+	}
+
+	// Parse the contents of an element (text, comments, ...) up to the
+	// next child element. Returns true and sets 'text' right after the
+	// '<' of the child element. Or returns false (with 'text' pointing
+	// to the '</') when the end tag was reached instead.
+	bool parseToNextChild(char*& text)
+	{
+		while (true) {
+			char* contentsStart = text; // start before ws is skipped
+			skip<WhitespacePred>(text); // Skip ws between > and contents
+
+			switch (*text) {
+			case '<':
+				if (text[1] == '/') {
+					return false;
+				}
+				++text; // skip '<'
+				if ((*text != '?') && (*text != '!')) {
+					return true;
+				}
+				parseNode(text);
+				break;
+
+			case '\0':
+				throw ParseError("unexpected end of data", text);
+
+			default:
+				parseText(text, contentsStart);
+				break;
+			}
+		}
+	}
+
+	// Parse the end tag of an element ('text' points to the '</').
+	void parseEndTag(char*& text)
+	{
+		text += 2; // skip '</'
+		skip<NodeNamePred>(text);
+		handler.stop();
+		// Skip remaining whitespace after node name
+		skip<WhitespacePred>(text);
+		if (*text != '>') {
+			throw ParseError("expected >", text);
+		}
+		++text; // skip '>'
+	}
+
+	// Parse a complete element, including all its children. On entry
+	// 'text' points right after the '<'.
+	void parseElement(char*& text)
+	{
+		if (parseStartTag(text)) {
+			parseNodeContents(text);
+		}
+	}
+
 private:
 	// Parse XML declaration (<?xml...)
 	void parseDeclaration(char*& text)
@@ -529,36 +648,6 @@ private:
 		text += 3; // skip ]]>
 	}
 
-	void parseElement(char*& text)
-	{
-		// Extract element name
-		char* name = text;
-		skip<NodeNamePred>(text);
-		char* nameEnd = text;
-		if (name == nameEnd) {
-			throw ParseError("expected element name", text);
-		}
-		handler.start(string_ref(name, nameEnd));
-
-		skip<WhitespacePred>(text); // skip ws before attributes or >
-		parseAttributes(text, false);
-
-		// Determine ending type
-		if (*text == '>') {
-			++text;
-			parseNodeContents(text);
-		} else if (*text == '/') {
-			handler.stop();
-			++text;
-			if (*text != '>') {
-				throw ParseError("expected >", text);
-			}
-			++text;
-		} else {
-			throw ParseError("expected >", text);
-		}
-	}
-
 	// Determine node type, and parse it
 	void parseNode(char*& text)
 	{
@@ -731,6 +820,19 @@ inline void parse(HANDLER& handler, char* xml)
 	internal::Parser<FLAGS, HANDLER> parser(handler, xml);
 }
 
+// Parser that is driven by the caller, see the comments in internal::Parser.
+template<int FLAGS, typename HANDLER>
+using PullParser = internal::Parser<FLAGS, HANDLER>;
+
+// Replace the XML entities in the given zero-terminated string (in-place).
+// This is for text that was parsed with the noEntityTranslation flag.
+// Returns the new end of the string.
+inline char* expandEntities(char* text)
+{
+	return internal::skipAndExpand<internal::TextPred,
+	                               internal::TextPureNoWsPred, 0>(text);
+}
+
 } // namespace rapidsax
 
 #endif
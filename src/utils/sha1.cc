@@ -23,6 +23,15 @@ A million repetitions of "a"
 #include "endian.hh"
 #include <cassert>
 #include <cstring>
+// The x86 SHA extensions are used when the CPU supports them (checked at
+// runtime, so the build doesn't need special compiler flags).
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA1_X86_EXTENSIONS 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define SHA1_X86_EXTENSIONS 0
+#endif
 
 using std::string;
 
@@ -168,7 +177,86 @@ SHA1::SHA1()
 	m_finalized = false;
 }
 
-void SHA1::transform(const uint8_t buffer[64])
+#if SHA1_X86_EXTENSIONS
+#define SHA1_TARGET __attribute__((target("sha,sse4.1")))
+
+static bool hasShaExtensions()
+{
+	unsigned eax, ebx, ecx, edx;
+	if (__get_cpuid_max(0, nullptr) < 7) return false;
+	__cpuid(1, eax, ebx, ecx, edx);
+	if (!(ecx & (1 << 9)) || !(ecx & (1 << 19))) return false; // SSSE3, SSE4.1
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & (1 << 29)) != 0; // SHA
+}
+
+// Perform 20 rounds (5 groups of 4) using the x86 SHA extensions. The message
+// schedule 'w' holds the last 16 words, in 4 groups of 4.
+template<int F>
+SHA1_TARGET static inline void shaRounds(
+	__m128i& abcd, __m128i& e, __m128i (&w)[4], int first)
+{
+	for (int g = first; g < (first + 5); ++g) {
+		if (g >= 4) {
+			w[g & 3] = _mm_sha1msg2_epu32(
+				_mm_xor_si128(
+					_mm_sha1msg1_epu32(w[g & 3], w[(g + 1) & 3]),
+					w[(g + 2) & 3]),
+				w[(g + 3) & 3]);
+		}
+		__m128i e2 = (g == 0) ? _mm_add_epi32(e, w[0])
+		                      : _mm_sha1nexte_epu32(e, w[g & 3]);
+		e = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e2, F);
+	}
+}
+
+SHA1_TARGET static void transformSha(
+	uint32_t state[5], const uint8_t* data, size_t numBlocks)
+{
+	const __m128i BSWAP = _mm_set_epi64x(
+		0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd = _mm_shuffle_epi32(
+		_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+	__m128i e = _mm_set_epi32(state[4], 0, 0, 0);
+
+	for (/**/; numBlocks; --numBlocks, data += 64) {
+		__m128i abcdSave = abcd;
+		__m128i eSave = e;
+		__m128i w[4];
+		for (int i = 0; i < 4; ++i) {
+			w[i] = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<const __m128i*>(data + 16 * i)), BSWAP);
+		}
+		shaRounds<0>(abcd, e, w,  0);
+		shaRounds<1>(abcd, e, w,  5);
+		shaRounds<2>(abcd, e, w, 10);
+		shaRounds<3>(abcd, e, w, 15);
+		e = _mm_sha1nexte_epu32(e, eSave);
+		abcd = _mm_add_epi32(abcd, abcdSave);
+	}
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+	                 _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = _mm_cvtsi128_si32(_mm_srli_si128(e, 12));
+}
+#endif
+
+void SHA1::transform(const uint8_t* data, size_t numBlocks)
+{
+#if SHA1_X86_EXTENSIONS
+	static const bool useSha = hasShaExtensions();
+	if (useSha) {
+		transformSha(m_state.a, data, numBlocks);
+		return;
+	}
+#endif
+	for (/**/; numBlocks; --numBlocks, data += 64) {
+		transformBlock(data);
+	}
+}
+
+void SHA1::transformBlock(const uint8_t buffer[64])
 {
 	WorkspaceBlock block(buffer);
 
@@ -227,10 +315,10 @@ void SHA1::update(const uint8_t* data, size_t len)
 	size_t i;
 	if ((j + len) > 63) {
 		memcpy(&m_buffer[j], data, (i = 64 - j));
-		transform(m_buffer);
-		for (; i + 63 < len; i += 64) {
-			transform(&data[i]);
-		}
+		transform(m_buffer, 1);
+		size_t numBlocks = (len - i) / 64;
+		transform(&data[i], numBlocks);
+		i += numBlocks * 64;
 		j = 0;
 	} else {
 		i = 0;
@@ -84,7 +84,8 @@ public:
 	static Sha1Sum calc(const uint8_t* data, size_t len);
 
 private:
-	void transform(const uint8_t buffer[64]);
+	void transform(const uint8_t* data, size_t numBlocks);
+	void transformBlock(const uint8_t buffer[64]);
 	void finalize();
 
 	uint64_t m_count;
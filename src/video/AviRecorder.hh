@@ -29,6 +29,7 @@ public:
 	void addImage(FrameSource* frame, EmuTime::param time);
 	void stop();
 	unsigned getFrameHeight() const;
+	bool isRecording() const { return aviWriter || wavWriter; }
 
 private:
 	void start(bool recordAudio, bool recordVideo, bool recordMono,
@@ -1,6 +1,7 @@
 // Code based on DOSBox-0.65
 
 #include "AviWriter.hh"
+#include "FrameSource.hh"
 #include "FileOperations.hh"
 #include "MSXException.hh"
 #include "memory.hh"
@@ -14,11 +15,13 @@
 namespace openmsx {
 
 static const unsigned AVI_HEADER_SIZE = 500;
+static const unsigned MAX_QUEUED_FRAMES = 8;
 
 AviWriter::AviWriter(const Filename& filename, unsigned width_,
                      unsigned height_, unsigned bpp, unsigned channels_,
 		     unsigned freq_)
-	: file(filename, "wb")
+	: stopEncoder(false)
+	, file(filename, "wb")
 	, codec(width_, height_, bpp)
 	, fps(0.0f) // will be filled in later
 	, width(width_)
@@ -35,10 +38,20 @@ AviWriter::AviWriter(const Filename& filename, unsigned width_,
 	frames = 0;
 	written = 0;
 	audiowritten = 0;
+
+	encoderThread = std::thread([this]() { encoderLoop(); });
 }
 
 AviWriter::~AviWriter()
 {
+	// first encode all pending frames
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopEncoder = true;
+	}
+	condition.notify_all();
+	encoderThread.join();
+
 	if (written == 0) {
 		// no data written yet (a recording less than one video frame)
 		std::string filename = file.getURL();
@@ -245,13 +258,63 @@ void AviWriter::addAviChunk(const char* tag, unsigned size, void* data, unsigned
 }
 
 void AviWriter::addFrame(FrameSource* frame, unsigned samples, int16_t* sampleData)
+{
+	// Capture the frame now, the FrameSource is not valid anymore
+	// after we return.
+	Frame f;
+	f.pixelFormat = frame->getSDLPixelFormat();
+	f.pixels.resize(codec.getFrameSize());
+	codec.captureFrame(frame, f.pixels.data());
+	f.samples.assign(sampleData, sampleData + samples);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!error.empty()) {
+		std::string message = std::move(error);
+		error.clear();
+		throw MSXException("Error while writing avi file: " + message);
+	}
+	condition.wait(lock, [&] { return queue.size() < MAX_QUEUED_FRAMES; });
+	queue.push_back(std::move(f));
+	lock.unlock();
+	condition.notify_all();
+}
+
+void AviWriter::encoderLoop()
+{
+	bool failed = false;
+	while (true) {
+		Frame frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [&] {
+				return !queue.empty() || stopEncoder; });
+			if (queue.empty()) return; // stopped and nothing pending
+			frame = std::move(queue.front());
+			queue.pop_front();
+		}
+		condition.notify_all(); // there's room for a new frame
+
+		if (failed) continue; // drop remaining frames
+		try {
+			encodeFrame(frame);
+		} catch (MSXException& e) {
+			failed = true;
+			std::lock_guard<std::mutex> lock(mutex);
+			error = e.getMessage();
+		}
+	}
+}
+
+void AviWriter::encodeFrame(const Frame& frame)
 {
 	bool keyFrame = (frames++ % 300 == 0);
 	void* buffer;
 	unsigned size;
-	codec.compressFrame(keyFrame, frame, buffer, size);
+	codec.compressFrame(keyFrame, frame.pixels.data(), frame.pixelFormat,
+	                    buffer, size);
 	addAviChunk("00dc", size, buffer, keyFrame ? 0x10 : 0x0);
 
+	auto samples = unsigned(frame.samples.size());
 	if (samples) {
 		assert((samples % channels) == 0);
 		assert(audiorate != 0);
@@ -261,11 +324,12 @@ void AviWriter::addFrame(FrameSource* frame, unsigned samples, int16_t* sampleDa
 			//std::vector<Endian::L16> buf(sampleData, sampleData + samples); // needs c++11
 			std::vector<Endian::L16> buf(samples);
 			for (unsigned i = 0; i < samples; ++i) {
-				buf[i] = sampleData[i];
+				buf[i] = frame.samples[i];
 			}
 			addAviChunk("01wb", samples * sizeof(int16_t), buf.data(), 0);
 		} else {
-			addAviChunk("01wb", samples * sizeof(int16_t), sampleData, 0);
+			addAviChunk("01wb", samples * sizeof(int16_t),
+			            const_cast<int16_t*>(frame.samples.data()), 0);
 		}
 		audiowritten += samples;
 	}
@@ -5,8 +5,15 @@
 
 #include "ZMBVEncoder.hh"
 #include "File.hh"
+#include "MemBuffer.hh"
 #include "endian.hh"
+#include <SDL.h>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 #include <memory>
 
@@ -15,6 +22,10 @@ namespace openmsx {
 class Filename;
 class FrameSource;
 
+/** Writes a ZMBV encoded avi file.
+ * Only capturing the frame happens in the calling thread, the actual
+ * encoding and writing happens in a separate thread.
+ */
 class AviWriter
 {
 public:
@@ -25,8 +36,25 @@ public:
 	void setFps(float fps_) { fps = fps_; }
 
 private:
+	struct Frame {
+		SDL_PixelFormat pixelFormat;
+		MemBuffer<uint8_t> pixels;
+		std::vector<int16_t> samples;
+	};
+
+	void encoderLoop();
+	void encodeFrame(const Frame& frame);
 	void addAviChunk(const char* tag, unsigned size, void* data, unsigned flags);
 
+	// Frames waiting to be encoded. When the encoder can't keep up with
+	// the emulation, addFrame() blocks, so memory usage stays bounded.
+	std::deque<Frame> queue;
+	std::mutex mutex; // protects queue, error and stopEncoder
+	std::condition_variable condition;
+	std::string error;
+	bool stopEncoder;
+	std::thread encoderThread;
+
 	File file;
 	ZMBVEncoder codec;
 	std::vector<Endian::L32> index;
@@ -19,6 +19,7 @@
 #include "XMLElement.hh"
 #include "VideoSystemChangeListener.hh"
 #include "CommandException.hh"
+#include "StartupProfiler.hh"
 #include "StringOp.hh"
 #include "Version.hh"
 #include "build-info.hh"
@@ -307,6 +308,7 @@ void Display::doRendererSwitch2()
 	}
 
 	resetVideoSystem();
+	StartupProfiler::Phase profile("video system");
 	videoSystem = RendererFactory::createVideoSystem(reactor);
 
 	for (auto& l : listeners) {
@@ -13,7 +13,7 @@ namespace openmsx {
 
 DummyVRAMOBserver VRAMWindow::dummyObserver;
 
-VRAMWindow::VRAMWindow(Ram& vram)
+VRAMWindow::VRAMWindow(TrackedRam& vram)
 	: data(&vram[0])
 {
 	observer = &dummyObserver;
@@ -146,7 +146,8 @@ void VDPVRAM::clear()
 		// Read from unconnected VRAM returns random data.
 		// TODO reading same location multiple times does not always
 		// give the same value.
-		memset(&data[actualSize], 0xFF, data.getSize() - actualSize);
+		memset(data.getWriteBackdoor() + actualSize, 0xFF,
+		       data.getSize() - actualSize);
 	}
 }
 
@@ -212,15 +213,16 @@ void VDPVRAM::updateVRMode(bool newVRmode, EmuTime::param time)
 	vrMode = newVRmode;
 	setSizeMask(time);
 
+	byte* d = data.getWriteBackdoor();
 	if (vrMode) {
 		// switch from VR=0 to VR=1
 		for (int i = 0x7FFF; i >=0; --i) {
-			std::swap(data[i], data[swapAddr(i)]);
+			std::swap(d[i], d[swapAddr(i)]);
 		}
 	} else {
 		// switch from VR=1 to VR=0
 		for (int i = 0; i < 0x8000; ++i) {
-			std::swap(data[i], data[swapAddr(i)]);
+			std::swap(d[i], d[swapAddr(i)]);
 		}
 	}
 }
@@ -304,7 +306,7 @@ void VDPVRAM::change4k8kMapping(bool mapping8k)
 			memcpy(dst, src, 64);
 		}
 	}
-	memcpy(&data[0], tmp, sizeof(tmp));
+	memcpy(data.getWriteBackdoor(), tmp, sizeof(tmp));
 }
 
 
@@ -329,7 +331,7 @@ void VDPVRAM::serialize(Archive& ar, unsigned /*version*/)
 		setSizeMask(static_cast<MSXDevice&>(vdp).getCurrentTime());
 	}
 
-	ar.serialize_blob("data", &data[0], actualSize);
+	data.serializeBlob(ar, "data", actualSize);
 	ar.serialize("cmdReadWindow",       cmdReadWindow);
 	ar.serialize("cmdWriteWindow",      cmdWriteWindow);
 	ar.serialize("nameTable",           nameTable);
@@ -5,7 +5,7 @@
 #include "VDP.hh"
 #include "VDPCmdEngine.hh"
 #include "SimpleDebuggable.hh"
-#include "Ram.hh"
+#include "TrackedRam.hh"
 #include "Math.hh"
 #include "openmsx.hh"
 #include "likely.hh"
@@ -334,11 +334,11 @@ private:
 	/** Create a new window.
 	  * Initially, the window is disabled; use setRange to enable it.
 	  */
-	explicit VRAMWindow(Ram& vram);
+	explicit VRAMWindow(TrackedRam& vram);
 
 	/** Pointer to the entire VRAM data.
 	  */
-	byte* data;
+	const byte* data;
 
 	/** Observer associated with this VRAM window.
 	  * It will be called when changes occur within the window.
@@ -567,7 +567,7 @@ private:
 		spriteAttribTable.notify(address, time);
 		spritePatternTable.notify(address, time);
 
-		data[address] = value;
+		data.write(address, value);
 
 		// Cache dirty marking should happen after the commit,
 		// otherwise the cache could be re-validated based on old state.
@@ -603,7 +603,7 @@ private:
 
 	/** VRAM data block.
 	  */
-	Ram data;
+	TrackedRam data;
 
 	/** Debuggable with mode dependend view on the vram
 	  *   Screen7/8 are not interleaved in this mode.
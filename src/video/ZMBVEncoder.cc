@@ -5,12 +5,17 @@
 #include "PixelOperations.hh"
 #include "unreachable.hh"
 #include "endian.hh"
+#include "Math.hh"
 #include <algorithm>
 #include <iterator>
+#include <thread>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace openmsx {
 
@@ -21,6 +26,8 @@ static const unsigned MAX_VECTOR = 16;
 static const unsigned BLOCK_WIDTH  = MAX_VECTOR;
 static const unsigned BLOCK_HEIGHT = MAX_VECTOR;
 static const unsigned FLAG_KEYFRAME = 0x01;
+// maximum number of slices (threads) used for the motion search
+static const unsigned MAX_SLICES = 8;
 
 struct CodecVector {
 	float cost() const {
@@ -83,6 +90,43 @@ static inline void writePixel(
 	dest = (r << 16) | (g <<  8) |  b;
 }
 
+// Returns the number of different pixels in one row of a block.
+#ifdef __SSE2__
+static_assert(BLOCK_WIDTH == 16, "SSE2 routines below assume this");
+static inline unsigned countDiffRow(const uint16_t* a, const uint16_t* b)
+{
+	auto* pa = reinterpret_cast<const __m128i*>(a);
+	auto* pb = reinterpret_cast<const __m128i*>(b);
+	__m128i e0 = _mm_cmpeq_epi16(_mm_loadu_si128(pa + 0), _mm_loadu_si128(pb + 0));
+	__m128i e1 = _mm_cmpeq_epi16(_mm_loadu_si128(pa + 1), _mm_loadu_si128(pb + 1));
+	unsigned equal = _mm_movemask_epi8(_mm_packs_epi16(e0, e1));
+	return BLOCK_WIDTH - Math::countBits(equal);
+}
+static inline unsigned countDiffRow(const uint32_t* a, const uint32_t* b)
+{
+	auto* pa = reinterpret_cast<const __m128i*>(a);
+	auto* pb = reinterpret_cast<const __m128i*>(b);
+	__m128i e0 = _mm_cmpeq_epi32(_mm_loadu_si128(pa + 0), _mm_loadu_si128(pb + 0));
+	__m128i e1 = _mm_cmpeq_epi32(_mm_loadu_si128(pa + 1), _mm_loadu_si128(pb + 1));
+	__m128i e2 = _mm_cmpeq_epi32(_mm_loadu_si128(pa + 2), _mm_loadu_si128(pb + 2));
+	__m128i e3 = _mm_cmpeq_epi32(_mm_loadu_si128(pa + 3), _mm_loadu_si128(pb + 3));
+	__m128i e01 = _mm_packs_epi32(e0, e1);
+	__m128i e23 = _mm_packs_epi32(e2, e3);
+	unsigned equal = _mm_movemask_epi8(_mm_packs_epi16(e01, e23));
+	return BLOCK_WIDTH - Math::countBits(equal);
+}
+#else
+template<class P>
+static inline unsigned countDiffRow(const P* a, const P* b)
+{
+	unsigned ret = 0;
+	for (unsigned x = 0; x < BLOCK_WIDTH; ++x) {
+		if (a[x] != b[x]) ++ret;
+	}
+	return ret;
+}
+#endif
+
 static void createVectorTable()
 {
 	unsigned p = 0;
@@ -118,7 +162,12 @@ static void createVectorTable()
 }
 
 ZMBVEncoder::ZMBVEncoder(unsigned width_, unsigned height_, unsigned bpp)
-	: width(width_)
+	: sliceJob(nullptr)
+	, jobSlices(0)
+	, jobCounter(0)
+	, pendingSlices(0)
+	, stopWorkers(false)
+	, width(width_)
 	, height(height_)
 {
 	setupBuffers(bpp);
@@ -145,6 +194,16 @@ ZMBVEncoder::ZMBVEncoder(unsigned width_, unsigned height_, unsigned bpp)
 	// Level 6 seems a good compromise between size/speed for THIS test.
 }
 
+ZMBVEncoder::~ZMBVEncoder()
+{
+	{
+		std::lock_guard<std::mutex> lock(workMutex);
+		stopWorkers = true;
+	}
+	workCondition.notify_all();
+	for (auto& w : workers) w.join();
+}
+
 void ZMBVEncoder::setupBuffers(unsigned bpp)
 {
 	switch (bpp) {
@@ -198,11 +257,11 @@ unsigned ZMBVEncoder::neededSize()
 }
 
 template<class P>
-unsigned ZMBVEncoder::possibleBlock(int vx, int vy, unsigned offset)
+unsigned ZMBVEncoder::possibleBlock(int vx, int vy, unsigned offset) const
 {
 	int ret = 0;
-	auto* pold = &(reinterpret_cast<P*>(oldframe.data()))[offset + (vy * pitch) + vx];
-	auto* pnew = &(reinterpret_cast<P*>(newframe.data()))[offset];
+	auto* pold = &(reinterpret_cast<const P*>(oldframe.data()))[offset + (vy * pitch) + vx];
+	auto* pnew = &(reinterpret_cast<const P*>(newframe.data()))[offset];
 	for (unsigned y = 0; y < BLOCK_HEIGHT; y += 4) {
 		for (unsigned x = 0; x < BLOCK_WIDTH; x += 4) {
 			if (pold[x] != pnew[x]) ++ret;
@@ -214,15 +273,13 @@ unsigned ZMBVEncoder::possibleBlock(int vx, int vy, unsigned offset)
 }
 
 template<class P>
-unsigned ZMBVEncoder::compareBlock(int vx, int vy, unsigned offset)
+unsigned ZMBVEncoder::compareBlock(int vx, int vy, unsigned offset) const
 {
-	int ret = 0;
-	auto* pold = &(reinterpret_cast<P*>(oldframe.data()))[offset + (vy * pitch) + vx];
-	auto* pnew = &(reinterpret_cast<P*>(newframe.data()))[offset];
+	unsigned ret = 0;
+	auto* pold = &(reinterpret_cast<const P*>(oldframe.data()))[offset + (vy * pitch) + vx];
+	auto* pnew = &(reinterpret_cast<const P*>(newframe.data()))[offset];
 	for (unsigned y = 0; y < BLOCK_HEIGHT; ++y) {
-		for (unsigned x = 0; x < BLOCK_WIDTH; ++x) {
-			if (pold[x] != pnew[x]) ++ret;
-		}
+		ret += countDiffRow(pold, pnew);
 		pold += pitch;
 		pnew += pitch;
 	}
@@ -231,17 +288,18 @@ unsigned ZMBVEncoder::compareBlock(int vx, int vy, unsigned offset)
 
 template<class P>
 void ZMBVEncoder::addXorBlock(
-	const PixelOperations<P>& pixelOps, int vx, int vy, unsigned offset, unsigned& workUsed)
+	const PixelOperations<P>& pixelOps, int vx, int vy, unsigned offset,
+	uint8_t* dest, unsigned& destUsed) const
 {
 	using LE_P = typename Endian::Little<P>::type;
 
-	auto* pold = &(reinterpret_cast<P*>(oldframe.data()))[offset + (vy * pitch) + vx];
-	auto* pnew = &(reinterpret_cast<P*>(newframe.data()))[offset];
+	auto* pold = &(reinterpret_cast<const P*>(oldframe.data()))[offset + (vy * pitch) + vx];
+	auto* pnew = &(reinterpret_cast<const P*>(newframe.data()))[offset];
 	for (unsigned y = 0; y < BLOCK_HEIGHT; ++y) {
 		for (unsigned x = 0; x < BLOCK_WIDTH; ++x) {
 			P pxor = pnew[x] ^ pold[x];
-			writePixel(pixelOps, pxor, *reinterpret_cast<LE_P*>(&work[workUsed]));
-			workUsed += sizeof(P);
+			writePixel(pixelOps, pxor, *reinterpret_cast<LE_P*>(&dest[destUsed]));
+			destUsed += sizeof(P);
 		}
 		pold += pitch;
 		pnew += pitch;
@@ -261,9 +319,95 @@ void ZMBVEncoder::addXorFrame(const SDL_PixelFormat& pixelFormat, unsigned& work
 	// Align the following xor data on 4 byte boundary
 	workUsed = (workUsed + blockcount * 2 + 3) & ~3;
 
+	// The motion search of a block only depends on the previous block (to
+	// get an initial guess for the vector). So we can split the frame in
+	// horizontal slices and search those in parallel. The xor data of the
+	// slices is concatenated afterwards and compressed as before, so the
+	// result is still a valid ZMBV stream.
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	unsigned numSlices = std::min(std::min(threads, MAX_SLICES), yblocks);
+	unsigned rowsPerSlice = (yblocks + numSlices - 1) / numSlices;
+	numSlices = (yblocks + rowsPerSlice - 1) / rowsPerSlice;
+
+	unsigned sliceSize = rowsPerSlice * xblocks *
+	                     BLOCK_WIDTH * BLOCK_HEIGHT * sizeof(P);
+	sliceBufs.resize(numSlices - 1);
+	for (auto& buf : sliceBufs) buf.resize(sliceSize);
+	std::vector<unsigned> sliceUsed(numSlices, 0);
+
+	runSlices(numSlices, [&](unsigned s) {
+		unsigned first = s * rowsPerSlice * xblocks;
+		unsigned last = std::min((s + 1) * rowsPerSlice, yblocks) * xblocks;
+		if (s == 0) {
+			// first slice directly in the work buffer
+			addXorSlice<P>(pixelOps, first, last, vectors,
+			               work.data(), workUsed);
+		} else {
+			addXorSlice<P>(pixelOps, first, last, vectors,
+			               sliceBufs[s - 1].data(), sliceUsed[s]);
+		}
+	});
+
+	for (unsigned s = 1; s < numSlices; ++s) {
+		memcpy(&work[workUsed], sliceBufs[s - 1].data(), sliceUsed[s]);
+		workUsed += sliceUsed[s];
+	}
+}
+
+// Run job(0) in this thread and job(1) .. job(numSlices - 1) in the helper
+// threads, returns when all are finished.
+void ZMBVEncoder::runSlices(unsigned numSlices,
+                            const std::function<void(unsigned)>& job)
+{
+	while (workers.size() < (numSlices - 1)) {
+		unsigned slice = unsigned(workers.size()) + 1;
+		workers.emplace_back([this, slice]() { workerLoop(slice); });
+	}
+	{
+		std::lock_guard<std::mutex> lock(workMutex);
+		sliceJob = &job;
+		jobSlices = numSlices;
+		pendingSlices = numSlices - 1;
+		++jobCounter;
+	}
+	workCondition.notify_all();
+
+	job(0);
+
+	std::unique_lock<std::mutex> lock(workMutex);
+	doneCondition.wait(lock, [&] { return pendingSlices == 0; });
+	sliceJob = nullptr;
+}
+
+void ZMBVEncoder::workerLoop(unsigned slice)
+{
+	unsigned lastJob = 0;
+	std::unique_lock<std::mutex> lock(workMutex);
+	while (true) {
+		workCondition.wait(lock, [&] {
+			return stopWorkers || (jobCounter != lastJob);
+		});
+		if (stopWorkers) return;
+		lastJob = jobCounter;
+		if (slice >= jobSlices) continue; // not needed for this job
+
+		auto* job = sliceJob;
+		lock.unlock();
+		(*job)(slice);
+		lock.lock();
+		if (--pendingSlices == 0) doneCondition.notify_one();
+	}
+}
+
+template<class P>
+void ZMBVEncoder::addXorSlice(
+	const PixelOperations<P>& pixelOps, unsigned firstBlock,
+	unsigned lastBlock, int8_t* vectors, uint8_t* dest,
+	unsigned& destUsed) const
+{
 	int bestvx = 0;
 	int bestvy = 0;
-	for (unsigned b = 0; b < blockcount; ++b) {
+	for (unsigned b = firstBlock; b < lastBlock; ++b) {
 		unsigned offset = blockOffsets[b];
 		// first try best vector of previous block
 		unsigned bestchange = compareBlock<P>(bestvx, bestvy, offset);
@@ -287,7 +431,7 @@ void ZMBVEncoder::addXorFrame(const SDL_PixelFormat& pixelFormat, unsigned& work
 		vectors[b * 2 + 1] = (bestvy << 1);
 		if (bestchange) {
 			vectors[b * 2 + 0] |= 1;
-			addXorBlock<P>(pixelOps, bestvx, bestvy, offset, workUsed);
+			addXorBlock<P>(pixelOps, bestvx, bestvy, offset, dest, destUsed);
 		}
 	}
 }
@@ -311,7 +455,7 @@ void ZMBVEncoder::addFullFrame(const SDL_PixelFormat& pixelFormat, unsigned& wor
 	}
 }
 
-const void* ZMBVEncoder::getScaledLine(FrameSource* frame, unsigned y, void* buf_)
+const void* ZMBVEncoder::getScaledLine(FrameSource* frame, unsigned y, void* buf_) const
 {
 #if HAVE_32BPP
 	if (pixelSize == 4) { // 32bpp
@@ -347,7 +491,18 @@ const void* ZMBVEncoder::getScaledLine(FrameSource* frame, unsigned y, void* buf
 	return nullptr; // avoid warning
 }
 
-void ZMBVEncoder::compressFrame(bool keyFrame, FrameSource* frame,
+void ZMBVEncoder::captureFrame(FrameSource* frame, uint8_t* dest) const
+{
+	unsigned lineWidth = width * pixelSize;
+	for (unsigned i = 0; i < height; ++i) {
+		auto* scaled = getScaledLine(frame, i, dest);
+		if (scaled != dest) memcpy(dest, scaled, lineWidth);
+		dest += lineWidth;
+	}
+}
+
+void ZMBVEncoder::compressFrame(bool keyFrame, const uint8_t* pixels,
+                                const SDL_PixelFormat& pixelFormat,
                                 void*& buffer, unsigned& written)
 {
 	std::swap(newframe, oldframe); // replace oldframe with newframe
@@ -378,8 +533,8 @@ void ZMBVEncoder::compressFrame(bool keyFrame, FrameSource* frame,
 	uint8_t* dest =
 		&newframe[pixelSize * (MAX_VECTOR + MAX_VECTOR * pitch)];
 	for (unsigned i = 0; i < height; ++i) {
-		auto* scaled = getScaledLine(frame, i, dest);
-		if (scaled != dest) memcpy(dest, scaled, lineWidth);
+		memcpy(dest, pixels, lineWidth);
+		pixels += lineWidth;
 		dest += linePitch;
 	}
 
@@ -389,12 +544,12 @@ void ZMBVEncoder::compressFrame(bool keyFrame, FrameSource* frame,
 		switch (pixelSize) {
 #if HAVE_16BPP
 		case 2:
-			addFullFrame<uint16_t>(frame->getSDLPixelFormat(), workUsed);
+			addFullFrame<uint16_t>(pixelFormat, workUsed);
 			break;
 #endif
 #if HAVE_32BPP
 		case 4:
-			addFullFrame<uint32_t>(frame->getSDLPixelFormat(), workUsed);
+			addFullFrame<uint32_t>(pixelFormat, workUsed);
 			break;
 #endif
 		default:
@@ -405,12 +560,12 @@ void ZMBVEncoder::compressFrame(bool keyFrame, FrameSource* frame,
 		switch (pixelSize) {
 #if HAVE_16BPP
 		case 2:
-			addXorFrame<uint16_t>(frame->getSDLPixelFormat(), workUsed);
+			addXorFrame<uint16_t>(pixelFormat, workUsed);
 			break;
 #endif
 #if HAVE_32BPP
 		case 4:
-			addXorFrame<uint32_t>(frame->getSDLPixelFormat(), workUsed);
+			addXorFrame<uint32_t>(pixelFormat, workUsed);
 			break;
 #endif
 		default:
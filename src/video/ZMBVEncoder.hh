@@ -4,7 +4,12 @@
 #define ZMBVENCODER_HH
 
 #include "MemBuffer.hh"
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <zlib.h>
 
 struct SDL_PixelFormat;
@@ -20,8 +25,20 @@ public:
 	static const char* CODEC_4CC;
 
 	ZMBVEncoder(unsigned width, unsigned height, unsigned bpp);
+	~ZMBVEncoder();
 
-	void compressFrame(bool keyFrame, FrameSource* frame,
+	/** Size (in bytes) of a captured frame, see captureFrame(). */
+	unsigned getFrameSize() const { return width * height * pixelSize; }
+
+	/** Copy the (scaled) lines of the given frame into 'dest'. This
+	  * doesn't touch the encoder state, so it can run in a different
+	  * thread than compressFrame().
+	  */
+	void captureFrame(FrameSource* frame, uint8_t* dest) const;
+
+	/** Compress a frame previously captured with captureFrame(). */
+	void compressFrame(bool keyFrame, const uint8_t* pixels,
+	                   const SDL_PixelFormat& pixelFormat,
 	                   void*& buffer, unsigned& written);
 
 private:
@@ -31,21 +48,41 @@ private:
 	};
 
 	void setupBuffers(unsigned bpp);
+	void runSlices(unsigned numSlices, const std::function<void(unsigned)>& job);
+	void workerLoop(unsigned slice);
 	unsigned neededSize();
 	template<class P> void addFullFrame(const SDL_PixelFormat& pixelFormat, unsigned& workUsed);
 	template<class P> void addXorFrame (const SDL_PixelFormat& pixelFormat, unsigned& workUsed);
-	template<class P> unsigned possibleBlock(int vx, int vy, unsigned offset);
-	template<class P> unsigned compareBlock(int vx, int vy, unsigned offset);
+	template<class P> void addXorSlice(
+		const PixelOperations<P>& pixelOps, unsigned firstBlock,
+		unsigned lastBlock, int8_t* vectors, uint8_t* dest,
+		unsigned& destUsed) const;
+	template<class P> unsigned possibleBlock(int vx, int vy, unsigned offset) const;
+	template<class P> unsigned compareBlock(int vx, int vy, unsigned offset) const;
 	template<class P> void addXorBlock(
 		const PixelOperations<P>& pixelOps, int vx, int vy,
-		unsigned offset, unsigned& workUsed);
-	const void* getScaledLine(FrameSource* frame, unsigned y, void* workBuf);
+		unsigned offset, uint8_t* dest, unsigned& destUsed) const;
+	const void* getScaledLine(FrameSource* frame, unsigned y, void* workBuf) const;
 
 	MemBuffer<uint8_t, SSE2_ALIGNMENT> oldframe;
 	MemBuffer<uint8_t, SSE2_ALIGNMENT> newframe;
 	MemBuffer<uint8_t, SSE2_ALIGNMENT> work;
 	MemBuffer<uint8_t> output;
 	MemBuffer<unsigned> blockOffsets;
+	// xor data of all but the first slice (see addXorFrame())
+	std::vector<MemBuffer<uint8_t>> sliceBufs;
+	// Helper threads for the motion search, worker 'i' always handles
+	// slice 'i + 1'. Started on the first xor frame, kept until the
+	// encoder is destroyed.
+	std::vector<std::thread> workers;
+	std::mutex workMutex; // protects the members below
+	std::condition_variable workCondition; // new job or stopWorkers
+	std::condition_variable doneCondition; // pendingSlices became 0
+	const std::function<void(unsigned)>* sliceJob;
+	unsigned jobSlices;     // number of slices of the current job
+	unsigned jobCounter;    // incremented for each new job
+	unsigned pendingSlices; // slices of the current job still running
+	bool stopWorkers;
 	unsigned outputSize;
 
 	z_stream zstream;